@@ -0,0 +1,562 @@
+#include "javac.h"
+
+#include <pthread.h>
+
+// The atom table keeps exactly one copy of every distinct spelling
+// seen by the lexer. An atom stays valid until atom_finit(), so names
+// in the tree and in later symbol tables are compared by pointer.
+// The hash is computed once, when a spelling is interned.
+//
+// Any number of threads may intern at once, without a lock, between
+// atom_share(true) and atom_share(false). The table is then a
+// split-ordered list: all atoms sit in one linked list
+// sorted by their hash with the bits reversed, so the atoms of bucket b
+// are together, right after a dummy node for b, and they stay together
+// when the bucket count doubles, as bucket b splits into b and
+// b + n_buckets by the next hash bit: a dummy is simply put in the
+// middle. Buckets are made the first time they are used, from the
+// bucket they split from. A bucket is its dummy, kept in the bucket
+// array, so a lookup goes from the array straight to the atoms.
+//
+// A lookup walks from the dummy of its bucket, and an atom is put in
+// with a compare-and-swap of the link before it; a thread losing the
+// race walks again. Nothing is ever removed or moved, so the list
+// needs no more than that. The bucket count doubles whenever the load
+// factor reaches 1, so chains stay short on large inputs; only new
+// bucket segments are made, nothing is rehashed.
+// Atoms are never freed one by one, they come from a shared arena.
+//
+// The rest of the time one thread interns, and the list costs more
+// than it gives: a lookup goes through the dummy, and a miss walks
+// the list again to link the atom in. Those atoms are found through a
+// plain chained table instead, the buckets doubling as the load factor
+// reaches 1. Switching over puts the atoms made since the last switch
+// into the other table, so each table holds every atom when in use.
+#define ATOM_MAX_BUCKETS (1u << 30)
+
+// The order of an atom is its hash reversed, with the low bit set;
+// that of a dummy does not have it, so a dummy for b comes before
+// every atom of its bucket. The order holds all but the top bit of
+// the hash, the chained table compares the hash itself.
+#define ATOM_ORDER_DUMMY(B) (atom_reverse(B))
+#define ATOM_ORDER(HASH) (atom_reverse((HASH) | 0x80000000u))
+#define ATOM_IS_DUMMY(N) (((N)->order & 1) == 0)
+
+// The flags of a dummy: one thread claims it to link it in,
+// and it is used once it is ready.
+#define ATOM_BUCKET_CLAIMED (1u << 30)
+#define ATOM_BUCKET_READY (1u << 31)
+
+static arena_t atom_arena;
+static patom_node_t buckets[ATOM_SEGMENTS];
+static unsigned n_buckets;
+static unsigned n_atoms;
+
+// Set between atom_share(true) and atom_share(false).
+static bool shared;
+
+// The chained table, and how many of the first ids are in each table.
+static patom_t *chains;
+static unsigned n_chains;
+static unsigned n_chained;
+static unsigned n_listed;
+
+// Indexed by atom id, grows with the ids handed out.
+patom_t *atoms_by_id[ATOM_SEGMENTS];
+
+static inline unsigned atom_reverse(unsigned x)
+{
+	x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+	x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+	x = ((x >> 4) & 0x0F0F0F0Fu) | ((x & 0x0F0F0F0Fu) << 4);
+	return __builtin_bswap32(x);
+}
+
+// Segment s of a segmented array of elem-sized elements,
+// zeroed when made, if no thread has made it yet.
+static void *atom_segment_get(void **psegment, unsigned s, size_t elem)
+{
+	assert(s < ATOM_SEGMENTS);
+	
+	void *segment = __atomic_load_n(psegment, __ATOMIC_ACQUIRE);
+	if (!segment) {
+		size_t size = (ATOM_SEGMENT0 << s) * elem;
+		void *fresh = xmalloc(size);
+		memset(fresh, 0, size);
+		if (__atomic_compare_exchange_n(psegment, &segment, fresh, false,
+			__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+			segment = fresh;
+		else
+			xfree(fresh);
+	}
+	
+	return segment;
+}
+
+static patom_t *atom_id_slot(unsigned id)
+{
+	unsigned s = atom_segment(id);
+	patom_t *segment = atom_segment_get((void **)&atoms_by_id[s], s, sizeof(patom_t));
+	return &segment[atom_segment_offset(id, s)];
+}
+
+// Walks from start to where order goes, and returns the atom there
+// spelled text[0..len) (or the dummy, for text NULL), or NULL.
+// If NULL, *pplink and *pnext tell where a new node goes.
+static inline patom_node_t atom_find(patom_node_t start, unsigned order,
+	const char *text, size_t len, patom_node_t **pplink, patom_node_t *pnext)
+{
+	patom_node_t *plink = &start->next;
+	while (true) {
+		patom_node_t curr = __atomic_load_n(plink, __ATOMIC_ACQUIRE);
+		if (!curr || curr->order > order) {
+			*pplink = plink;
+			*pnext = curr;
+			return NULL;
+		}
+		
+		// Orders are equal for a dummy only if it is the one looked for.
+		if (curr->order == order) {
+			patom_t atom = (patom_t)curr;
+			if (!text || (atom->len == len && !memcmp(atom->text, text, len)))
+				return curr;
+		}
+		
+		plink = &curr->next;
+	}
+}
+
+// Links node in after start, unless an equal one beats it to it:
+// returns the node that is in the list.
+static patom_node_t atom_link(patom_node_t start, patom_node_t node, const char *text, size_t len)
+{
+	while (true) {
+		patom_node_t *plink;
+		patom_node_t next;
+		patom_node_t found = atom_find(start, node->order, text, len, &plink, &next);
+		if (found)
+			return found;
+		
+		node->next = next;
+		if (__atomic_compare_exchange_n(plink, &next, node, false,
+			__ATOMIC_RELEASE, __ATOMIC_RELAXED))
+			return node;
+	}
+}
+
+// Where to walk from for bucket b: its dummy, linked in after that of
+// its parent, the bucket b splits from, if it is not there yet.
+// While another thread links it, the parent does as well.
+static patom_node_t atom_bucket(unsigned b)
+{
+	unsigned s = atom_segment(b);
+	patom_node_t segment = atom_segment_get((void **)&buckets[s], s, sizeof(atom_node_t));
+	patom_node_t dummy = &segment[atom_segment_offset(b, s)];
+	
+	unsigned flags = __atomic_load_n(&dummy->flags, __ATOMIC_ACQUIRE);
+	if (flags & ATOM_BUCKET_READY)
+		return dummy;
+	
+	// Bucket 0 is made by atom_init().
+	assert(b > 0);
+	patom_node_t parent = atom_bucket(b & ~(0x80000000u >> __builtin_clz(b)));
+	
+	if (flags || !__atomic_compare_exchange_n(&dummy->flags, &flags, ATOM_BUCKET_CLAIMED, false,
+		__ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		return parent;
+	
+	dummy->order = ATOM_ORDER_DUMMY(b);
+	atom_link(parent, dummy, NULL, 0);
+	
+	__atomic_store_n(&dummy->flags, ATOM_BUCKET_READY, __ATOMIC_RELEASE);
+	return dummy;
+}
+
+// Doubles the buckets when ids catch up with them,
+// unless another thread did since there were size.
+static void atom_list_grow(unsigned id, unsigned size)
+{
+	if (id + 1 >= size && size < ATOM_MAX_BUCKETS)
+		__atomic_compare_exchange_n(&n_buckets, &size, size * 2, false,
+			__ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+// Links in an atom of the chained table, by this thread alone.
+static void atom_list_add(patom_t atom)
+{
+	unsigned size = n_buckets;
+	patom_node_t found = atom_link(atom_bucket(atom->hash & (size - 1)),
+		&atom->node, atom->text, atom->len);
+	assert(found == &atom->node);
+	(void)found;
+	
+	atom_list_grow(atom->id, size);
+}
+
+static void atom_chain(patom_t atom)
+{
+	patom_t *pchain = &chains[atom->hash & (n_chains - 1)];
+	atom->chain = *pchain;
+	*pchain = atom;
+}
+
+static void atom_chains_grow()
+{
+	patom_t *old_chains = chains;
+	unsigned old_n_chains = n_chains;
+	
+	n_chains *= 2;
+	chains = xmalloc(n_chains * sizeof(patom_t));
+	memset(chains, 0, n_chains * sizeof(patom_t));
+	
+	unsigned i;
+	for (i = 0; i != old_n_chains; ++i) {
+		patom_t atom = old_chains[i];
+		while (atom) {
+			patom_t next = atom->chain;
+			atom_chain(atom);
+			atom = next;
+		}
+	}
+	
+	xfree(old_chains);
+}
+
+void atom_init()
+{
+	n_buckets = ATOM_SEGMENT0;
+	n_atoms = 0;
+	
+	patom_node_t head = atom_segment_get((void **)&buckets[0], 0, sizeof(atom_node_t));
+	head->order = ATOM_ORDER_DUMMY(0);
+	head->flags = ATOM_BUCKET_READY;
+	
+	shared = false;
+	n_chains = ATOM_SEGMENT0;
+	chains = xmalloc(n_chains * sizeof(patom_t));
+	memset(chains, 0, n_chains * sizeof(patom_t));
+	n_chained = n_listed = 0;
+}
+
+void atom_finit()
+{
+	arena_free(&atom_arena);
+	
+	int s;
+	for (s = 0; s != ATOM_SEGMENTS; ++s) {
+		xfree(buckets[s]);
+		buckets[s] = NULL;
+		xfree(atoms_by_id[s]);
+		atoms_by_id[s] = NULL;
+	}
+	n_buckets = 0;
+	n_atoms = 0;
+	
+	xfree(chains);
+	chains = NULL;
+	n_chains = n_chained = n_listed = 0;
+}
+
+// Lets any number of threads intern until atom_share(false). Both are
+// called from one thread, while no other interns.
+void atom_share(bool share)
+{
+	assert(share != shared);
+	
+	unsigned id;
+	if (share) {
+		for (id = n_listed; id != n_atoms; ++id)
+			atom_list_add(ATOM_BY_ID(id));
+	} else {
+		for (id = n_chained; id != n_atoms; ++id) {
+			// Ids lost in a race name the atom that won.
+			patom_t atom = ATOM_BY_ID(id);
+			if (ATOM_ID(atom) != id)
+				continue;
+			
+			atom_chain(atom);
+			if (id + 1 >= n_chains)
+				atom_chains_grow();
+		}
+	}
+	
+	n_chained = n_listed = n_atoms;
+	shared = share;
+}
+
+// A new atom spelled text[0..len), with the next id, in no table yet.
+static patom_t atom_make(const char *text, size_t len, unsigned hash)
+{
+	patom_t atom = arena_alloc_shared(&atom_arena, sizeof(atom_t) + len + 1);
+	atom->node.order = ATOM_ORDER(hash);
+	atom->hash = hash;
+	atom->node.flags = 0;
+	atom->id = __atomic_fetch_add(&n_atoms, 1, __ATOMIC_RELAXED);
+	atom->len = len;
+	atom->keyword = lex_keyword_lookup(text, len);
+	if (atom->keyword != KEYWORD_NONE)
+		atom->node.flags |= ATOM_FLAG_KEYWORD;
+	memcpy(atom->text, text, len);
+	atom->text[len] = '\0';
+	
+	// The id slot is filled before the atom is linked in,
+	// so whoever finds the atom can look it up by id.
+	*atom_id_slot(atom->id) = atom;
+	return atom;
+}
+
+// The same as atom_intern(), by this thread alone.
+static patom_t atom_intern_serial(const char *text, size_t len)
+{
+	unsigned hash = hash_bytes(text, len);
+	
+	patom_t atom;
+	for (atom = chains[hash & (n_chains - 1)]; atom; atom = atom->chain) {
+		if (atom->hash == hash && atom->len == len &&
+			!memcmp(atom->text, text, len))
+			return atom;
+	}
+	
+	// Not seen yet.
+	atom = atom_make(text, len, hash);
+	atom_chain(atom);
+	n_chained = n_atoms;
+	
+	if (n_atoms >= n_chains)
+		atom_chains_grow();
+	
+	return atom;
+}
+
+// Returns the atom spelled text[0..len), creating it on first sight.
+// A new atom is classified once here: if the spelling is a keyword,
+// ATOM_FLAG_KEYWORD is set and ATOM_KEYWORD() tells which one.
+patom_t atom_intern(const char *text, size_t len)
+{
+	assert(buckets[0]);
+	assert(text);
+	
+	if (!shared)
+		return atom_intern_serial(text, len);
+	
+	unsigned hash = hash_bytes(text, len);
+	unsigned order = ATOM_ORDER(hash);
+	unsigned mask = __atomic_load_n(&n_buckets, __ATOMIC_RELAXED) - 1;
+	
+	// The bucket is mostly there already.
+	unsigned s = atom_segment(hash & mask);
+	patom_node_t segment = __atomic_load_n(&buckets[s], __ATOMIC_ACQUIRE);
+	patom_node_t start = segment ? &segment[atom_segment_offset(hash & mask, s)] : NULL;
+	if (!start || !(__atomic_load_n(&start->flags, __ATOMIC_ACQUIRE) & ATOM_BUCKET_READY))
+		start = atom_bucket(hash & mask);
+	
+	// Seen already, as it mostly is.
+	patom_node_t *plink;
+	patom_node_t next;
+	patom_node_t found = atom_find(start, order, text, len, &plink, &next);
+	if (found)
+		return (patom_t)found;
+	
+	// Not seen yet, as far as this thread knows.
+	patom_t atom = atom_make(text, len, hash);
+	
+	found = atom_link(start, &atom->node, text, len);
+	if (found != &atom->node) {
+		// Another thread put the same spelling in first. The id taken
+		// is never seen, it is left naming that atom.
+		*atom_id_slot(atom->id) = (patom_t)found;
+		return (patom_t)found;
+	}
+	
+	atom_list_grow(atom->id, mask + 1);
+	return atom;
+}
+
+patom_t atom_intern_str(const char *text)
+{
+	assert(text);
+	
+	return atom_intern(text, strlen(text));
+}
+
+// Ids run from 0 to atom_count() - 1. Threads racing to intern the same
+// spelling may leave an id unused, ATOM_BY_ID() still gives the atom.
+unsigned atom_count()
+{
+	return __atomic_load_n(&n_atoms, __ATOMIC_ACQUIRE);
+}
+
+// Not to be called while other threads intern.
+void atom_stat()
+{
+	assert(!shared);
+	
+	unsigned count = 0;
+	unsigned empty = 0;
+	unsigned longest = 0;
+	unsigned i;
+	for (i = 0; i != n_chains; ++i) {
+		unsigned chain = 0;
+		patom_t atom;
+		for (atom = chains[i]; atom; atom = atom->chain)
+			chain++;
+		
+		count += chain;
+		if (!chain)
+			empty++;
+		if (chain > longest)
+			longest = chain;
+	}
+	
+	printf("stat for atoms: \n");
+	printf("atom count = %u, load factor = %.2f, bucket util = %.2f, longest chain = %u\n",
+		count,
+		(double)count / n_chains,
+		1.0 - (double)empty / n_chains,
+		longest
+		);
+}
+
+#ifndef NDEBUG
+// Threads intern the same names, each in an order of its own,
+// and some names of their own between them.
+#define ATOM_TEST_THREADS 4
+#define ATOM_TEST_SHARED 2000
+#define ATOM_TEST_OWN 200
+
+typedef struct _atom_test_worker_t {
+	pthread_t thread;
+	int index;
+	patom_t shared[ATOM_TEST_SHARED];
+	patom_t own[ATOM_TEST_OWN];
+} atom_test_worker_t;
+
+static void *atom_test_worker(void *arg)
+{
+	atom_test_worker_t *worker = arg;
+	char name[32];
+	int i;
+	for (i = 0; i != ATOM_TEST_SHARED; ++i) {
+		int k = (i + worker->index * 2503) % ATOM_TEST_SHARED;
+		if (worker->index % 2)
+			k = ATOM_TEST_SHARED - 1 - k;
+		sprintf(name, "atom_shared_%d", k);
+		worker->shared[k] = atom_intern_str(name);
+		
+		if (i % (ATOM_TEST_SHARED / ATOM_TEST_OWN) == 0) {
+			int j = i / (ATOM_TEST_SHARED / ATOM_TEST_OWN);
+			sprintf(name, "atom_own_%d_%d", worker->index, j);
+			worker->own[j] = atom_intern_str(name);
+		}
+	}
+	
+	return NULL;
+}
+#endif
+
+void atom_unittest()
+{
+#	ifndef NDEBUG
+	// Runs on a table of its own.
+	atom_init();
+	
+	// Same spelling, same atom; the text need not be terminated.
+	patom_t queens = atom_intern("queens_test", 6);
+	assert(queens == atom_intern_str("queens"));
+	assert(queens != atom_intern_str("queen"));
+	assert(!strcmp(ATOM_TEXT(queens), "queens"));
+	assert(ATOM_LEN(queens) == 6);
+	assert(!ATOM_IS(queens, ATOM_FLAG_KEYWORD));
+	
+	// Keywords are classified when they are interned.
+	patom_t kw = atom_intern_str("while");
+	assert(ATOM_IS(kw, ATOM_FLAG_KEYWORD));
+	assert(ATOM_KEYWORD(kw) == KEYWORD_WHILE);
+	assert(!ATOM_IS(atom_intern_str("whilee"), ATOM_FLAG_KEYWORD));
+	
+	// Flags set on an atom are seen through every later intern.
+	patom_t rec = atom_intern_str("atom_test_record");
+	ATOM_SET_FLAGS(rec, ATOM_FLAG_TYPENAME);
+	assert(ATOM_IS(atom_intern_str("atom_test_record"), ATOM_FLAG_TYPENAME));
+	
+	// Atoms survive the table growing under them.
+	enum { N_NAMES = 5000 };
+	patom_t *atoms = xmalloc(N_NAMES * sizeof(patom_t));
+	char name[32];
+	int i;
+	for (i = 0; i != N_NAMES; ++i) {
+		sprintf(name, "atom_test_%d", i);
+		atoms[i] = atom_intern_str(name);
+	}
+	assert(n_chains > n_atoms);
+	for (i = 0; i != N_NAMES; ++i) {
+		sprintf(name, "atom_test_%d", i);
+		assert(atoms[i] == atom_intern_str(name));
+		assert(ATOM_BY_ID(ATOM_ID(atoms[i])) == atoms[i]);
+		assert(!strcmp(ATOM_TEXT(atoms[i]), name));
+	}
+	assert(rec == atom_intern_str("atom_test_record"));
+	xfree(atoms);
+	
+	atom_finit();
+	
+	// Threads racing on the same names all get the same atoms,
+	// while the table grows under them. Some of the names are there
+	// before, and all of them are found after, by this thread alone.
+	atom_init();
+	patom_t before[ATOM_TEST_OWN];
+	for (i = 0; i != ATOM_TEST_OWN; ++i) {
+		sprintf(name, "atom_shared_%d", i * (ATOM_TEST_SHARED / ATOM_TEST_OWN));
+		before[i] = atom_intern_str(name);
+	}
+	
+	atom_share(true);
+	atom_test_worker_t *workers = xmalloc(ATOM_TEST_THREADS * sizeof(atom_test_worker_t));
+	for (i = 0; i != ATOM_TEST_THREADS; ++i) {
+		workers[i].index = i;
+		if (pthread_create(&workers[i].thread, NULL, atom_test_worker, &workers[i]))
+			fatal("cannot create atom test thread");
+	}
+	for (i = 0; i != ATOM_TEST_THREADS; ++i)
+		pthread_join(workers[i].thread, NULL);
+	atom_share(false);
+	
+	for (i = 0; i != ATOM_TEST_OWN; ++i)
+		assert(workers[0].shared[i * (ATOM_TEST_SHARED / ATOM_TEST_OWN)] == before[i]);
+	
+	int k;
+	for (k = 0; k != ATOM_TEST_SHARED; ++k) {
+		patom_t atom = workers[0].shared[k];
+		sprintf(name, "atom_shared_%d", k);
+		assert(atom == atom_intern_str(name));
+		assert(ATOM_BY_ID(ATOM_ID(atom)) == atom);
+		for (i = 1; i != ATOM_TEST_THREADS; ++i)
+			assert(workers[i].shared[k] == atom);
+	}
+	for (i = 0; i != ATOM_TEST_THREADS; ++i) {
+		for (k = 0; k != ATOM_TEST_OWN; ++k) {
+			sprintf(name, "atom_own_%d_%d", i, k);
+			assert(!strcmp(ATOM_TEXT(workers[i].own[k]), name));
+			assert(ATOM_BY_ID(ATOM_ID(workers[i].own[k])) == workers[i].own[k]);
+		}
+	}
+	
+	// Every spelling is in the list once, and in order.
+	unsigned count = 0;
+	unsigned order = 0;
+	patom_node_t node;
+	for (node = buckets[0]->next; node; node = node->next) {
+		assert(node->order >= order);
+		order = node->order;
+		if (!ATOM_IS_DUMMY(node))
+			count++;
+	}
+	assert(count == ATOM_TEST_SHARED + ATOM_TEST_THREADS * ATOM_TEST_OWN);
+	assert(count <= atom_count());
+	xfree(workers);
+	
+	atom_finit();
+#	endif
+
+	printf("test atom ok\n");
+}
@@ -1,5 +1,22 @@
 #include "javac.h"
 
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// The checker resolves names: every id is looked up in symtab.c
+// and TREE_ID_DECL() is set to the decl it names, or the use is
+// reported. Types are not checked yet.
+//
+// Scopes nest as follows:
+//     global: functions, natives and records, all declared before
+//         any body is looked at, as they may be used before they are;
+//     function: parameters and variables, in one scope, so a variable
+//         cannot shadow a parameter;
+//     compound stmt: a scope of its own inside the enclosing one;
+//     record: the fields, only to tell duplicates, as fields are
+//         reached through '.' and never looked up by name.
+
 static void visit_tree(tree_node_visitor_t *visitor, tree_t tree, int depth);
 static void visit_const(tree_node_visitor_t *visitor, tree_t tree, int depth);
 static void visit_decl(tree_node_visitor_t *visitor, tree_t tree, int depth);
@@ -20,162 +37,137 @@ tree_node_visitor_t check_visitor = {
 	visit_typespec
 };
 
-static void print_space(int depth)
+// Visits pushed around the ones of the trees in a scope,
+// see parser_visit_push(), to enter and leave it in order.
+static void check_enter_scope(tree_node_visitor_t *visitor, tree_t tree, int depth)
+{
+	symtab_enter_scope();
+}
+
+static void check_leave_scope(tree_node_visitor_t *visitor, tree_t tree, int depth)
 {
-	assert(depth >= 0);
+	symtab_leave_scope();
+}
+
+// The last visit of the walk.
+static void check_finish(tree_node_visitor_t *visitor, tree_t tree, int depth)
+{
+	symtab_leave_scope();
 	
-	int i;
-	for (i = 0; i < (depth << 2); ++i)
-		printf(" ");
+	assert(symtab_scope_depth() == 0);
+	symtab_finit();
+}
+
+// Visited after the function of a call, when its id is resolved.
+static void check_callee(tree_node_visitor_t *visitor, tree_t tree, int depth)
+{
+	if (TREE_NODE_KIND(tree) == NODE_KIND_ID &&
+		TREE_DECL_KIND(TREE_ID_DECL(tree)) != DECL_KIND_FUNCTION)
+		fatal_tree(tree, "'%s' is not a function", TREE_ID_NAME(tree));
+}
+
+static void check_declare(tree_t decl)
+{
+	tree_t prev = symtab_declare(decl);
+	if (prev)
+		fatal_tree(TREE_DECL_ID(decl), "redefinition of '%s'", TREE_ID_NAME(TREE_DECL_ID(decl)));
+}
+
+// Visited after the type specifier of a variable.
+static void check_declare_var(tree_node_visitor_t *visitor, tree_t tree, int depth)
+{
+	check_declare(tree);
+	TREE_ID_DECL(TREE_DECL_ID(tree)) = tree;
 }
 
 static void visit_tree(tree_node_visitor_t *visitor, tree_t tree, int depth)
 {
-	fatal("check-tree performs semantic check on the grammer tree, not implemented!");
-	
-	printf("printing grammer tree:\n");
-	
 	assert(TREE_NODE_KIND(tree) == NODE_KIND_LIST);
 	assert(TREE_LIST_KIND(tree) == LIST_KIND_TU);
-	visitor->visit_list(visitor, tree, depth + 1);
+	
+	symtab_init();
+	
+	// global.
+	symtab_enter_scope();
+	parser_visit_push(visitor->visit_list, tree, depth + 1);
+	parser_visit_push(check_finish, tree, depth);
 }
 
 static void visit_const(tree_node_visitor_t *visitor, tree_t tree, int depth)
 {
-	print_space(depth);
-	
-	switch (TREE_CONST_KIND(tree)) {
-	case CONST_KIND_CHARACTER:
-		printf("character = 0x%02x\n", TREE_CONST_CHAR(tree));
-		break;
-	case CONST_KIND_INTEGER:
-		printf("integer = %d\n", TREE_CONST_INT(tree));
-		break;
-	case CONST_KIND_NULL:
-		printf("null\n");
-		break;
-	case CONST_KIND_STRING:
-		printf("string literal = \"%s\"\n", TREE_CONST_STRING(tree));
-		break;
-	default:
-		assert(false);
-		break;
-	}
+	// nothing to resolve.
 }
 
 static void visit_decl(tree_node_visitor_t *visitor, tree_t tree, int depth)
 {
 	tree_t typespec;
-	tree_t id;
 	tree_t params;
 	tree_t vars;
 	tree_t stmts;
 	
-	print_space(depth);
 	switch (TREE_DECL_KIND(tree)) {
 	case DECL_KIND_FUNCTION:
-		if (TREE_DECL_NATIVE(tree)) {
-			printf("prototype decl\n");
-			
-			// type specifier.
-			typespec = TREE_DECL_TYPESPEC(tree);
-			assert(typespec);
-			assert(TREE_NODE_KIND(typespec) == NODE_KIND_TYPESPEC);
-			visitor->visit_typespec(visitor, typespec, depth + 1);
-			
-			// id.
-			id = TREE_DECL_ID(tree);
-			assert(id);
-			assert(TREE_NODE_KIND(id) == NODE_KIND_ID);
-			visitor->visit_id(visitor, id, depth + 1);
-			
-			// parameter list.
-			params = TREE_DECL_PARAMS(tree);
-			if (params) {
-				assert(TREE_NODE_KIND(params) == NODE_KIND_LIST);
-				assert(TREE_LIST_KIND(params) == LIST_KIND_PARAMS);
-				visitor->visit_list(visitor, params, depth + 1);
-			}
-		} else {
-			printf("function def\n");
-			
-			// type specifier.
-			typespec = TREE_DECL_TYPESPEC(tree);
-			assert(typespec);
-			assert(TREE_NODE_KIND(typespec) == NODE_KIND_TYPESPEC);
-			visitor->visit_typespec(visitor, typespec, depth + 1);
-			
-			// id.
-			id = TREE_DECL_ID(tree);
-			assert(id);
-			assert(TREE_NODE_KIND(id) == NODE_KIND_ID);
-			visitor->visit_id(visitor, id, depth + 1);
-			
-			// parameter list.
-			params = TREE_DECL_PARAMS(tree);
-			if (params) {
-				assert(TREE_NODE_KIND(params) == NODE_KIND_LIST);
-				assert(TREE_LIST_KIND(params) == LIST_KIND_PARAMS);
-				visitor->visit_list(visitor, params, depth + 1);
-			}
-			
+		// the name is global, see visit_list().
+		
+		// type specifier.
+		typespec = TREE_DECL_TYPESPEC(tree);
+		assert(typespec);
+		assert(TREE_NODE_KIND(typespec) == NODE_KIND_TYPESPEC);
+		parser_visit_push(visitor->visit_typespec, typespec, depth + 1);
+		
+		// function.
+		parser_visit_push(check_enter_scope, tree, depth);
+		
+		// parameter list.
+		params = TREE_DECL_PARAMS(tree);
+		if (params) {
+			assert(TREE_NODE_KIND(params) == NODE_KIND_LIST);
+			assert(TREE_LIST_KIND(params) == LIST_KIND_PARAMS);
+			parser_visit_push(visitor->visit_list, params, depth + 1);
+		}
+		
+		if (!TREE_DECL_NATIVE(tree)) {
 			// var decl list.
 			vars = TREE_DECL_VARS(tree);
 			assert(vars);
 			assert(TREE_NODE_KIND(vars) == NODE_KIND_LIST);
 			assert(TREE_LIST_KIND(vars) == LIST_KIND_VARS);
-			visitor->visit_list(visitor, vars, depth + 1);
+			parser_visit_push(visitor->visit_list, vars, depth + 1);
 			
 			// stmt list.
 			stmts = TREE_DECL_STMTS(tree);
 			assert(stmts);
 			assert(TREE_NODE_KIND(stmts) == NODE_KIND_LIST);
 			assert(TREE_LIST_KIND(stmts) == LIST_KIND_STMTS);
-			visitor->visit_list(visitor, stmts, depth + 1);
+			parser_visit_push(visitor->visit_list, stmts, depth + 1);
 		}
+		
+		parser_visit_push(check_leave_scope, tree, depth);
 		break;
 	case DECL_KIND_VARIABLE:
-		if (TREE_DECL_PARAM(tree)) {
-			printf("parameter decl\n");
-			
-			// type specifier.
-			typespec = TREE_DECL_TYPESPEC(tree);
-			assert(TREE_NODE_KIND(typespec) == NODE_KIND_TYPESPEC);
-			visitor->visit_typespec(visitor, typespec, depth + 1);
-			
-			// id.
-			id = TREE_DECL_ID(tree);
-			assert(TREE_NODE_KIND(id) == NODE_KIND_ID);
-			visitor->visit_id(visitor, id, depth + 1);
-		} else {
-			printf("variable decl\n");
-			
-			// type specifier.
-			typespec = TREE_DECL_TYPESPEC(tree);
-			assert(TREE_NODE_KIND(typespec) == NODE_KIND_TYPESPEC);
-			visitor->visit_typespec(visitor, typespec, depth + 1);
-			
-			// id.
-			id = TREE_DECL_ID(tree);
-			assert(TREE_NODE_KIND(id) == NODE_KIND_ID);
-			visitor->visit_id(visitor, id, depth + 1);
-		}
-
+		// parameter, local variable or field.
+		
+		// type specifier.
+		typespec = TREE_DECL_TYPESPEC(tree);
+		assert(TREE_NODE_KIND(typespec) == NODE_KIND_TYPESPEC);
+		parser_visit_push(visitor->visit_typespec, typespec, depth + 1);
+		
+		// id, once the type is resolved: 'P P;' names record P.
+		assert(TREE_NODE_KIND(TREE_DECL_ID(tree)) == NODE_KIND_ID);
+		parser_visit_push(check_declare_var, tree, depth);
 		break;
 	case DECL_KIND_TYPENAME:
-		printf("record def\n");
-		
-		// id.
-		id = TREE_DECL_ID(tree);
-		assert(TREE_NODE_KIND(id) == NODE_KIND_ID);
-		visitor->visit_id(visitor, id, depth + 1);
+		// the name is global, see visit_list().
 		
 		// var decl list.
 		vars = TREE_DECL_VARS(tree);
 		assert(vars);
 		assert(TREE_NODE_KIND(vars) == NODE_KIND_LIST);
 		assert(TREE_LIST_KIND(vars) == LIST_KIND_VARS);
-		visitor->visit_list(visitor, vars, depth + 1);
+		
+		parser_visit_push(check_enter_scope, tree, depth);
+		parser_visit_push(visitor->visit_list, vars, depth + 1);
+		parser_visit_push(check_leave_scope, tree, depth);
 		break;
 	default:
 		assert(false);
@@ -199,13 +191,10 @@ static void visit_exp(tree_node_visitor_t *visitor, tree_t tree, int depth)
 	
 	// expr, expr, ...
 	if (TREE_NODE_KIND(tree) == NODE_KIND_LIST) {
-		slist_iter_t iter;
-		slist_iter_begin(TREE_LIST(tree), &iter);
-		while (slist_iter_not_end(&iter)) {
-			tree_t exp = SLIST_ITER_GET_T(iter, tree_t);
-			visitor->visit_exp(visitor, exp, depth);
-			
-			slist_iter_move_next(&iter);
+		int i;
+		for (i = 0; i != TREE_LIST_COUNT(tree); ++i) {
+			tree_t exp = TREE_LIST_ITEM(tree, i);
+			parser_visit_push(visitor->visit_exp, exp, depth);
 		}
 		return;
 	}
@@ -213,307 +202,67 @@ static void visit_exp(tree_node_visitor_t *visitor, tree_t tree, int depth)
 	// the following exps are all with one specific operator.
 	assert(TREE_NODE_KIND(tree) == NODE_KIND_EXP);
 	
-	print_space(depth);
-		
-	tree_t first;
-	tree_t second;
+	tree_t first = TREE_EXP_FIRST(tree);
+	tree_t second = TREE_EXP_SECOND(tree);
 	switch (TREE_EXP_OP(tree)) {
 	case EXP_OP_CALL:
-		printf("function call\n");
-		
 		// function id.
-		first = TREE_EXP_FIRST(tree);
 		assert(first);
-		
-		visitor->visit_exp(visitor, first, depth + 1);
+		parser_visit_push(visitor->visit_exp, first, depth + 1);
+		parser_visit_push(check_callee, first, depth + 1);
 		
 		// arguments.
-		second = TREE_EXP_SECOND(tree);
 		if (second)
-			visitor->visit_exp(visitor, second, depth + 1);
-		break;
-	case EXP_OP_INDEX:
-		printf("postfix (index)\n");
-		
-		// indexee.
-		first = TREE_EXP_FIRST(tree);
-		assert(first);
-		
-		visitor->visit_exp(visitor, first, depth + 1);
-		
-		// indexer.
-		second = TREE_EXP_SECOND(tree);
-		assert(second);
-		
-		visitor->visit_exp(visitor, second, depth + 1);
+			parser_visit_push(visitor->visit_exp, second, depth + 1);
 		break;
 	case EXP_OP_DOT:
-		printf("postfix (dot)\n");
-		
 		// obj.
-		first = TREE_EXP_FIRST(tree);
 		assert(first);
+		parser_visit_push(visitor->visit_exp, first, depth + 1);
 		
-		visitor->visit_exp(visitor, first, depth + 1);
-		
-		// property.
-		second = TREE_EXP_SECOND(tree);
+		// property, resolved against the type of obj, not in scope.
 		assert(second);
 		assert(TREE_NODE_KIND(second) == NODE_KIND_ID);
-		
-		visitor->visit_exp(visitor, second, depth + 1);
 		break;
-	case EXP_OP_ASSIGNMENT:
-		printf("assignment expr\n");
-		
-		// left-value.
-		first = TREE_EXP_FIRST(tree);
+	case EXP_OP_NEW:
+		// type.
 		assert(first);
+		assert(TREE_NODE_KIND(first) == NODE_KIND_TYPESPEC);
+		parser_visit_push(visitor->visit_typespec, first, depth + 1);
 		
-		visitor->visit_exp(visitor, first, depth + 1);
-		
-		// right-value.
-		second = TREE_EXP_SECOND(tree);
-		assert(second);
-		
-		visitor->visit_exp(visitor, second, depth + 1);
+		// dim.
+		if (second)
+			parser_visit_push(visitor->visit_exp, second, depth + 1);
 		break;
 	case EXP_OP_U_PLUS:
-		printf("unary expr (plus)\n");
-		
-		// operand.
-		first = TREE_EXP_FIRST(tree);
-		assert(first);
-		
-		visitor->visit_exp(visitor, first, depth + 1);
-		break;
 	case EXP_OP_U_MINUS:
-		printf("unary expr (minus)\n");
-		
-		// operand.
-		first = TREE_EXP_FIRST(tree);
-		assert(first);
-		
-		visitor->visit_exp(visitor, first, depth + 1);
-		break;
 	case EXP_OP_NOT:
-		printf("unary expr (not)\n");
-		
 		// operand.
-		first = TREE_EXP_FIRST(tree);
 		assert(first);
-		
-		visitor->visit_exp(visitor, first, depth + 1);
+		parser_visit_push(visitor->visit_exp, first, depth + 1);
 		break;
+	case EXP_OP_INDEX:
+	case EXP_OP_ASSIGNMENT:
 	case EXP_OP_LOGICAL_OR:
-		printf("logical or expr\n");
-		
-		// lhs.
-		first = TREE_EXP_FIRST(tree);
-		assert(first);
-		
-		visitor->visit_exp(visitor, first, depth + 1);
-		
-		// rhs.
-		second = TREE_EXP_SECOND(tree);
-		assert(second);
-		
-		visitor->visit_exp(visitor, second, depth + 1);
-		break;
 	case EXP_OP_LOGICAL_AND:
-		printf("logical and expr\n");
-		
-		// lhs.
-		first = TREE_EXP_FIRST(tree);
-		assert(first);
-		
-		visitor->visit_exp(visitor, first, depth + 1);
-		
-		// rhs.
-		second = TREE_EXP_SECOND(tree);
-		assert(second);
-		
-		visitor->visit_exp(visitor, second, depth + 1);
-		break;
 	case EXP_OP_EQ:
-		printf("relational expr (eq)\n");
-		
-		// lhs.
-		first = TREE_EXP_FIRST(tree);
-		assert(first);
-		
-		visitor->visit_exp(visitor, first, depth + 1);
-		
-		// rhs.
-		second = TREE_EXP_SECOND(tree);
-		assert(second);
-		
-		visitor->visit_exp(visitor, second, depth + 1);
-		break;
 	case EXP_OP_NEQ:
-		printf("relational expr (neq)\n");
-		
-		// lhs. 
-		first = TREE_EXP_FIRST(tree);
-		assert(first);
-		
-		visitor->visit_exp(visitor, first, depth + 1);
-		
-		// rhs.
-		second = TREE_EXP_SECOND(tree);
-		assert(second);
-		
-		visitor->visit_exp(visitor, second, depth + 1);
-		break;
 	case EXP_OP_LESS:
-		printf("relational expr (less)\n");
-		
-		// lhs.
-		first = TREE_EXP_FIRST(tree);
-		assert(first);
-		
-		visitor->visit_exp(visitor, first, depth + 1);
-		
-		// rhs.
-		second = TREE_EXP_SECOND(tree);
-		assert(second);
-		
-		visitor->visit_exp(visitor, second, depth + 1);
-		break;
 	case EXP_OP_LESS_EQ:
-		printf("relational expr (less eq)\n");
-		
-		// lhs.
-		first = TREE_EXP_FIRST(tree);
-		assert(first);
-		
-		visitor->visit_exp(visitor, first, depth + 1);
-		
-		// rhs.
-		second = TREE_EXP_SECOND(tree);
-		assert(second);
-		
-		visitor->visit_exp(visitor, second, depth + 1);
-		break;
 	case EXP_OP_GREATER:
-		printf("relational expr (greater)\n");
-		
-		// lhs.
-		first = TREE_EXP_FIRST(tree);
-		assert(first);
-		
-		visitor->visit_exp(visitor, first, depth + 1);
-		
-		// rhs.
-		second = TREE_EXP_SECOND(tree);
-		assert(second);
-		
-		visitor->visit_exp(visitor, second, depth + 1);
-		break;
 	case EXP_OP_GREATER_EQ:
-		printf("relational expr (greater eq)\n");
-		
-		// lhs.
-		first = TREE_EXP_FIRST(tree);
-		assert(first);
-		
-		visitor->visit_exp(visitor, first, depth + 1);
-		
-		// rhs.
-		second = TREE_EXP_SECOND(tree);
-		assert(second);
-		
-		visitor->visit_exp(visitor, second, depth + 1);
-		break;
 	case EXP_OP_PLUS:
-		printf("additive expr (plus)\n");
-		
-		// lhs.
-		first = TREE_EXP_FIRST(tree);
-		assert(first);
-		
-		visitor->visit_exp(visitor, first, depth + 1);
-		
-		// rhs.
-		second = TREE_EXP_SECOND(tree);
-		assert(second);
-		
-		visitor->visit_exp(visitor, second, depth + 1);
-		break;
 	case EXP_OP_MINUS:
-		printf("additive expr (minus)\n");
-		
-		// lhs.
-		first = TREE_EXP_FIRST(tree);
-		assert(first);
-		
-		visitor->visit_exp(visitor, first, depth + 1);
-		
-		// rhs.
-		second = TREE_EXP_SECOND(tree);
-		assert(second);
-		
-		visitor->visit_exp(visitor, second, depth + 1);
-		break;
 	case EXP_OP_MULTIPLY:
-		printf("mult expr (mult)\n");
-		
-		// lhs.
-		first = TREE_EXP_FIRST(tree);
-		assert(first);
-		
-		visitor->visit_exp(visitor, first, depth + 1);
-		
-		// rhs.
-		second = TREE_EXP_SECOND(tree);
-		assert(second);
-		
-		visitor->visit_exp(visitor, second, depth + 1);
-		break;
 	case EXP_OP_DIVIDE:
-		printf("mult expr (divide)\n");
-		
-		// lhs.
-		first = TREE_EXP_FIRST(tree);
-		assert(first);
-		
-		visitor->visit_exp(visitor, first, depth + 1);
-		
-		// rhs.
-		second = TREE_EXP_SECOND(tree);
-		assert(second);
-		
-		visitor->visit_exp(visitor, second, depth + 1);
-		break;
 	case EXP_OP_MODULO:
-		printf("mult expr (modulo)\n");
-		
 		// lhs.
-		first = TREE_EXP_FIRST(tree);
 		assert(first);
-		
-		visitor->visit_exp(visitor, first, depth + 1);
+		parser_visit_push(visitor->visit_exp, first, depth + 1);
 		
 		// rhs.
-		second = TREE_EXP_SECOND(tree);
 		assert(second);
-		
-		visitor->visit_exp(visitor, second, depth + 1);
-		break;
-	case EXP_OP_NEW:
-		printf("primary (new)\n");
-		
-		tree_t typespec = TREE_EXP_FIRST(tree);
-		assert(typespec);
-		assert(TREE_NODE_KIND(typespec) == NODE_KIND_TYPESPEC);
-		
-		// type.
-		visitor->visit_typespec(visitor, typespec, depth + 1);
-		
-		// dim.
-		tree_t dim = TREE_EXP_SECOND(tree);
-		if (dim)
-			visitor->visit_exp(visitor, dim, depth + 1);
+		parser_visit_push(visitor->visit_exp, second, depth + 1);
 		break;
 	default:
 		assert(false);
@@ -521,70 +270,66 @@ static void visit_exp(tree_node_visitor_t *visitor, tree_t tree, int depth)
 	}
 }
 
+// A use of a name: one probe finds the innermost decl of it.
 static void visit_id(tree_node_visitor_t *visitor, tree_t tree, int depth)
 {
-	print_space(depth);
-	printf("identifier = %s\n", TREE_ID_NAME(tree));
+	tree_t decl = symtab_lookup(TREE_ID_ATOM(tree));
+	if (!decl)
+		fatal_tree(tree, "'%s' undeclared", TREE_ID_NAME(tree));
+	
+	TREE_ID_DECL(tree) = decl;
 }
 
 static void visit_list(tree_node_visitor_t *visitor, tree_t tree, int depth)
 {
-	slist_iter_t iter;
+	int i;
 	
-	print_space(depth);
 	switch (TREE_LIST_KIND(tree)) {
 	case LIST_KIND_TU:
-		printf("translation unit\n");
-		
-		slist_iter_begin(TREE_LIST(tree), &iter);
-		while (slist_iter_not_end(&iter)) {
-			tree_t edecl = SLIST_ITER_GET_T(iter, tree_t);
+		// every name first, then the bodies.
+		for (i = 0; i != TREE_LIST_COUNT(tree); ++i) {
+			tree_t edecl = TREE_LIST_ITEM(tree, i);
 			assert(TREE_NODE_KIND(edecl) == NODE_KIND_DECL);
 			assert(TREE_DECL_KIND(edecl) == DECL_KIND_FUNCTION ||
 				TREE_DECL_KIND(edecl) == DECL_KIND_TYPENAME);
 			
-			visitor->visit_decl(visitor, edecl, depth + 1);
-			slist_iter_move_next(&iter);
+			check_declare(edecl);
+			TREE_ID_DECL(TREE_DECL_ID(edecl)) = edecl;
 		}
+		
+		for (i = 0; i != TREE_LIST_COUNT(tree); ++i)
+			parser_visit_push(visitor->visit_decl, TREE_LIST_ITEM(tree, i), depth + 1);
 		break;
 	case LIST_KIND_PARAMS:
-		printf("parameter list\n");
-		
-		slist_iter_begin(TREE_LIST(tree), &iter);
-		while (slist_iter_not_end(&iter)) {
-			tree_t param = SLIST_ITER_GET_T(iter, tree_t);
+		for (i = 0; i != TREE_LIST_COUNT(tree); ++i) {
+			tree_t param = TREE_LIST_ITEM(tree, i);
 			assert(TREE_NODE_KIND(param) == NODE_KIND_DECL);
 			assert(TREE_DECL_KIND(param) == DECL_KIND_VARIABLE);
 			assert(TREE_DECL_PARAM(param));
 			
-			visitor->visit_decl(visitor, param, depth + 1);
-			slist_iter_move_next(&iter);
+			parser_visit_push(visitor->visit_decl, param, depth + 1);
 		}
 		break;
 	case LIST_KIND_VARS:
-		printf("variable decl list\n");
-		
-		slist_iter_begin(TREE_LIST(tree), &iter);
-		while (slist_iter_not_end(&iter)) {
-			tree_t var = SLIST_ITER_GET_T(iter, tree_t);
+		for (i = 0; i != TREE_LIST_COUNT(tree); ++i) {
+			tree_t var = TREE_LIST_ITEM(tree, i);
 			assert(TREE_NODE_KIND(var) == NODE_KIND_DECL);
 			assert(TREE_DECL_KIND(var) == DECL_KIND_VARIABLE);
 			assert(!TREE_DECL_PARAM(var));
 			
-			visitor->visit_decl(visitor, var, depth + 1);
-			slist_iter_move_next(&iter);
+			parser_visit_push(visitor->visit_decl, var, depth + 1);
 		}
 		break;
 	case LIST_KIND_STMTS:
-		printf("stmt list\n");
-	  
-		slist_iter_begin(TREE_LIST(tree), &iter);
-		while (slist_iter_not_end(&iter)) {
-			tree_t stmt = SLIST_ITER_GET_T(iter, tree_t);
+		for (i = 0; i != TREE_LIST_COUNT(tree); ++i) {
+			tree_t stmt = TREE_LIST_ITEM(tree, i);
+			
+			// '{}' is no stmt.
+			if (!stmt)
+				continue;
 			assert(TREE_NODE_KIND(stmt) == NODE_KIND_STMT);
 			
-			visitor->visit_stmt(visitor, stmt, depth + 1);
-			slist_iter_move_next(&iter);
+			parser_visit_push(visitor->visit_stmt, stmt, depth + 1);
 		}
 		break;
 	default:
@@ -595,85 +340,67 @@ static void visit_list(tree_node_visitor_t *visitor, tree_t tree, int depth)
 
 static void visit_stmt(tree_node_visitor_t *visitor, tree_t tree, int depth)
 {
-	print_space(depth);
-  
 	tree_t exp;
 	tree_t body;
+	tree_t init;
+	tree_t incr;
 	switch (TREE_STMT_KIND(tree)) {
 	case STMT_KIND_EXPR:
-		printf("expr stmt\n");
-		
+	case STMT_KIND_RETURN:
 		// expr.
 		exp = TREE_STMT_EXP(tree);
 		assert(exp);
 		assert(TREE_NODE_KIND(exp) == NODE_KIND_LIST);
 		assert(TREE_LIST_KIND(exp) == LIST_KIND_EXPR);
-			
-		visitor->visit_exp(visitor, exp, depth + 1);
-		break;
-	case STMT_KIND_COMPOUND:
-		printf("compound stmt\n");
 		
-		// stmt list.
-		tree_t stmts = TREE_STMT_BODY(tree);
-		assert(TREE_NODE_KIND(stmts) == NODE_KIND_LIST);
-		assert(TREE_LIST_KIND(stmts) == LIST_KIND_STMTS);
-		
-		visitor->visit_list(visitor, stmts, depth + 1);
+		parser_visit_push(visitor->visit_exp, exp, depth + 1);
 		break;
-	case STMT_KIND_RETURN:
-		printf("return stmt\n");
+	case STMT_KIND_COMPOUND:
+		// stmt list, in a scope of its own.
+		body = TREE_STMT_BODY(tree);
+		assert(TREE_NODE_KIND(body) == NODE_KIND_LIST);
+		assert(TREE_LIST_KIND(body) == LIST_KIND_STMTS);
 		
-		// expr.
-		exp = TREE_STMT_EXP(tree);
-		assert(exp);
-		assert(TREE_NODE_KIND(exp) == NODE_KIND_LIST);
-		assert(TREE_LIST_KIND(exp) == LIST_KIND_EXPR);
-			
-		visitor->visit_exp(visitor, exp, depth + 1);
+		parser_visit_push(check_enter_scope, tree, depth);
+		parser_visit_push(visitor->visit_list, body, depth + 1);
+		parser_visit_push(check_leave_scope, tree, depth);
 		break;
 	case STMT_KIND_BREAK:
-		printf("break stmt\n");
-		break;
 	case STMT_KIND_CONTINUE:
-		printf("continue stmt\n");
 		break;
 	case STMT_KIND_IF:
-		printf("if stmt\n");
-		
 		// expr.
 		exp = TREE_STMT_EXP(tree);
 		assert(exp);
 		assert(TREE_NODE_KIND(exp) == NODE_KIND_LIST);
 		assert(TREE_LIST_KIND(exp) == LIST_KIND_EXPR);
-			
-		visitor->visit_exp(visitor, exp, depth + 1);
 		
-		// stmt (then).
-		tree_t then_part = TREE_IF_THEN(tree);
-		assert(then_part);
-		assert(TREE_NODE_KIND(then_part) == NODE_KIND_STMT);
+		parser_visit_push(visitor->visit_exp, exp, depth + 1);
 		
-		visitor->visit_stmt(visitor, then_part, depth + 1);
+		// stmt (then), none for '{}'.
+		tree_t then_part = TREE_IF_THEN(tree);
+		if (then_part) {
+			assert(TREE_NODE_KIND(then_part) == NODE_KIND_STMT);
+			
+			parser_visit_push(visitor->visit_stmt, then_part, depth + 1);
+		}
 		
 		// stmt (else).
 		tree_t else_part = TREE_IF_ELSE(tree);
 		if (else_part) {
 			assert(TREE_NODE_KIND(else_part) == NODE_KIND_STMT);
-		
-			visitor->visit_stmt(visitor, else_part, depth + 1);
+			
+			parser_visit_push(visitor->visit_stmt, else_part, depth + 1);
 		}
 		break;
 	case STMT_KIND_FOR:
-		printf("for stmt\n");
-		
 		// init.
-		tree_t init = TREE_FOR_INIT(tree);
+		init = TREE_FOR_INIT(tree);
 		if (init) {
 			assert(TREE_NODE_KIND(init) == NODE_KIND_STMT);
 			assert(TREE_STMT_KIND(init) == STMT_KIND_EXPR);
-
-			visitor->visit_stmt(visitor, init, depth + 1);
+			
+			parser_visit_push(visitor->visit_stmt, init, depth + 1);
 		}
 		
 		// expr.
@@ -681,43 +408,43 @@ static void visit_stmt(tree_node_visitor_t *visitor, tree_t tree, int depth)
 		if (exp) {
 			assert(TREE_NODE_KIND(exp) == NODE_KIND_STMT);
 			assert(TREE_STMT_KIND(exp) == STMT_KIND_EXPR);
-
-			visitor->visit_stmt(visitor, exp, depth + 1);
+			
+			parser_visit_push(visitor->visit_stmt, exp, depth + 1);
 		}
 		
 		// incr.
-		tree_t incr = TREE_FOR_INCR(tree);
+		incr = TREE_FOR_INCR(tree);
 		if (incr) {
 			assert(TREE_NODE_KIND(incr) == NODE_KIND_LIST);
 			assert(TREE_LIST_KIND(incr) == LIST_KIND_EXPR);
 			
-			visitor->visit_exp(visitor, incr, depth + 1);
+			parser_visit_push(visitor->visit_exp, incr, depth + 1);
 		}
 		
-		// body.
+		// body, none for '{}'.
 		body = TREE_STMT_BODY(tree);
-		assert(body);
-		assert(TREE_NODE_KIND(body) == NODE_KIND_STMT);
-		
-		visitor->visit_stmt(visitor, body, depth + 1);
+		if (body) {
+			assert(TREE_NODE_KIND(body) == NODE_KIND_STMT);
+			
+			parser_visit_push(visitor->visit_stmt, body, depth + 1);
+		}
 		break;
 	case STMT_KIND_WHILE:
-		printf("while stmt\n");
-		
 		// expr.
 		exp = TREE_STMT_EXP(tree);
 		assert(exp);
 		assert(TREE_NODE_KIND(exp) == NODE_KIND_LIST);
 		assert(TREE_LIST_KIND(exp) == LIST_KIND_EXPR);
-			
-		visitor->visit_exp(visitor, exp, depth + 1);
 		
-		// body.
-		body = TREE_STMT_BODY(tree);
-		assert(body);
-		assert(TREE_NODE_KIND(body) == NODE_KIND_STMT);
+		parser_visit_push(visitor->visit_exp, exp, depth + 1);
 		
-		visitor->visit_stmt(visitor, body, depth + 1);
+		// body, none for '{}'.
+		body = TREE_STMT_BODY(tree);
+		if (body) {
+			assert(TREE_NODE_KIND(body) == NODE_KIND_STMT);
+			
+			parser_visit_push(visitor->visit_stmt, body, depth + 1);
+		}
 		break;
 	default:
 		assert(false);
@@ -727,29 +454,116 @@ static void visit_stmt(tree_node_visitor_t *visitor, tree_t tree, int depth)
 
 static void visit_typespec(tree_node_visitor_t *visitor, tree_t tree, int depth)
 {
-	print_space(depth);
-	printf("type specifier = ");
+	if (TREE_TYPESPEC_KIND(tree) != TYPESPEC_ID)
+		return;
 	
-	if (TREE_TYPESPEC_ARRAY(tree))
-		printf("%d-dim array of ", TREE_TYPESPEC_DIM(tree));
+	tree_t id = TREE_TYPESPEC_ID(tree);
+	visitor->visit_id(visitor, id, depth + 1);
+	if (TREE_DECL_KIND(TREE_ID_DECL(id)) != DECL_KIND_TYPENAME)
+		fatal_tree(id, "'%s' does not name a record", TREE_ID_NAME(id));
+}
+
+#ifndef NDEBUG
+// Every function def in tu has its body lazy, or none has.
+static bool check_test_lazy(tree_t tu, bool lazy)
+{
+	int i;
+	for (i = 0; i != TREE_LIST_COUNT(tu); ++i) {
+		tree_t decl = TREE_LIST_ITEM(tu, i);
+		if (TREE_DECL_KIND(decl) == DECL_KIND_FUNCTION && !TREE_DECL_NATIVE(decl) &&
+			TREE_DECL_LAZY(decl) != lazy)
+			return false;
+	}
 	
-	switch (TREE_TYPESPEC_KIND(tree)) {
-	case TYPESPEC_CHAR:
-		printf("char");
-		break;
-	case TYPESPEC_ID:
-		printf(TREE_ID_NAME(TREE_TYPESPEC_ID(tree)));
-		break;
-	case TYPESPEC_INT:
-		printf("int");
-		break;
-	case TYPESPEC_STRING:
-		printf("string");
-		break;
-	default:
+	return true;
+}
+
+// Lexes, parses and checks src in a child, with its output dropped.
+// Returns how the child exits: 0 if src is accepted, 1 from fatal()
+// if it is rejected, -1 for a crash or a failed assert.
+// With lazy, the bodies are left lazy and checked for their syntax
+// first, as for -flist-functions, then the checker parses each one
+// through TREE_DECL_VARS() and TREE_DECL_STMTS().
+static int check_test_run(const char *src, bool lazy)
+{
+	int fds[2];
+	if (pipe(fds) < 0)
 		assert(false);
-		break;
+	
+	// The sources are short enough to fit the pipe whole.
+	size_t len = strlen(src);
+	if (write(fds[1], src, len) != len)
+		assert(false);
+	close(fds[1]);
+	
+	fflush(stdout);
+	fflush(stderr);
+	pid_t pid = fork();
+	assert(pid >= 0);
+	if (!pid) {
+		int null = open("/dev/null", O_WRONLY);
+		dup2(null, STDOUT_FILENO);
+		dup2(null, STDERR_FILENO);
+		dup2(fds[0], STDIN_FILENO);
+		
+		atom_init();
+		lex_init("-");
+		parser_init();
+		parser_lazy_bodies = lazy;
+		tree_t tree = parser_file();
+		if (lazy) {
+			assert(check_test_lazy(tree, true));
+			parser_check_bodies(tree);
+			assert(check_test_lazy(tree, true));
+		}
+		parser_visit_tree(&check_visitor, tree);
+		assert(check_test_lazy(tree, false));
+		_exit(0);
+	}
+	close(fds[0]);
+	
+	int status;
+	waitpid(pid, &status, 0);
+	return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+#endif
+
+void check_unittest()
+{
+#	ifndef NDEBUG
+	static const char *accepted[] = {
+		// '{}' parses to no stmt at all.
+		"int main(string[] a) { int x; x = 0;"
+		" if (x == 0) {} else { x = 1; } if (x == 1) x = 2; else {}"
+		" while (x) {} for (;;) {} {} { {} } return 0; }",
+		
+		// A variable named as its record type.
+		"record P { int x; } int main(string[] a) { P P; return 0; }",
+		"record P { int x; } int f(P P) { int y; return 0; }",
+		"record P { P P; }",
+		NULL
+	};
+	
+	static const char *rejected[] = {
+		"int main(string[] a) { int x; y = 0; return 0; }",
+		"int main(string[] a) { int x; int x; return 0; }",
+		"int main(string[] a) { int x; { {} } x(); return 0; }",
+		"record P { int x; } int main(string[] a) { P P; P Q; return 0; }",
+		
+		// Only a body is wrong, even when no pass asks for it.
+		"int f(int x) { int y; y = ; return 0; } int main(string[] a) { int x; return 0; }",
+		NULL
+	};
+	
+	const char **src;
+	int lazy;
+	for (lazy = 0; lazy != 2; ++lazy) {
+		for (src = accepted; *src; ++src)
+			assert(check_test_run(*src, lazy) == 0);
+		for (src = rejected; *src; ++src)
+			assert(check_test_run(*src, lazy) == 1);
 	}
+#	endif
 	
-	printf("\n");
+	printf("test check ok\n");
 }
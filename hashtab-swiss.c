@@ -0,0 +1,296 @@
+#include "javac.h"
+
+// The same hash table interface as hashtab.c, as a group-probed table
+// in the style of Swiss tables. Built with HASHTAB_SWISS only.
+#ifdef HASHTAB_SWISS
+
+#if defined(__SSE2__)
+#	include <emmintrin.h>
+#endif
+
+// Every slot has a control byte: HASHTAB_EMPTY, HASHTAB_DELETED,
+// or for a full slot the low 7 bits of its hash (the tag).
+// A probe loads the control bytes of HASHTAB_GROUP slots at once and
+// compares all their tags with the one looked for, so the slots
+// themselves are only touched on a tag match. The high bits of the
+// hash pick the first group; groups are then tried at growing strides,
+// which visit every group as the slot count is a power of 2.
+//
+// The first HASHTAB_GROUP control bytes are repeated past the end,
+// so a group starting near the end can be loaded in one go.
+//
+// Removed slots become HASHTAB_DELETED, so that probes go on past them,
+// and are only reclaimed by a rehash. The table is rehashed when no
+// free slot is left within 7/8 of it: doubled if it is more than half
+// full, in place otherwise.
+#define HASHTAB_GROUP 16
+#define HASHTAB_MIN_SLOTS HASHTAB_GROUP
+#define HASHTAB_EMPTY 0x80
+#define HASHTAB_DELETED 0xFE
+
+#define HASHTAB_TAG(HASH) ((HASH) & 0x7F)
+
+static inline int hashtab_start(phashtab_t phashtab, unsigned hash)
+{
+	return (hash >> 7) & (phashtab->n_buckets - 1);
+}
+
+// Bit i is set if control byte i of the group at ctrl is c.
+static inline unsigned hashtab_match(const unsigned char *ctrl, unsigned char c)
+{
+#	if defined(__SSE2__)
+	__m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(c)));
+#	else
+	unsigned mask = 0;
+	int i;
+	for (i = 0; i != HASHTAB_GROUP; ++i)
+		if (ctrl[i] == c)
+			mask |= 1u << i;
+	return mask;
+#	endif
+}
+
+// Bit i is set if slot i of the group at ctrl is empty or deleted,
+// which are the only control bytes with the high bit set.
+static inline unsigned hashtab_match_free(const unsigned char *ctrl)
+{
+#	if defined(__SSE2__)
+	return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)ctrl));
+#	else
+	unsigned mask = 0;
+	int i;
+	for (i = 0; i != HASHTAB_GROUP; ++i)
+		if (ctrl[i] & 0x80)
+			mask |= 1u << i;
+	return mask;
+#	endif
+}
+
+static inline void hashtab_set_ctrl(phashtab_t phashtab, int i, unsigned char c)
+{
+	phashtab->ctrl[i] = c;
+	if (i < HASHTAB_GROUP)
+		phashtab->ctrl[phashtab->n_buckets + i] = c;
+}
+
+static void hashtab_alloc(phashtab_t phashtab, int n_slots)
+{
+	phashtab->n_buckets = n_slots;
+	phashtab->growth_left = n_slots - n_slots / 8 - phashtab->n_elems;
+	phashtab->slots = xmalloc(n_slots * sizeof(hashtab_slot_t));
+	phashtab->ctrl = xmalloc(n_slots + HASHTAB_GROUP);
+	memset(phashtab->ctrl, HASHTAB_EMPTY, n_slots + HASHTAB_GROUP);
+}
+
+// n_buckets is how many elements are expected,
+// the table grows past it when needed.
+phashtab_t hashtab_create(int n_buckets)
+{
+	phashtab_t hashtab = xmalloc(sizeof(hashtab_t));
+	hashtab->n_elems = 0;
+	
+	int n_slots = HASHTAB_MIN_SLOTS;
+	while (n_slots - n_slots / 8 < n_buckets)
+		n_slots *= 2;
+	hashtab_alloc(hashtab, n_slots);
+	
+	return hashtab;
+}
+
+void hashtab_destroy(phashtab_t phashtab)
+{
+	assert(phashtab);
+	
+	// Keys are in the pairs, freeing the pairs frees them all.
+	int i;
+	for (i = 0; i != phashtab->n_buckets; ++i)
+		if (!(phashtab->ctrl[i] & 0x80))
+			pool_free(phashtab->slots[i].ppair);
+	
+	xfree(phashtab->ctrl);
+	xfree(phashtab->slots);
+	xfree(phashtab);
+}
+
+// The slot holding key, or NULL.
+static phashtab_slot_t hashtab_find(phashtab_t phashtab, const char *key, size_t len, unsigned hash)
+{
+	int mask = phashtab->n_buckets - 1;
+	int pos = hashtab_start(phashtab, hash);
+	int stride = 0;
+	
+	while (true) {
+		const unsigned char *ctrl = phashtab->ctrl + pos;
+		unsigned match = hashtab_match(ctrl, HASHTAB_TAG(hash));
+		while (match) {
+			phashtab_slot_t slot = &phashtab->slots[(pos + __builtin_ctz(match)) & mask];
+			if (slot->hash == hash && slot->len == len && !memcmp(slot->ppair->key, key, len))
+				return slot;
+			match &= match - 1;
+		}
+		
+		// An empty slot ends every probe that could reach the key.
+		if (hashtab_match(ctrl, HASHTAB_EMPTY))
+			return NULL;
+		
+		stride += HASHTAB_GROUP;
+		pos = (pos + stride) & mask;
+	}
+}
+
+// The first empty or deleted slot on the probe sequence of hash.
+static int hashtab_find_free(phashtab_t phashtab, unsigned hash)
+{
+	int mask = phashtab->n_buckets - 1;
+	int pos = hashtab_start(phashtab, hash);
+	int stride = 0;
+	
+	while (true) {
+		unsigned match = hashtab_match_free(phashtab->ctrl + pos);
+		if (match)
+			return (pos + __builtin_ctz(match)) & mask;
+		
+		stride += HASHTAB_GROUP;
+		pos = (pos + stride) & mask;
+	}
+}
+
+static void hashtab_rehash(phashtab_t phashtab, int n_slots)
+{
+	int old_n_slots = phashtab->n_buckets;
+	phashtab_slot_t old_slots = phashtab->slots;
+	unsigned char *old_ctrl = phashtab->ctrl;
+	
+	hashtab_alloc(phashtab, n_slots);
+	
+	int i;
+	for (i = 0; i != old_n_slots; ++i) {
+		if (old_ctrl[i] & 0x80)
+			continue;
+		
+		int k = hashtab_find_free(phashtab, old_slots[i].hash);
+		hashtab_set_ctrl(phashtab, k, HASHTAB_TAG(old_slots[i].hash));
+		phashtab->slots[k] = old_slots[i];
+	}
+	
+	xfree(old_ctrl);
+	xfree(old_slots);
+}
+
+void hashtab_insert(phashtab_t phashtab, const char *key, const void *pdata, size_t size)
+{
+	assert(phashtab);
+	assert(key);
+	
+	size_t len = strlen(key);
+	unsigned hash = hash_bytes(key, len);
+	
+	// Ensure no duplicate key in the same hash table.
+	assert(!hashtab_find(phashtab, key, len, hash));
+	
+	int i = hashtab_find_free(phashtab, hash);
+	
+	// Only taking an empty slot uses up room, a deleted one was counted.
+	if (phashtab->ctrl[i] == HASHTAB_EMPTY && !phashtab->growth_left) {
+		if (phashtab->n_elems >= phashtab->n_buckets / 2)
+			hashtab_rehash(phashtab, phashtab->n_buckets * 2);
+		else
+			hashtab_rehash(phashtab, phashtab->n_buckets);
+		i = hashtab_find_free(phashtab, hash);
+	}
+	if (phashtab->ctrl[i] == HASHTAB_EMPTY)
+		phashtab->growth_left--;
+	
+	// Build the pair in place, the key right after the data.
+	ppair_t ppair = pool_alloc(sizeof(pair_t) + size + len + 1);
+	ppair->key = memcpy(ppair->data + size, key, len + 1);
+	if (pdata && size > 0)
+		memcpy(ppair->data, pdata, size);
+	
+	hashtab_set_ctrl(phashtab, i, HASHTAB_TAG(hash));
+	phashtab_slot_t slot = &phashtab->slots[i];
+	slot->hash = hash;
+	slot->len = len;
+	slot->ppair = ppair;
+	phashtab->n_elems++;
+}
+
+bool hashtab_lookup(phashtab_t phashtab, const char *key, void *pdata, size_t size)
+{
+	assert(phashtab);
+	assert(key);
+	
+	size_t len = strlen(key);
+	phashtab_slot_t slot = hashtab_find(phashtab, key, len, hash_bytes(key, len));
+	if (!slot)
+		return false;
+	
+	if (pdata && size > 0)
+		memcpy(pdata, slot->ppair->data, size);
+	
+	return true;
+}
+
+bool hashtab_remove(phashtab_t phashtab, const char *key)
+{
+	assert(phashtab);
+	assert(key);
+	
+	size_t len = strlen(key);
+	phashtab_slot_t slot = hashtab_find(phashtab, key, len, hash_bytes(key, len));
+	if (!slot)
+		return false;
+	
+	pool_free(slot->ppair);
+	slot->ppair = NULL;
+	hashtab_set_ctrl(phashtab, slot - phashtab->slots, HASHTAB_DELETED);
+	phashtab->n_elems--;
+	
+	return true;
+}
+
+void hashtab_stat(phashtab_t phashtab, const char *name)
+{
+	printf("stat for hashtab '%s': \n", name);
+	int sum = 0;
+	int deleted = 0;
+	int longest = 0;
+	long probes = 0;
+	int mask = phashtab->n_buckets - 1;
+	int i;
+	for (i = 0; i != phashtab->n_buckets; ++i) {
+		if (phashtab->ctrl[i] == HASHTAB_DELETED)
+			deleted++;
+		if (phashtab->ctrl[i] & 0x80)
+			continue;
+		
+		// Groups loaded to find this slot.
+		phashtab_slot_t slot = &phashtab->slots[i];
+		int pos = hashtab_start(phashtab, slot->hash);
+		int stride = 0;
+		int probe = 1;
+		while (((i - pos) & mask) >= HASHTAB_GROUP) {
+			stride += HASHTAB_GROUP;
+			pos = (pos + stride) & mask;
+			probe++;
+		}
+#		if HASHTAB_STAT_VERBOSE
+		printf("%d groups for '%s'\n", probe, slot->ppair->key);
+#		endif
+	
+		sum++;
+		probes += probe;
+		if (probe > longest)
+			longest = probe;
+	}
+	printf("element count = %d, load factor = %.2f, deleted = %d, mean groups = %.2f, most groups = %d\n",
+		sum,
+		(double)sum / phashtab->n_buckets,
+		deleted,
+		sum ? (double)probes / sum : 0.0,
+		longest
+		);
+}
+
+#endif // HASHTAB_SWISS
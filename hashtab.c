@@ -1,16 +1,105 @@
 #include "javac.h"
 
+// A word-at-a-time hash in the style of wyhash: 16 bytes are mixed
+// per step by one wide multiply, and short keys are read as at most
+// two overlapping loads, so no byte is handled on its own.
+#define HASH_P0 0xa0761d6478bd642full
+#define HASH_P1 0xe7037ed1a0b428dbull
+#define HASH_P2 0x8ebc6af09c88c6e3ull
+
+// Folds the 128-bit product of a and b to 64 bits.
+static inline uint64_t hash_mum(uint64_t a, uint64_t b)
+{
+#	ifdef __SIZEOF_INT128__
+	__uint128_t r = (__uint128_t)a * b;
+	return (uint64_t)r ^ (uint64_t)(r >> 64);
+#	else
+	uint64_t ha = a >> 32, la = (uint32_t)a;
+	uint64_t hb = b >> 32, lb = (uint32_t)b;
+	uint64_t hh = ha * hb, hl = ha * lb, lh = la * hb, ll = la * lb;
+	uint64_t mid = (ll >> 32) + (uint32_t)hl + (uint32_t)lh;
+	uint64_t lo = (mid << 32) | (uint32_t)ll;
+	uint64_t hi = hh + (hl >> 32) + (lh >> 32) + (mid >> 32);
+	return lo ^ hi;
+#	endif
+}
+
+static inline uint64_t hash_read64(const unsigned char *p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint64_t hash_read32(const unsigned char *p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+// Hashes the len bytes at data; the hash of a key and of
+// an identifier spelled the same are equal.
+unsigned hash_bytes(const void *data, size_t len)
+{
+	const unsigned char *p = data;
+	uint64_t seed = HASH_P0 ^ len;
+	uint64_t a, b;
+	
+	size_t n = len;
+	while (n > 16) {
+		seed = hash_mum(hash_read64(p) ^ HASH_P1, hash_read64(p + 8) ^ seed);
+		p += 16;
+		n -= 16;
+	}
+	
+	if (n >= 8) {
+		a = hash_read64(p);
+		b = hash_read64(p + n - 8);
+	} else if (n >= 4) {
+		a = hash_read32(p);
+		b = hash_read32(p + n - 4);
+	} else if (n > 0) {
+		a = ((uint64_t)p[0] << 16) | ((uint64_t)p[n >> 1] << 8) | p[n - 1];
+		b = 0;
+	} else {
+		a = b = 0;
+	}
+	
+	uint64_t hash = hash_mum(hash_mum(a ^ HASH_P1, b ^ seed), len ^ HASH_P2);
+	return (unsigned)(hash ^ (hash >> 32));
+}
+
+// Built with HASHTAB_SWISS, hashtab-swiss.c has the table instead.
+#ifndef HASHTAB_SWISS
+
+// Open addressing with linear probing. A slot holds the hash and
+// the length of its key and the pair, the pair is NULL in a free slot.
+// The slot count is a power of 2 and doubles before the table is 3/4
+// full; the cached hashes make the rehash cheap and spare most key
+// compares.
+// hashtab_remove() shifts the following entries back into the hole,
+// so no tombstones are left behind.
+#define HASHTAB_MIN_SLOTS 8
+
+static inline int hashtab_home(phashtab_t phashtab, unsigned hash)
+{
+	return hash & (phashtab->n_buckets - 1);
+}
+
+// n_buckets is how many elements are expected,
+// the table grows past it when needed.
 phashtab_t hashtab_create(int n_buckets)
 {
 	phashtab_t hashtab = xmalloc(sizeof(hashtab_t));
 	hashtab->n_elems = 0;
 	
-	hashtab->n_buckets = n_buckets;
-	hashtab->buckets = xmalloc(hashtab->n_buckets * sizeof(slist_t));
-	int i;
-	for (i = 0; i != hashtab->n_buckets; ++i)
-		hashtab->buckets[i] = slist_create();
-		
+	hashtab->n_buckets = HASHTAB_MIN_SLOTS;
+	while (hashtab->n_buckets * 3 < n_buckets * 4)
+		hashtab->n_buckets *= 2;
+	hashtab->slots = xmalloc(hashtab->n_buckets * sizeof(hashtab_slot_t));
+	memset(hashtab->slots, 0, hashtab->n_buckets * sizeof(hashtab_slot_t));
+	
 	return hashtab;
 }
 
@@ -18,41 +107,56 @@ void hashtab_destroy(phashtab_t phashtab)
 {
 	assert(phashtab);
 	
+	// Keys are in the pairs, freeing the pairs frees them all.
 	int i;
-	for (i = 0; i != phashtab->n_buckets; ++i) {
-		// Free the spaces for 'key'.
-		slist_iter_t iter;
-		slist_iter_begin(phashtab->buckets[i], &iter);
-		while (slist_iter_not_end(&iter)) {
-			pair_t pair = SLIST_ITER_GET_T(iter, pair_t);
-			assert(pair.key);
-			xfree((void *)pair.key);
-			slist_iter_move_next(&iter);
-		}
+	for (i = 0; i != phashtab->n_buckets; ++i)
+		pool_free(phashtab->slots[i].ppair);
+	
+	xfree(phashtab->slots);
+	xfree(phashtab);
+}
+
+// The slot holding key, or the free slot ending its probe sequence.
+// Key bytes are only compared when both hash and length match.
+static phashtab_slot_t hashtab_find(phashtab_t phashtab, const char *key, size_t len, unsigned hash)
+{
+	int mask = phashtab->n_buckets - 1;
+	int i = hashtab_home(phashtab, hash);
+	
+	while (true) {
+		phashtab_slot_t slot = &phashtab->slots[i];
+		if (!slot->ppair)
+			return slot;
+		if (slot->hash == hash && slot->len == len && !memcmp(slot->ppair->key, key, len))
+			return slot;
 		
-		// Destroy the bucket.
-		slist_destroy(phashtab->buckets[i]);
+		i = (i + 1) & mask;
 	}
-		
-	xfree(phashtab->buckets);
-	xfree(phashtab);
 }
 
-static int string_hash(const char *key)
+static void hashtab_grow(phashtab_t phashtab)
 {
-	int hash = 0;
- 
-	while (*key) {
-		hash = (hash << 4) + (*key++);
+	int n_slots = phashtab->n_buckets;
+	phashtab_slot_t slots = phashtab->slots;
+	
+	phashtab->n_buckets = n_slots * 2;
+	phashtab->slots = xmalloc(phashtab->n_buckets * sizeof(hashtab_slot_t));
+	memset(phashtab->slots, 0, phashtab->n_buckets * sizeof(hashtab_slot_t));
+	
+	// Keys are all different, only free slots are looked for.
+	int mask = phashtab->n_buckets - 1;
+	int i;
+	for (i = 0; i != n_slots; ++i) {
+		if (!slots[i].ppair)
+			continue;
 		
-		int temp = hash & 0xF0000000;
-		if (temp) {
-			hash = hash ^ (temp >> 24);
-			hash = hash ^ temp;
-		}
+		int k = hashtab_home(phashtab, slots[i].hash);
+		while (phashtab->slots[k].ppair)
+			k = (k + 1) & mask;
+		phashtab->slots[k] = slots[i];
 	}
- 
-	return hash & 0x7FFFFFFF;
+	
+	xfree(slots);
 }
 
 void hashtab_insert(phashtab_t phashtab, const char *key, const void *pdata, size_t size)
@@ -60,30 +164,26 @@ void hashtab_insert(phashtab_t phashtab, const char *key, const void *pdata, siz
 	assert(phashtab);
 	assert(key);
 	
-	int hash = string_hash(key);
-	int index = hash % phashtab->n_buckets;
+	if ((phashtab->n_elems + 1) * 4 > phashtab->n_buckets * 3)
+		hashtab_grow(phashtab);
 	
-	// Create a pair.
-	size_t pair_size = sizeof(pair_t) + size;
-	ppair_t ppair = xmalloc(pair_size);
-	ppair->key = xstrdup(key);
-	if (pdata && size > 0)
-		memcpy(ppair->data, pdata, size);
+	size_t len = strlen(key);
+	unsigned hash = hash_bytes(key, len);
+	phashtab_slot_t slot = hashtab_find(phashtab, key, len, hash);
 	
-	// Insert to that bucket.
-	slist_iter_t iter;
-	slist_iter_begin(phashtab->buckets[index], &iter);
-#	ifndef NDEBUG
 	// Ensure no duplicate key in the same hash table.
-	while (slist_iter_not_end(&iter)) {
-		ppair_t ppair = &SLIST_ITER_GET_T(iter, pair_t);
-		assert(strcmp(ppair->key, key));
-		slist_iter_move_next(&iter);
-	}
-#	endif
-	slist_insert(&iter, ppair, pair_size);
+	assert(!slot->ppair);
+	
+	// Build the pair in place, the key right after the data.
+	ppair_t ppair = pool_alloc(sizeof(pair_t) + size + len + 1);
+	ppair->key = memcpy(ppair->data + size, key, len + 1);
+	if (pdata && size > 0)
+		memcpy(ppair->data, pdata, size);
 	
-	xfree(ppair);
+	slot->hash = hash;
+	slot->len = len;
+	slot->ppair = ppair;
+	phashtab->n_elems++;
 }
 
 bool hashtab_lookup(phashtab_t phashtab, const char *key, void *pdata, size_t size)
@@ -91,56 +191,84 @@ bool hashtab_lookup(phashtab_t phashtab, const char *key, void *pdata, size_t si
 	assert(phashtab);
 	assert(key);
 	
-	int hash = string_hash(key);
-	int index = hash % phashtab->n_buckets;
+	size_t len = strlen(key);
+	phashtab_slot_t slot = hashtab_find(phashtab, key, len, hash_bytes(key, len));
+	if (!slot->ppair)
+		return false;
+	
+	if (pdata && size > 0)
+		memcpy(pdata, slot->ppair->data, size);
+	
+	return true;
+}
+
+bool hashtab_remove(phashtab_t phashtab, const char *key)
+{
+	assert(phashtab);
+	assert(key);
+	
+	size_t len = strlen(key);
+	phashtab_slot_t slot = hashtab_find(phashtab, key, len, hash_bytes(key, len));
+	if (!slot->ppair)
+		return false;
+	
+	pool_free(slot->ppair);
+	phashtab->n_elems--;
 	
-	slist_iter_t iter;
-	slist_iter_begin(phashtab->buckets[index], &iter);
-	while (slist_iter_not_end(&iter)) {
-		ppair_t ppair = &SLIST_ITER_GET_T(iter, pair_t);
+	// Move back every following entry that may sit in the hole:
+	// one whose home is not cyclically within (hole, entry].
+	int mask = phashtab->n_buckets - 1;
+	int hole = slot - phashtab->slots;
+	int i = hole;
+	while (true) {
+		i = (i + 1) & mask;
+		if (!phashtab->slots[i].ppair)
+			break;
 		
-		if (!strcmp(ppair->key, key)) {
-			if (pdata && size > 0)
-				memcpy(pdata, ppair->data, size);
-			
-			return true;
+		int home = hashtab_home(phashtab, phashtab->slots[i].hash);
+		if (((i - home) & mask) >= ((i - hole) & mask)) {
+			phashtab->slots[hole] = phashtab->slots[i];
+			hole = i;
 		}
-		
-		slist_iter_move_next(&iter);
 	}
+	phashtab->slots[hole].ppair = NULL;
 	
-	return false;
+	return true;
 }
 
 void hashtab_stat(phashtab_t phashtab, const char *name)
 {
 	printf("stat for hashtab '%s': \n", name);
 	int sum = 0;
-	int empty = 0;
+	int longest = 0;
+	long probes = 0;
+	int mask = phashtab->n_buckets - 1;
 	int i;
 	for (i = 0; i != phashtab->n_buckets; ++i) {
-		int local_sum = 0;
-		slist_iter_t iter;
-		slist_iter_begin(phashtab->buckets[i], &iter);
-		while (slist_iter_not_end(&iter)) {
-			local_sum++;
-			sum++;
-			slist_iter_move_next(&iter);
-		}
+		phashtab_slot_t slot = &phashtab->slots[i];
+		if (!slot->ppair)
+			continue;
+		
+		int probe = ((i - hashtab_home(phashtab, slot->hash)) & mask) + 1;
 #		if HASHTAB_STAT_VERBOSE
-		printf("%d elements in bucket %d\n", local_sum, i);
+		printf("%d probes for '%s'\n", probe, slot->ppair->key);
 #		endif
 		
-		if (slist_is_empty(phashtab->buckets[i]))
-			empty++;
+		sum++;
+		probes += probe;
+		if (probe > longest)
+			longest = probe;
 	}
-	printf("element count = %d, load factor = %.2f, bucket util = %.2f\n",
+	printf("element count = %d, load factor = %.2f, mean probe = %.2f, longest probe = %d\n",
 		sum,
 		(double)sum / phashtab->n_buckets,
-		1.0 - (double)empty / phashtab->n_buckets
-  		);
+		sum ? (double)probes / sum : 0.0,
+		longest
+		);
 }
 
+#endif // HASHTAB_SWISS
+
 void hashtab_unittest()
 {
 	static char *strs[] = {
@@ -179,7 +307,72 @@ void hashtab_unittest()
 		str++;
 	}
 	
+	// Every other key removed, then inserted again with another value.
+	int i;
+	for (i = 0; strs[i]; ++i)
+		if (i % 2 == 0)
+			assert(hashtab_remove(pht, strs[i]));
+	assert(!hashtab_remove(pht, strs[0]));
+	assert(pht->n_elems == 6);
+	for (i = 0; strs[i]; ++i)
+		assert(hashtab_lookup(pht, strs[i], NULL, 0) == (i % 2 == 1));
+	for (i = 0; strs[i]; ++i)
+		if (i % 2 == 0)
+			hashtab_insert(pht, strs[i], &i, sizeof(int));
+#	ifndef NDEBUG
+	int value;
+#	endif
+	for (i = 0; strs[i]; ++i) {
+		if (i % 2 == 0) {
+			assert(hashtab_lookup(pht, strs[i], &value, sizeof(int)));
+			assert(value == i);
+		}
+	}
+	assert(pht->n_elems == 13);
+	
 	hashtab_destroy(pht);
 	
+	// The table grows, and removing keeps every probe sequence whole.
+	pht = hashtab_create(0);
+	enum { N_KEYS = 2000 };
+	char key[16];
+	for (i = 0; i != N_KEYS; ++i) {
+		sprintf(key, "k%d", i);
+		hashtab_insert(pht, key, &i, sizeof(int));
+	}
+	assert(pht->n_elems == N_KEYS);
+	assert(pht->n_buckets >= N_KEYS);
+	for (i = 0; i != N_KEYS; ++i) {
+		sprintf(key, "k%d", i);
+		if (i % 3 == 0)
+			assert(hashtab_remove(pht, key));
+	}
+	for (i = 0; i != N_KEYS; ++i) {
+		sprintf(key, "k%d", i);
+		assert(hashtab_lookup(pht, key, &value, sizeof(int)) == (i % 3 != 0));
+		assert(i % 3 == 0 || value == i);
+	}
+	hashtab_destroy(pht);
+	
+#	ifndef NDEBUG
+	// Every length takes its own path through the hash, the last byte
+	// of a key counts and the bytes around it do not.
+	char buf[64];
+	memset(buf, 'x', sizeof(buf));
+	unsigned hashes[40];
+	int len;
+	for (len = 0; len != 40; ++len) {
+		hashes[len] = hash_bytes(buf + 8, len);
+		assert(hash_bytes(buf + 9, len) == hashes[len]);
+		buf[8 + len] = 'y';
+		assert(hash_bytes(buf + 8, len) == hashes[len]);
+		assert(len == 0 || hash_bytes(buf + 9, len) != hashes[len]);
+		buf[8 + len] = 'x';
+		int k;
+		for (k = 0; k != len; ++k)
+			assert(hashes[k] != hashes[len]);
+	}
+#	endif
+	
 	printf("test hashtab ok\n");
 }
\ No newline at end of file
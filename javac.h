@@ -12,19 +12,97 @@
 
 
 
-#define CURRTEXT() (currtok.token_value.text)
-#define CURRINT() (currtok.token_value.integer)
-#define CURRCHAR() (currtok.token_value.character)
-#define CURRTEXT_EQUALS(S) (!strcmp(CURRTEXT(), (S)))
-#define CURREOF() (currtok.token_flag_eof)
-#define CURRTYPE() (currtok.token_type)
+void *xmalloc(size_t size);
+void *xrealloc(void *p, size_t size);
+void xfree(void *p);
+char *xstrdup(const char *src);
+void xstat();
+
+// Built with XMEM_SITES, every xmalloc() and xrealloc() is also
+// counted for the file and line calling it.
+void *xmalloc_at(size_t size, const char *file, int line);
+void *xrealloc_at(void *p, size_t size, const char *file, int line);
+
+#ifdef XMEM_SITES
+#	define xmalloc(S) xmalloc_at((S), __FILE__, __LINE__)
+#	define xrealloc(P, S) xrealloc_at((P), (S), __FILE__, __LINE__)
+#endif
+
+// Compiler phases memory is counted for, see xmem_phase().
+typedef enum _xmem_phase_t {
+	XMEM_PHASE_MAIN,
+	XMEM_PHASE_LEX,
+	XMEM_PHASE_PARSE,
+	XMEM_PHASE_CHECK,
+	XMEM_PHASE_CODEGEN,
+	XMEM_N_PHASES
+} xmem_phase_t;
+
+void xmem_phase(xmem_phase_t phase);
+void xmem_report(FILE *fp);
+void xmem_unittest();
+
+typedef struct _arena_chunk_t {
+	struct _arena_chunk_t *next;
+	size_t size;
+	size_t used;
+	char data[0] __attribute__((aligned(8)));
+} arena_chunk_t, *parena_chunk_t;
+
+// A zeroed arena_t is an empty arena.
+typedef struct _arena_t {
+	parena_chunk_t chunks;
+} arena_t, *parena_t;
+
+void *arena_alloc(parena_t arena, size_t size);
+void *arena_alloc_shared(parena_t arena, size_t size);
+void arena_free(parena_t arena);
+void arena_merge(parena_t into, parena_t from);
+
+// Where an arena was at, to give back what was made since.
+typedef struct _arena_mark_t {
+	parena_chunk_t chunk;
+	size_t used;
+} arena_mark_t;
+
+arena_mark_t arena_mark(parena_t arena);
+void arena_release(parena_t arena, arena_mark_t mark);
+
+void *pool_alloc(size_t size);
+void pool_free(void *p);
+void pool_finit();
+void pool_unittest();
+
+
+
+// The I-th token of the file.
+#define TOKTYPE(I) (lextoks.types[I])
+#define TOKPAYLOAD(I) (lextoks.payloads[I])
+#define TOKATOM(I) (ATOM_BY_ID(TOKPAYLOAD(I)))
+#define TOKINT(I) (TOKPAYLOAD(I))
+#define TOKCHAR(I) ((char)TOKPAYLOAD(I))
+#define TOKKW(I) (TOKPAYLOAD(I))
+#define TOKEOF(I) (TOKTYPE(I) == TOKEN_TYPE_EOF)
+#define TOKKW_IS(I, K) (TOKTYPE(I) == TOKEN_TYPE_KEYWORD && TOKKW(I) == (K))
+
+// The current token (under the cursor).
+#define CURRSTRING(PLEN) (lex_token_string(lexstate.pos, (PLEN)))
+#define CURRATOM() (TOKATOM(lexstate.pos))
+#define CURRINT() (TOKINT(lexstate.pos))
+#define CURRCHAR() (TOKCHAR(lexstate.pos))
+#define CURRKW() (TOKKW(lexstate.pos))
+#define CURREOF() (TOKEOF(lexstate.pos))
+#define CURRTYPE() (TOKTYPE(lexstate.pos))
 #define CURRTYPE_IS(T) (CURRTYPE() == (T))
+#define CURRKW_IS(K) (TOKKW_IS(lexstate.pos, (K)))
 
-#define LATEXT() (latok.token_value.text)
-#define LATEXT_EQUALS(S) (!strcmp(LATEXT(), (S)))
-#define LAEOF() (latok.token_flag_eof)
-#define LATYPE() (latok.token_type)
+// The look-ahead token (the one after the cursor).
+#define LAATOM() (TOKATOM(lexstate.pos + 1))
+#define LAKW() (TOKKW(lexstate.pos + 1))
+#define LAEOF() (TOKEOF(lexstate.pos + 1))
+#define LATYPE() (TOKTYPE(lexstate.pos + 1))
 #define LATYPE_IS(T) (LATYPE() == (T))
+#define LAKW_IS(K) (TOKKW_IS(lexstate.pos + 1, (K)))
 
 enum TOKEN_TYPES {
 	TOKEN_TYPE_KEYWORD, // Including operatos
@@ -32,43 +110,215 @@ enum TOKEN_TYPES {
 	TOKEN_TYPE_INT_CONST,
 	TOKEN_TYPE_CHAR_CONST,
 	TOKEN_TYPE_STRING_CONST,
+	TOKEN_TYPE_EOF, // Only in the token buffer, see lex_tokens_t.
+};
+
+// Keywords and operators, carried by TOKEN_TYPE_KEYWORD tokens.
+enum KEYWORDS {
+	KEYWORD_NATIVE,		// 'native'
+	KEYWORD_RECORD,		// 'record'
+	KEYWORD_NEW,			// 'new'
+	KEYWORD_INT,			// 'int'
+	KEYWORD_STRING,		// 'string'
+	KEYWORD_CHAR,			// 'char'
+	KEYWORD_NULL,			// 'null'
+	KEYWORD_IF,			// 'if'
+	KEYWORD_ELSE,			// 'else'
+	KEYWORD_WHILE,		// 'while'
+	KEYWORD_FOR,			// 'for'
+	KEYWORD_RETURN,		// 'return'
+	KEYWORD_BREAK,		// 'break'
+	KEYWORD_CONTINUE,		// 'continue'
+	KEYWORD_SEMICOLON,	// ';'
+	KEYWORD_LBRACKET,		// '['
+	KEYWORD_RBRACKET,		// ']'
+	KEYWORD_LBRACE,		// '{'
+	KEYWORD_RBRACE,		// '}'
+	KEYWORD_LPAREN,		// '('
+	KEYWORD_RPAREN,		// ')'
+	KEYWORD_COMMA,		// ','
+	KEYWORD_ASSIGN,		// '='
+	KEYWORD_OR,			// '||'
+	KEYWORD_AND,			// '&&'
+	KEYWORD_EQ,			// '=='
+	KEYWORD_NEQ,			// '!='
+	KEYWORD_LESS,			// '<'
+	KEYWORD_LESS_EQ,		// '<='
+	KEYWORD_GREATER,		// '>'
+	KEYWORD_GREATER_EQ,	// '>='
+	KEYWORD_PLUS,			// '+'
+	KEYWORD_MINUS,		// '-'
+	KEYWORD_MULTIPLY,		// '*'
+	KEYWORD_DIVIDE,		// '/'
+	KEYWORD_MODULO,		// '%'
+	KEYWORD_NOT,			// '!'
+	KEYWORD_DOT,			// '.'
+	KEYWORD_COUNT,
+	KEYWORD_NONE = -1,	// Not a keyword (or end of file).
 };
 
+typedef union _token_value_t {
+	bool escaped;	// String consts: contains an escape sequence
+	struct _atom_t *atom;	// Identifiers
+	int keyword;
+	int integer;
+	char character;
+} token_value_t;
+
+// A token as the DFA produces it.
 typedef struct _token_t {
 	int token_type;
-	union _token_value_t {
-		char *text;
-		int integer;
-		char character;
-	} token_value;
-	unsigned char token_flag_valid : 1;
+	token_value_t token_value;
 	unsigned char token_flag_eof : 1;
 } token_t, *ptoken_t;
 
+// lex_init() lexes the whole file up front into this buffer,
+// one array per field, so the parser walks an index over it
+// and may look arbitrarily far ahead.
+// The file always ends with TOKEN_TYPE_EOF tokens.
+//
+// The payload of a token is, by type:
+//     keyword: the KEYWORD_* code,
+//     identifier: the atom id,
+//     int const, char const: the value,
+//     string const: -1 if it has no escapes (the value is then
+//         the source between the quotes), otherwise an index into
+//         strings, where lex_token_string() decodes it on demand.
+typedef struct _lex_string_t {
+	const char *text; // NULL until decoded.
+	int length;
+} lex_string_t;
+
+typedef struct _lex_tokens_t {
+	int n_toks;
+	int cap;
+	unsigned char *types;
+	int *offsets;	// Source offset of the first character.
+	int *lengths;	// Length in source characters.
+	int *payloads;
+	
+	int n_strings;
+	int cap_strings;
+	lex_string_t *strings;
+	arena_t string_arena;
+} lex_tokens_t, *plex_tokens_t;
+
+// The cursor over the token buffer, pos is the current token.
+// A saved state is a checkpoint to backtrack to.
+// Every thread has a cursor of its own (see lexstate).
 typedef struct _lex_state_t {
-	token_t currtok;
-	token_t latok;
-	int lineno;
-	long pos;
+	int pos;
 } lex_state_t, *plex_state_t;
 
 void lex_init(const char *filename);
 void lex_finit();
 void lex_next_token();
 void lex_peek_token();
+int lex_peek_nth(int n);
+const char *lex_token_string(int i, int *plength);
+void lex_save(plex_state_t pstate);
+void lex_restore(const lex_state_t *pstate);
 void lex_print_all_tokens();
+void lex_locate(int offset, int *pline, int *pcolumn);
+int lex_keyword_lookup(const char *text, size_t len);
+const char *lex_keyword_text(int keyword);
+void lex_unittest();
 
-extern token_t currtok;
-extern token_t latok; // look-ahead token
+// Kernels scanning runs of bytes for the hot lexer states (lex-scan.c).
+// The widest set the CPU supports is picked at run time.
+#define LEX_MAX_SCANNERS 3
 
-extern int lineno;
+typedef struct _lex_scanner_t {
+	const char *name;
+	const char *(*skip_spaces)(const char *p, const char *end);
+	const char *(*skip_id)(const char *p, const char *end);
+	const char *(*find_eol)(const char *p, const char *end);
+	const char *(*skip_block_comment)(const char *p, const char *end);
+} lex_scanner_t;
+
+extern const lex_scanner_t lex_scanner_scalar;
+
+const lex_scanner_t *lex_scanner_select();
+int lex_scanner_available(const lex_scanner_t **scanners);
+void lex_scan_unittest();
+
+extern lex_tokens_t lextoks;
+extern __thread lex_state_t lexstate;
+
+// The source offset fatal() and warn() report, -1 for none.
+// Like the cursor, it is per thread.
+extern __thread int srcpos;
+
+
+
+// Interned spellings (atom.c).
+// An atom is unique per spelling, so atoms compare by pointer.
+// Threads may intern at once between atom_share(true) and
+// atom_share(false), and an atom never moves once it is made.
+#define ATOM_TEXT(A) ((A)->text)
+#define ATOM_LEN(A) ((A)->len)
+#define ATOM_FLAGS(A) (__atomic_load_n(&(A)->node.flags, __ATOMIC_RELAXED))
+#define ATOM_SET_FLAGS(A, F) (__atomic_fetch_or(&(A)->node.flags, (F), __ATOMIC_RELAXED))
+#define ATOM_IS(A, F) ((ATOM_FLAGS(A) & (F)) != 0)
+#define ATOM_KEYWORD(A) ((A)->keyword)
+#define ATOM_ID(A) ((A)->id)
+#define ATOM_BY_ID(ID) (atom_by_id(ID))
+
+enum ATOM_FLAGS {
+	ATOM_FLAG_KEYWORD = 1 << 0,	// Spells a keyword, see ATOM_KEYWORD().
+	ATOM_FLAG_TYPENAME = 1 << 1,	// Names a record.
+};
 
-
-
-void *xmalloc(size_t size);
-void xfree(void *p);
-char *xstrdup(const char *src);
-void xstat();
+// Atoms and the buckets of the table are nodes of one list (see atom.c).
+typedef struct _atom_node_t {
+	struct _atom_node_t *next;
+	unsigned order; // Where in the list.
+	unsigned flags;
+} atom_node_t, *patom_node_t;
+
+typedef struct _atom_t {
+	atom_node_t node;
+	struct _atom_t *chain; // The next in its bucket of the chained table.
+	unsigned hash;
+	unsigned id; // Atoms are numbered from 0 in order of creation.
+	unsigned len;
+	int keyword;
+	char text[0];
+} atom_t, *patom_t;
+
+// Arrays indexed by atom id, and the buckets of the table, are cut in
+// segments that double in size and never move once made:
+// segment s holds indexes ATOM_SEGMENT0 * (2^s - 1) up to
+// ATOM_SEGMENT0 * (2^(s + 1) - 1), exclusive.
+#define ATOM_SEGMENT0 256
+#define ATOM_SEGMENTS 24
+
+static inline unsigned atom_segment(unsigned i)
+{
+	return 31 - __builtin_clz(i / ATOM_SEGMENT0 + 1);
+}
+
+static inline unsigned atom_segment_offset(unsigned i, unsigned s)
+{
+	return i - ATOM_SEGMENT0 * ((1u << s) - 1);
+}
+
+extern patom_t *atoms_by_id[ATOM_SEGMENTS];
+
+static inline patom_t atom_by_id(unsigned id)
+{
+	unsigned s = atom_segment(id);
+	return atoms_by_id[s][atom_segment_offset(id, s)];
+}
+
+void atom_init();
+void atom_finit();
+patom_t atom_intern(const char *text, size_t len);
+patom_t atom_intern_str(const char *text);
+void atom_share(bool share);
+unsigned atom_count();
+void atom_stat();
+void atom_unittest();
 
 
 
@@ -90,6 +340,7 @@ void *slist_iter_deref(pslist_iter_t piter);
 slist_t slist_create();
 void slist_destroy(slist_t list);
 void slist_insert(pslist_iter_t piter, const void *pdata, size_t size);
+void *slist_insert_new(pslist_iter_t piter, size_t size);
 void slist_push_front(slist_t list, const void *pdata, size_t size);
 void slist_remove(pslist_iter_t piter);
 bool slist_is_empty(slist_t list);
@@ -103,44 +354,70 @@ void slist_unittest();
 #define HASHTAB_STAT(PHT) hashtab_stat(PHT, #PHT)
 #define HASHTAB_STAT_VERBOSE 0
 
-typedef struct _hashtab_t {
-	int n_buckets;
-	int n_elems;
-	slist_t *buckets;
-} hashtab_t, *phashtab_t;
-
+// The key is kept in the same block, right after the data.
 typedef struct _pair_t {
 	const char *key; // Key is not allowed to change in hash table.
 	char data[0];
 } pair_t, *ppair_t;
 
+typedef struct _hashtab_slot_t {
+	unsigned hash;
+	unsigned len; // Of the key.
+	ppair_t ppair; // NULL if the slot is free.
+} hashtab_slot_t, *phashtab_slot_t;
+
+typedef struct _hashtab_t {
+	int n_buckets; // Slots, a power of 2.
+	int n_elems;
+	phashtab_slot_t slots;
+#	ifdef HASHTAB_SWISS
+	unsigned char *ctrl; // A control byte per slot, see hashtab-swiss.c.
+	int growth_left;
+#	endif
+} hashtab_t, *phashtab_t;
+
 phashtab_t hashtab_create(int n_buckets);
 void hashtab_destroy(phashtab_t phashtab);
 void hashtab_insert(phashtab_t phashtab, const char *key, const void *pdata, size_t size);
 bool hashtab_lookup(phashtab_t phashtab, const char *key, void *pdata, size_t size);
+bool hashtab_remove(phashtab_t phashtab, const char *key);
 void hashtab_unittest();
 void hashtab_stat(phashtab_t phashtab, const char *name);
+unsigned hash_bytes(const void *data, size_t len);
 
 
 
-#define TREE_NODE_LNO(T) ((T)->common.lineno)
+#define TREE_NODE_OFFSET(T) ((T)->common.offset)
 #define TREE_NODE_KIND(T) ((T)->common.node_kind)
 
-#define TREE_LIST(T) ((T)->list.list)
+#define TREE_LIST_COUNT(T) ((T)->list.n_items)
+#define TREE_LIST_ITEMS(T) ((T)->list.items)
+#define TREE_LIST_ITEM(T, I) ((T)->list.items[(I)])
 #define TREE_LIST_KIND(T) ((T)->list.list_kind)
 
-#define TREE_ALLOC(K) xmalloc(sizeof(K))
+// Nodes and the arrays of their lists are never freed one by one:
+// they come from tree_arena, in the order they are made,
+// and parser_free_tree() releases it after the last pass.
+// Threads parsing function bodies have an arena each, handed over
+// to the one of the main thread when they are done.
+extern __thread arena_t tree_arena;
+
+#define TREE_ALLOC(K) arena_alloc(&tree_arena, sizeof(K))
 
 #define TREE_DECL_KIND(T) ((T)->decl_common.decl_kind)
 #define TREE_DECL_NATIVE(T) ((T)->decl.flag_native)
 #define TREE_DECL_PARAM(T) ((T)->decl.flag_param)
-#define TREE_DECL_VARS(T) ((T)->decl.vars)
-#define TREE_DECL_STMTS(T) ((T)->decl.stmts)
+#define TREE_DECL_LAZY(T) ((T)->decl.flag_lazy)
+#define TREE_DECL_BODY(T) ((T)->decl.body)
+#define TREE_DECL_VARS(T) (parser_decl_body(T)->decl.vars)
+#define TREE_DECL_STMTS(T) (parser_decl_body(T)->decl.stmts)
 #define TREE_DECL_PARAMS(T) ((T)->decl.params)
 #define TREE_DECL_TYPESPEC(T) ((T)->decl.typespec)
 #define TREE_DECL_ID(T) ((T)->decl_common.id)
 
-#define TREE_ID_NAME(T) ((T)->id.name)
+#define TREE_ID_ATOM(T) ((T)->id.atom)
+#define TREE_ID_NAME(T) (ATOM_TEXT(TREE_ID_ATOM(T)))
+#define TREE_ID_DECL(T) ((T)->id.decl)
 
 #define TREE_TYPESPEC_KIND(T) ((T)->typespec.typespec_kind)
 #define TREE_TYPESPEC_ID(T) ((T)->typespec.id)
@@ -157,7 +434,8 @@ void hashtab_stat(phashtab_t phashtab, const char *name);
 
 #define TREE_CONST_INT(T) ((T)->_const.value.integer)
 #define TREE_CONST_CHAR(T) ((T)->_const.value.character)
-#define TREE_CONST_STRING(T) ((T)->_const.value.string)
+#define TREE_CONST_STRING(T) ((T)->_const.value.string.text)
+#define TREE_CONST_STRLEN(T) ((T)->_const.value.string.length)
 #define TREE_CONST_KIND(T) ((T)->_const.const_kind)
 
 #define TREE_IF_THEN(T) ((T)->stmt.first)
@@ -176,9 +454,18 @@ enum TREE_NODE_KINDS {
 	NODE_KIND_CONST,		// Consts (int, char, string)
 };
 
+// A node records the source offset it starts at; lex_locate() turns
+// it into a line and column when a diagnostic is printed.
+// The kind and the offset share a word, which bounds the source size
+// to TREE_MAX_OFFSET (512 MB); lex_init() rejects larger files.
+// Each node puts its own kind fields right after, so they fill
+// the rest of the 8 bytes before the first pointer.
+#define TREE_OFFSET_BITS 29
+#define TREE_MAX_OFFSET ((1 << TREE_OFFSET_BITS) - 1)
+
 typedef struct _tree_common_t {
-	int node_kind;
-	int lineno;
+	unsigned node_kind : 3;
+	unsigned offset : TREE_OFFSET_BITS;
 } tree_common_t;
 
 typedef union _tree_node_t *tree_t;
@@ -209,14 +496,13 @@ enum EXP_OPS {
 
 typedef struct _tree_exp_t {
 	tree_common_t common;
+	unsigned exp_op : 5;
 	
 	// Available for:
 	//     unary_op first
 	//     first binary_op second
 	tree_t first;
 	tree_t second;
-	
-	unsigned exp_op : 5;
 } tree_exp_t;
 
 enum STMT_KINDS {
@@ -232,6 +518,7 @@ enum STMT_KINDS {
 
 typedef struct _tree_stmt_t {
 	tree_common_t common;
+	unsigned stmt_kind : 4;
 	
 	// expr,
 	// Available for:
@@ -251,8 +538,6 @@ typedef struct _tree_stmt_t {
 	//     while (exp) body,
 	//     for (init; exp; incr) body.
 	tree_t body;
-	
-	unsigned stmt_kind : 4;
 } tree_stmt_t;
 
 enum TYPESPEC_KINDS {
@@ -264,19 +549,22 @@ enum TYPESPEC_KINDS {
 
 typedef struct _tree_typespec_t {
 	tree_common_t common;
+	unsigned typespec_kind : 2;
+	unsigned flag_array : 1;
+	unsigned array_dim : 8;
 	
 	// Available for:
 	//     typename.
 	tree_t id;
-	
-	unsigned typespec_kind : 2;
-	unsigned flag_array : 1;
-	unsigned array_dim : 8;
 } tree_typespec_t;
 
 typedef struct _tree_id_t {
 	tree_common_t common;
-	const char *name;
+	patom_t atom;
+	
+	// The decl the id names, NULL until the checker resolves it.
+	// Ids naming a record field after '.' are left NULL.
+	union _tree_node_t *decl;
 } tree_id_t;
 
 enum CONST_KINDS {
@@ -288,12 +576,16 @@ enum CONST_KINDS {
 
 typedef struct _tree_const_t {
 	tree_common_t common;
+	unsigned const_kind : 2;
 	union _value_t {
 		int integer;
 		char character;
-		const char *string;
+		struct {
+			// Not terminated, may point into the source.
+			const char *text;
+			int length;
+		} string;
 	} value;
-	unsigned const_kind : 2;
 } tree_const_t;
 
 enum LIST_KINDS {
@@ -304,10 +596,13 @@ enum LIST_KINDS {
 	LIST_KIND_EXPR,	// Expr
 };
 
+// The children are in one array, in source order,
+// made when the whole list has been parsed.
 typedef struct _tree_list_t {
 	tree_common_t common;
-	slist_t list;
 	unsigned list_kind : 3;
+	unsigned n_items : 29;
+	tree_t *items;
 } tree_list_t;
 
 enum DECL_KINDS {
@@ -318,8 +613,8 @@ enum DECL_KINDS {
 
 typedef struct _tree_decl_common_t {
 	tree_common_t common;
-	tree_t id;
 	unsigned decl_kind : 2;
+	tree_t id;
 } tree_decl_common_t;
 
 typedef struct _tree_decl_t {
@@ -350,8 +645,14 @@ typedef struct _tree_decl_t {
 	//     function def.
 	tree_t stmts;
 	
+	// the token before the LBRACE of its body,
+	// available for:
+	//     function def, while its body is lazy.
+	int body;
+	
 	unsigned flag_param : 1;
 	unsigned flag_native : 1;
+	unsigned flag_lazy : 1;
 } tree_decl_t;
 
 typedef union _tree_node_t {
@@ -384,13 +685,79 @@ typedef struct _tree_node_visitor_t {
 
 void parser_init();
 void parser_finit();
+void parser_free_tree();
 tree_t parser_file();
+void parser_parse_body(tree_t fun);
+void parser_check_bodies(tree_t tu);
+void parser_print_type(tree_t typespec);
+
+// Set, parser_file() leaves the body of every function def lazy:
+// it is only parsed when its vars or stmts are first asked for.
+extern bool parser_lazy_bodies;
+
+// Set, parser_file() only checks the syntax and returns NULL:
+// the nodes of an item of a list are dropped once it is parsed.
+extern bool parser_syntax_only;
+
+static inline tree_t parser_decl_body(tree_t decl)
+{
+	if (decl->decl.flag_lazy)
+		parser_parse_body(decl);
+	
+	return decl;
+}
 void parser_visit_tree(tree_node_visitor_t *visitor, tree_t tree);
 
+// The visits parser_visit_tree() is yet to make, latest on top.
+// A visit function does not call the visits of the children of its
+// tree, it pushes them, so that deep trees do not take C stack.
+typedef struct _tree_visit_t {
+	tree_node_visit_t visit;
+	tree_t tree;
+	int depth;
+} tree_visit_t;
+
+typedef struct _tree_visits_t {
+	int n_visits;
+	int cap;
+	tree_visit_t *visits;
+} tree_visits_t;
+
+extern tree_visits_t tree_visits;
+
+void parser_visit_grow();
+
+// Visits pushed by one visit are made in the order they are pushed.
+static inline void parser_visit_push(tree_node_visit_t visit, tree_t tree, int depth)
+{
+	if (tree_visits.n_visits == tree_visits.cap)
+		parser_visit_grow();
+	
+	tree_visit_t *item = &tree_visits.visits[tree_visits.n_visits++];
+	item->visit = visit;
+	item->tree = tree;
+	item->depth = depth;
+}
+
 
 
 extern tree_node_visitor_t print_visitor;
 extern tree_node_visitor_t check_visitor;
+void check_unittest();
+
+void print_function_heads(tree_t tu);
+
+
+
+// Scoped names for the checker (symtab.c).
+void symtab_init();
+void symtab_finit();
+void symtab_enter_scope();
+void symtab_leave_scope();
+int symtab_scope_depth();
+tree_t symtab_declare(tree_t decl);
+tree_t symtab_lookup(patom_t atom);
+void symtab_unittest();
 
 
 
@@ -0,0 +1,367 @@
+#include "javac.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#	define LEX_SCAN_X86 1
+#	include <immintrin.h>
+#else
+#	define LEX_SCAN_X86 0
+#endif
+
+// Scanning kernels for the hot states of the lexer.
+// Each kernel starts at 'p', never reads at or beyond 'end',
+// and returns a pointer to the first byte it did not consume.
+// Line breaks are not counted here: positions are source offsets,
+// turned into lines only for diagnostics (see lex_locate()).
+
+static inline bool is_space(int c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static inline bool is_id_char(int c)
+{
+	return (c >= 'a' && c <= 'z') ||
+		(c >= 'A' && c <= 'Z') ||
+		(c >= '0' && c <= '9') ||
+		c == '_';
+}
+
+
+
+// Scalar reference kernels.
+// They define the behaviour the vector kernels must reproduce,
+// and also finish the tails shorter than a vector.
+
+static const char *skip_spaces_scalar(const char *p, const char *end)
+{
+	while (p < end && is_space(*p))
+		p++;
+
+	return p;
+}
+
+static const char *skip_id_scalar(const char *p, const char *end)
+{
+	while (p < end && is_id_char(*p))
+		p++;
+
+	return p;
+}
+
+static const char *find_eol_scalar(const char *p, const char *end)
+{
+	while (p < end && *p != '\n' && *p != '\r')
+		p++;
+
+	return p;
+}
+
+// Returns the pointer past "*/", or NULL if the comment is not closed.
+static const char *skip_block_comment_scalar(const char *p, const char *end)
+{
+	while (p < end) {
+		if (*p == '*' && p + 1 < end && p[1] == '/')
+			return p + 2;
+		p++;
+	}
+
+	return NULL;
+}
+
+const lex_scanner_t lex_scanner_scalar = {
+	"scalar",
+	skip_spaces_scalar,
+	skip_id_scalar,
+	find_eol_scalar,
+	skip_block_comment_scalar
+};
+
+
+
+#if LEX_SCAN_X86
+
+// SSE2 kernels, 16 bytes per step.
+// SSE2 is part of x86-64, but i386 builds need it enabled per function.
+
+#define SSE2 __attribute__((target("sse2")))
+
+static inline SSE2 unsigned sse2_space_mask(__m128i v)
+{
+	__m128i m = _mm_or_si128(
+		_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+			_mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+		_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\r')),
+			_mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))));
+	return _mm_movemask_epi8(m);
+}
+
+static inline SSE2 unsigned sse2_id_mask(__m128i v)
+{
+	// Bytes >= 0x80 are negative and fall out of every range.
+	__m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+	__m128i alpha = _mm_and_si128(
+		_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+		_mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+	__m128i digit = _mm_and_si128(
+		_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+		_mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+	__m128i under = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+	return _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(alpha, digit), under));
+}
+
+static SSE2 const char *skip_spaces_sse2(const char *p, const char *end)
+{
+	while (end - p >= 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)p);
+		unsigned stop = ~sse2_space_mask(v) & 0xFFFF;
+
+		if (stop)
+			return p + __builtin_ctz(stop);
+		p += 16;
+	}
+
+	return skip_spaces_scalar(p, end);
+}
+
+static SSE2 const char *skip_id_sse2(const char *p, const char *end)
+{
+	while (end - p >= 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)p);
+		unsigned stop = ~sse2_id_mask(v) & 0xFFFF;
+
+		if (stop)
+			return p + __builtin_ctz(stop);
+		p += 16;
+	}
+
+	return skip_id_scalar(p, end);
+}
+
+static SSE2 const char *find_eol_sse2(const char *p, const char *end)
+{
+	while (end - p >= 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)p);
+		unsigned stop = _mm_movemask_epi8(_mm_or_si128(
+			_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+			_mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))));
+
+		if (stop)
+			return p + __builtin_ctz(stop);
+		p += 16;
+	}
+
+	return find_eol_scalar(p, end);
+}
+
+static SSE2 const char *skip_block_comment_sse2(const char *p, const char *end)
+{
+	// Compare each byte with '*' and the byte after it with '/',
+	// so one more byte than the vector must be readable.
+	while (end - p >= 17) {
+		__m128i v = _mm_loadu_si128((const __m128i *)p);
+		__m128i w = _mm_loadu_si128((const __m128i *)(p + 1));
+		unsigned stop = _mm_movemask_epi8(_mm_and_si128(
+			_mm_cmpeq_epi8(v, _mm_set1_epi8('*')),
+			_mm_cmpeq_epi8(w, _mm_set1_epi8('/'))));
+
+		if (stop)
+			return p + __builtin_ctz(stop) + 2;
+		p += 16;
+	}
+
+	return skip_block_comment_scalar(p, end);
+}
+
+const lex_scanner_t lex_scanner_sse2 = {
+	"sse2",
+	skip_spaces_sse2,
+	skip_id_sse2,
+	find_eol_sse2,
+	skip_block_comment_sse2
+};
+
+// AVX2 kernels, 32 bytes per step.
+// Compiled for AVX2 regardless of the global flags,
+// and only selected when cpuid reports the extension.
+
+#define AVX2 __attribute__((target("avx2")))
+
+static inline AVX2 uint32_t avx2_space_mask(__m256i v)
+{
+	__m256i m = _mm256_or_si256(
+		_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+			_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))),
+		_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')),
+			_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))));
+	return _mm256_movemask_epi8(m);
+}
+
+static inline AVX2 uint32_t avx2_id_mask(__m256i v)
+{
+	__m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+	__m256i alpha = _mm256_and_si256(
+		_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+		_mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+	__m256i digit = _mm256_and_si256(
+		_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)),
+		_mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+	__m256i under = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+	return _mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(alpha, digit), under));
+}
+
+static AVX2 const char *skip_spaces_avx2(const char *p, const char *end)
+{
+	while (end - p >= 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)p);
+		uint32_t stop = ~avx2_space_mask(v);
+
+		if (stop)
+			return p + __builtin_ctz(stop);
+		p += 32;
+	}
+
+	return skip_spaces_sse2(p, end);
+}
+
+static AVX2 const char *skip_id_avx2(const char *p, const char *end)
+{
+	while (end - p >= 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)p);
+		uint32_t stop = ~avx2_id_mask(v);
+
+		if (stop)
+			return p + __builtin_ctz(stop);
+		p += 32;
+	}
+
+	return skip_id_sse2(p, end);
+}
+
+static AVX2 const char *find_eol_avx2(const char *p, const char *end)
+{
+	while (end - p >= 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)p);
+		uint32_t stop = _mm256_movemask_epi8(_mm256_or_si256(
+			_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')),
+			_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r'))));
+
+		if (stop)
+			return p + __builtin_ctz(stop);
+		p += 32;
+	}
+
+	return find_eol_sse2(p, end);
+}
+
+static AVX2 const char *skip_block_comment_avx2(const char *p, const char *end)
+{
+	while (end - p >= 33) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)p);
+		__m256i w = _mm256_loadu_si256((const __m256i *)(p + 1));
+		uint32_t stop = _mm256_movemask_epi8(_mm256_and_si256(
+			_mm256_cmpeq_epi8(v, _mm256_set1_epi8('*')),
+			_mm256_cmpeq_epi8(w, _mm256_set1_epi8('/'))));
+
+		if (stop)
+			return p + __builtin_ctz(stop) + 2;
+		p += 32;
+	}
+
+	return skip_block_comment_sse2(p, end);
+}
+
+const lex_scanner_t lex_scanner_avx2 = {
+	"avx2",
+	skip_spaces_avx2,
+	skip_id_avx2,
+	find_eol_avx2,
+	skip_block_comment_avx2
+};
+
+#endif // LEX_SCAN_X86
+
+// Pick the widest kernels the running CPU supports.
+const lex_scanner_t *lex_scanner_select()
+{
+#	if LEX_SCAN_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return &lex_scanner_avx2;
+	if (__builtin_cpu_supports("sse2"))
+		return &lex_scanner_sse2;
+#	endif
+
+	return &lex_scanner_scalar;
+}
+
+// All kernel sets built into this binary that the CPU can run,
+// terminated by NULL. The scalar one always comes first.
+int lex_scanner_available(const lex_scanner_t **scanners)
+{
+	int n = 0;
+	scanners[n++] = &lex_scanner_scalar;
+
+#	if LEX_SCAN_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2"))
+		scanners[n++] = &lex_scanner_sse2;
+	if (__builtin_cpu_supports("avx2"))
+		scanners[n++] = &lex_scanner_avx2;
+#	endif
+
+	scanners[n] = NULL;
+	return n;
+}
+
+static inline bool lex_scanner_agrees(const lex_scanner_t *s, const char *p, const char *end)
+{
+	const lex_scanner_t *ref = &lex_scanner_scalar;
+	
+	if (ref->skip_spaces(p, end) != s->skip_spaces(p, end))
+		return false;
+	if (ref->skip_id(p, end) != s->skip_id(p, end))
+		return false;
+	if (ref->find_eol(p, end) != s->find_eol(p, end))
+		return false;
+	if (ref->skip_block_comment(p, end) != s->skip_block_comment(p, end))
+		return false;
+	
+	return true;
+}
+
+// Differential test of every kernel against the scalar reference,
+// on random buffers of every length and start offset up to 80 bytes.
+void lex_scan_unittest()
+{
+#	ifndef NDEBUG
+	static const char alphabet[] = "  \t\n\r\n*/*/ab_Z09{;\x80";
+
+	const lex_scanner_t *scanners[LEX_MAX_SCANNERS + 1];
+	lex_scanner_available(scanners);
+
+	char buf[80];
+	unsigned seed = 12345;
+	int round;
+	for (round = 0; round < 20; ++round) {
+		int i;
+		for (i = 0; i < sizeof(buf); ++i) {
+			seed = seed * 1103515245 + 12345;
+			buf[i] = alphabet[(seed >> 16) % (sizeof(alphabet) - 1)];
+		}
+
+		int len;
+		for (len = 0; len <= sizeof(buf); ++len) {
+			const char *end = buf + len;
+			int start;
+			for (start = 0; start <= len; ++start) {
+				const char *p = buf + start;
+				const lex_scanner_t **s;
+				for (s = scanners + 1; *s; ++s)
+					assert(lex_scanner_agrees(*s, p, end));
+			}
+		}
+	}
+#	endif
+	
+	printf("test lex scanners ok\n");
+}
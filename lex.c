@@ -1,82 +1,853 @@
 #include "javac.h"
 
-FILE *input;
-int lineno = 0;
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-phashtab_t keywords;
+// The whole source is kept in memory and the DFA walks a pointer
+// over it, so no stdio call is made per character.
+// Regular files are mapped, anything else (pipes, ttys) is streamed:
+// srcbuf is then a window starting at offset srcbase of the source
+// (see lex_tokenize_stream()).
+// Large files are lexed by several threads at once (see
+// lex_tokenize_parallel()), so the DFA's own position is per thread.
+static char *srcbuf;
+static size_t srclen;
+static bool srcmapped;
+static bool srcstreamed;
+static size_t srcbase;
+static const char *srcend;
+static __thread const char *srcptr;
 
-token_t currtok;
-token_t latok;
+// Where the last token returned by lex_get_token() starts,
+// lexing errors and warnings are reported there.
+// Tokens are never copied out of the source buffer:
+// identifiers are interned from it, numbers and characters
+// are converted on the fly, and strings are decoded only
+// when their value is asked for (see lex_token_string()).
+static __thread const char *tokstart;
 
-void lex_init(const char *filename)
+// One-byte lookahead over the source buffer,
+// behaves like fgetc()/ungetc() (EOF is never pushed back).
+#define LEX_GETC() (srcptr < srcend ? (unsigned char)*srcptr++ : EOF)
+#define LEX_UNGETC(C) ((C) != EOF ? (void)srcptr-- : (void)0)
+
+__thread int srcpos = -1;
+
+// Offsets of the line breaks in the source, for lex_locate().
+// Lexing never counts lines, the index is built on the first
+// diagnostic that needs one.
+static int *srclines;
+static int n_srclines = -1;
+static int cap_srclines;
+
+// Keywords and operators are recognized with a perfect hash
+// over the fixed keyword set, which needs no initialization:
+//     slot = (len + keyword_asso[first] + keyword_asso[last]) % KEYWORD_SLOTS
+// The association values were found by a search for a collision-free
+// assignment (gperf style). When the keyword set changes, they must be
+// searched again; lex_unittest() checks the table in debug builds.
+#define KEYWORD_SLOTS 64
+#define KEYWORD_MAX_LENGTH 8
+
+static const unsigned char keyword_asso[256] = {
+	['!'] = 49,
+	['%'] = 29,
+	['&'] = 50,
+	['('] = 12,
+	[')'] = 3,
+	['*'] = 13,
+	['+'] = 53,
+	[','] = 8,
+	['-'] = 30,
+	['.'] = 26,
+	['/'] = 20,
+	[';'] = 36,
+	['<'] = 23,
+	['='] = 7,
+	['>'] = 57,
+	['['] = 41,
+	[']'] = 10,
+	['b'] = 23,
+	['c'] = 16,
+	['d'] = 44,
+	['e'] = 30,
+	['f'] = 40,
+	['g'] = 9,
+	['i'] = 50,
+	['k'] = 37,
+	['l'] = 54,
+	['n'] = 61,
+	['r'] = 26,
+	['s'] = 55,
+	['t'] = 47,
+	['w'] = 49,
+	['{'] = 33,
+	['|'] = 53,
+	['}'] = 63,
+};
+
+static const struct _keyword_slot_t {
+	char text[KEYWORD_MAX_LENGTH + 1];
+	unsigned char len;
+	unsigned char keyword;
+} keyword_slots[KEYWORD_SLOTS] = {
+	[0] = { "else", 4, KEYWORD_ELSE },
+	[1] = { "break", 5, KEYWORD_BREAK },
+	[2] = { ">=", 2, KEYWORD_GREATER_EQ },
+	[3] = { "{", 1, KEYWORD_LBRACE },
+	[5] = { "for", 3, KEYWORD_FOR },
+	[6] = { "string", 6, KEYWORD_STRING },
+	[7] = { ")", 1, KEYWORD_RPAREN },
+	[9] = { ";", 1, KEYWORD_SEMICOLON },
+	[12] = { "record", 6, KEYWORD_RECORD },
+	[15] = { "=", 1, KEYWORD_ASSIGN },
+	[16] = { "==", 2, KEYWORD_EQ },
+	[17] = { ",", 1, KEYWORD_COMMA },
+	[19] = { "[", 1, KEYWORD_LBRACKET },
+	[20] = { "while", 5, KEYWORD_WHILE },
+	[21] = { "]", 1, KEYWORD_RBRACKET },
+	[25] = { "(", 1, KEYWORD_LPAREN },
+	[27] = { "*", 1, KEYWORD_MULTIPLY },
+	[28] = { "if", 2, KEYWORD_IF },
+	[29] = { "return", 6, KEYWORD_RETURN },
+	[32] = { "<=", 2, KEYWORD_LESS_EQ },
+	[33] = { "native", 6, KEYWORD_NATIVE },
+	[35] = { "!", 1, KEYWORD_NOT },
+	[36] = { "int", 3, KEYWORD_INT },
+	[38] = { "&&", 2, KEYWORD_AND },
+	[41] = { "/", 1, KEYWORD_DIVIDE },
+	[43] = { "+", 1, KEYWORD_PLUS },
+	[44] = { "||", 2, KEYWORD_OR },
+	[46] = { "char", 4, KEYWORD_CHAR },
+	[47] = { "<", 1, KEYWORD_LESS },
+	[49] = { "new", 3, KEYWORD_NEW },
+	[51] = { ">", 1, KEYWORD_GREATER },
+	[53] = { ".", 1, KEYWORD_DOT },
+	[54] = { "continue", 8, KEYWORD_CONTINUE },
+	[55] = { "null", 4, KEYWORD_NULL },
+	[58] = { "!=", 2, KEYWORD_NEQ },
+	[59] = { "%", 1, KEYWORD_MODULO },
+	[61] = { "-", 1, KEYWORD_MINUS },
+	[63] = { "}", 1, KEYWORD_RBRACE },
+};
+
+static inline int keyword_hash(const char *text, size_t len)
+{
+	return (len + keyword_asso[(unsigned char)text[0]] +
+		keyword_asso[(unsigned char)text[len - 1]]) % KEYWORD_SLOTS;
+}
+
+static const char *keyword_texts[KEYWORD_COUNT] = {
+	"native", "record", "new", "int", "string", "char", "null",
+	"if", "else", "while", "for", "return", "break", "continue",
+	";", "[", "]", "{", "}", "(", ")", ",", "=", "||", "&&",
+	"==", "!=", "<", "<=", ">", ">=", "+", "-", "*", "/", "%", "!", ".",
+};
+
+// Returns the keyword (or operator) spelled text[0..len),
+// or KEYWORD_NONE. Costs one hash and one memcmp of known length.
+int lex_keyword_lookup(const char *text, size_t len)
+{
+	if (len == 0 || len > KEYWORD_MAX_LENGTH)
+		return KEYWORD_NONE;
+	
+	const struct _keyword_slot_t *slot = &keyword_slots[keyword_hash(text, len)];
+	if (slot->len == len && !memcmp(slot->text, text, len))
+		return slot->keyword;
+	
+	return KEYWORD_NONE;
+}
+
+const char *lex_keyword_text(int keyword)
+{
+	assert(keyword >= 0 && keyword < KEYWORD_COUNT);
+	
+	return keyword_texts[keyword];
+}
+
+// Kernels used to skip runs of blanks, identifier characters and comments.
+static const lex_scanner_t *scanner;
+
+lex_tokens_t lextoks;
+__thread lex_state_t lexstate;
+
+static void lex_dfa_build();
+static void lex_tokenize_all();
+static void lex_tokenize_parallel(int n_chunks);
+static void lex_tokenize_stream(int fd, const char *name);
+static void lex_free_tokens();
+static void lex_index_lines(const char *p, const char *end);
+static void lex_free_lines();
+
+// Map the source if it is a regular file, "-" is stdin.
+// Returns the open file to stream it from otherwise, or -1.
+static int lex_load_source(const char *filename)
 {
-	input = fopen(filename, "r");
-	if (!input)
+	int fd = strcmp(filename, "-") ? open(filename, O_RDONLY) : STDIN_FILENO;
+	if (fd < 0)
 		fatal("cannot open file %s", filename);
 	
-	// After opening file, set line number to 1
-	// to enable displaying of line number in 
-	// fatal(), warn(), ...
-	lineno = 1;
-	
-	keywords = hashtab_create(37);
-	
-	hashtab_insert(keywords, "native", NULL, 0);
-	hashtab_insert(keywords, "record", NULL, 0);
-	hashtab_insert(keywords, "new", NULL, 0);
-	hashtab_insert(keywords, "int", NULL, 0);
-	hashtab_insert(keywords, "string", NULL, 0);
-	hashtab_insert(keywords, "char", NULL, 0);
-	hashtab_insert(keywords, "null", NULL, 0);
-	hashtab_insert(keywords, "if", NULL, 0);
-	hashtab_insert(keywords, "else", NULL, 0);
-	hashtab_insert(keywords, "while", NULL, 0);
-	hashtab_insert(keywords, "for", NULL, 0);
-	hashtab_insert(keywords, "return", NULL, 0);
-	hashtab_insert(keywords, "break", NULL, 0);
-	hashtab_insert(keywords, "continue", NULL, 0);
-	hashtab_insert(keywords, ";", NULL, 0);
-	hashtab_insert(keywords, "[", NULL, 0);
-	hashtab_insert(keywords, "]", NULL, 0);
-	hashtab_insert(keywords, "{", NULL, 0);
-	hashtab_insert(keywords, "}", NULL, 0);
-	hashtab_insert(keywords, "(", NULL, 0);
-	hashtab_insert(keywords, ")", NULL, 0);
-	hashtab_insert(keywords, ",", NULL, 0);
-	hashtab_insert(keywords, "=", NULL, 0);
-	hashtab_insert(keywords, "||", NULL, 0);
-	hashtab_insert(keywords, "&&", NULL, 0);
-	hashtab_insert(keywords, "==", NULL, 0);
-	hashtab_insert(keywords, "!=", NULL, 0);
-	hashtab_insert(keywords, "<", NULL, 0);
-	hashtab_insert(keywords, "<=", NULL, 0);
-	hashtab_insert(keywords, ">", NULL, 0);
-	hashtab_insert(keywords, ">=", NULL, 0);
-	hashtab_insert(keywords, "+", NULL, 0);
-	hashtab_insert(keywords, "-", NULL, 0);
-	hashtab_insert(keywords, "*", NULL, 0);
-	hashtab_insert(keywords, "/", NULL, 0);
-	hashtab_insert(keywords, "%", NULL, 0);
-	hashtab_insert(keywords, "!", NULL, 0);
-	hashtab_insert(keywords, ".", NULL, 0);
+	struct stat st;
+	if (fstat(fd, &st) < 0)
+		fatal("cannot stat file %s", filename);
 	
-#	ifndef NDEBUG
-	// To see if elemets are spreading evenly.
-	HASHTAB_STAT(keywords);
-#	endif
+	srcbuf = NULL;
+	if (S_ISREG(st.st_mode) && st.st_size > 0) {
+		void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p != MAP_FAILED) {
+			srcbuf = p;
+			srclen = st.st_size;
+			srcmapped = true;
+			
+			// We only walk forward through the buffer.
+			madvise(p, st.st_size, MADV_SEQUENTIAL);
+		}
+	}
+	
+	if (!srcbuf)
+		return fd;
 	
-	// Mark the current token as valid.
-	currtok.token_flag_valid = 1;
+	if (fd != STDIN_FILENO)
+		close(fd);
+	
+	// Positions must fit into a tree node.
+	if (srclen > TREE_MAX_OFFSET)
+		fatal("file %s is too large (the limit is %d MB)",
+			filename, (TREE_MAX_OFFSET >> 20) + 1);
+	
+	srcptr = srcbuf;
+	srcend = srcbuf + srclen;
+	return -1;
+}
+
+// Below this many bytes per thread, lexing in parallel does not pay.
+#define LEX_MIN_CHUNK (1 << 20)
+
+// The number of threads lexing a large file: $JAVAC_LEX_JOBS, or 1.
+// Lexing in parallel is only done when asked for, it has not been
+// measured to pay yet: the chunks are copied into the token buffer
+// afterwards, serially.
+static int lex_jobs()
+{
+	const char *env = getenv("JAVAC_LEX_JOBS");
+	int jobs = env ? atoi(env) : 1;
+	
+	return jobs > 0 ? jobs : 1;
+}
+
+void lex_init(const char *filename)
+{
+	int fd = lex_load_source(filename);
+	
+	lex_dfa_build();
+	scanner = lex_scanner_select();
+	
+	// After opening file, fatal(), warn(), ...
+	// display the position.
+	srcpos = 0;
+	
+	if (fd >= 0) {
+		lex_tokenize_stream(fd, strcmp(filename, "-") ? filename : "<stdin>");
+		if (fd != STDIN_FILENO)
+			close(fd);
+	} else {
+		int n_chunks = lex_jobs();
+		if (n_chunks > (int)(srclen / LEX_MIN_CHUNK))
+			n_chunks = srclen / LEX_MIN_CHUNK;
+		
+		if (n_chunks > 1)
+			lex_tokenize_parallel(n_chunks);
+		else
+			lex_tokenize_all();
+	}
+	
+	// Before the first lex_next_token(),
+	// only the look-ahead token is valid.
+	lexstate.pos = -1;
+	srcpos = 0;
 }
 
 void lex_finit()
 {
-	fclose(input);
+	if (srcmapped)
+		munmap(srcbuf, srclen);
+	else
+		xfree(srcbuf);
+	srcbuf = NULL;
+	srcmapped = srcstreamed = false;
+	srcbase = 0;
+	
+	lex_free_tokens();
+	lex_free_lines();
+	srcptr = srcend = NULL;
+	// Later diagnostics have no source to point into.
+	srcpos = -1;
+}
+
+// Set while a thread lexes a chunk speculatively:
+// errors and warnings are not reported, but abandon the chunk
+// (it is lexed again, serially, if it turns out to be real source).
+static __thread jmp_buf *lex_abort;
+
+static void lex_fatal(const char *fmt, ...)
+{
+	if (lex_abort)
+		longjmp(*lex_abort, 1);
+	
+	char msg[256];
+	va_list args;
+	va_start(args, fmt);
+	vsnprintf(msg, sizeof(msg), fmt, args);
+	va_end(args);
+	
+	srcpos = tokstart - srcbuf + srcbase;
+	fatal("%s", msg);
+}
+
+static void lex_warn(const char *fmt, ...)
+{
+	if (lex_abort)
+		longjmp(*lex_abort, 1);
+	
+	char msg[256];
+	va_list args;
+	va_start(args, fmt);
+	vsnprintf(msg, sizeof(msg), fmt, args);
+	va_end(args);
+	
+	srcpos = tokstart - srcbuf + srcbase;
+	warn("%s", msg);
+}
+
+// Decode the escape sequence starting at p, just past the backslash.
+// Returns the pointer past the sequence and stores the character
+// in *pc, or -1 if the sequence is malformed (and warned about).
+// A line break or the end of the text is left to the caller.
+static const char *lex_decode_escape(const char *p, const char *end, int *pc)
+{
+	*pc = -1;
+	if (p == end || *p == '\r' || *p == '\n')
+		return p;
+	
+	int c = (unsigned char)*p++;
+	switch (c) {
+	// Handle some escape characters.
+	case 'n':
+		*pc = '\n';
+		break;
+	case 'r':
+		*pc = '\r';
+		break;
+	case 't':
+		*pc = '\t';
+		break;
+	case '\\':
+	case '"':
+	case '\'':
+		*pc = c;
+		break;
+	case '0':
+	case '1':
+	case '2':
+	case '3':
+	case '4':
+	case '5':
+	case '6':
+	case '7':
+	case '8':
+	case '9':
+	{
+		// in-str ascii.
+		int ascii = c - '0';
+		int count;
+		for (count = 1; count < 3; ++count) {
+			if (p == end || (*p < '0' || *p > '9')) {
+				lex_warn("ascii must be consist of three decimal digits");
+				break;
+			}
+			ascii = ascii * 10 + (*p++ - '0');
+		}
+		
+		if (count < 3)
+			break;
+			
+		if (ascii < 256)
+			*pc = ascii;
+		else
+			lex_warn("ascii must be less than 256");
+		break;
+	}
+	default:
+		lex_warn("undefined escape \\%c", c);
+		break;
+	}
+	
+	return p;
+}
+
+// Decode the body of a string literal (between the quotes) into out,
+// which must have room for end - p + 1 characters.
+// Returns the length of the value; out is also terminated.
+static int lex_decode_string(const char *p, const char *end, char *out)
+{
+	int len = 0;
+	while (p < end) {
+		if (*p != '\\') {
+			out[len++] = *p++;
+			continue;
+		}
+		
+		int c;
+		p = lex_decode_escape(p + 1, end, &c);
+		if (c >= 0)
+			out[len++] = c;
+	}
+	out[len] = '\0';
+	
+	return len;
+}
+
+// The identifier or keyword spelled start[0..end).
+static void lex_classify_id(ptoken_t ptoken, const char *start, const char *end)
+{
+	// The spelling is interned straight from the source,
+	// on whichever thread lexes it (see atom.c).
+	patom_t atom = atom_intern(start, end - start);
+	
+	// Maybe a keyword?
+	if (ATOM_IS(atom, ATOM_FLAG_KEYWORD)) {
+		ptoken->token_type = TOKEN_TYPE_KEYWORD;
+		ptoken->token_value.keyword = ATOM_KEYWORD(atom);
+	} else {
+		ptoken->token_value.atom = atom;
+	}
+}
+
+// The lexer is a DFA driven by a transition table.
+//
+// Every byte belongs to one of the classes below, and the transitions
+// are given per (state, class). The DFA takes one step, that is one
+// table lookup, per byte until it reaches an accept code, which ends
+// the lexeme; codes flagged LEX_DFA_UNGET did not take the byte that
+// ended it (the look-ahead). Runs of blanks, identifier characters
+// and comments are left to the scanning kernels (see RUN_BLANK).
+//
+// lex_get_token_switch() is the same DFA written as nested switches;
+// debug builds keep it as the reference the table is tested against.
+enum LEX_CHAR_CLASSES {
+	CC_OTHER,
+	CC_BLANK, // ' ' '\t'
+	CC_CR,
+	CC_LF,
+	CC_DIGIT,
+	CC_ALPHA,
+	CC_UNDERSCORE,
+	CC_QUOTE, // "
+	CC_APOS, // '
+	CC_BACKSLASH,
+	CC_SLASH,
+	CC_STAR,
+	CC_ASSIGN, // =
+	CC_CMP, // < > ! (may be followed by a '=')
+	CC_OP, // operators of a single character
+	CC_AMP,
+	CC_BAR,
+	CC_EOF, // not a byte: the end of the source
+	CC_COUNT,
+};
+
+static const unsigned char lex_char_class[256] = {
+	[' '] = CC_BLANK,
+	['\t'] = CC_BLANK,
+	['\r'] = CC_CR,
+	['\n'] = CC_LF,
+	['0' ... '9'] = CC_DIGIT,
+	['a' ... 'z'] = CC_ALPHA,
+	['A' ... 'Z'] = CC_ALPHA,
+	['_'] = CC_UNDERSCORE,
+	['"'] = CC_QUOTE,
+	['\''] = CC_APOS,
+	['\\'] = CC_BACKSLASH,
+	['/'] = CC_SLASH,
+	['*'] = CC_STAR,
+	['='] = CC_ASSIGN,
+	['<'] = CC_CMP,
+	['>'] = CC_CMP,
+	['!'] = CC_CMP,
+	['.'] = CC_OP,
+	['['] = CC_OP,
+	[']'] = CC_OP,
+	['('] = CC_OP,
+	[')'] = CC_OP,
+	['{'] = CC_OP,
+	['}'] = CC_OP,
+	[';'] = CC_OP,
+	[','] = CC_OP,
+	['+'] = CC_OP,
+	['-'] = CC_OP,
+	['%'] = CC_OP,
+	['&'] = CC_AMP,
+	['|'] = CC_BAR,
+};
+
+enum LEX_DFA_STATES {
+	DS_START,
+	DS_INT, // 12345
+	DS_STR, // "abc"
+	DS_STR_ESCAPE, // just past the backslash in "abc\n"
+	DS_STR_ESCAPED, // "a\tbc" (decoded on demand)
+	DS_STR_ESCAPED_ESCAPE,
+	DS_CHAR, // 'x'
+	DS_CHAR_ESCAPE, // just past the backslash in '\n'
+	DS_SLASH, // 'a / b' OR '//'
+	DS_OP_EQ, // = < > ! and maybe a '='
+	DS_AMP, // &&
+	DS_BAR, // ||
+	DS_COUNT,
+	
+	// Accept codes, the DFA stops on them.
+	// The RUN_ codes hand a run of blanks, identifier characters
+	// or comment over to the scanning kernels.
+	RUN_BLANK = 32,
+	RUN_LINE_COMMENT,
+	RUN_BLOCK_COMMENT,
+	RUN_ID,
+	ACCEPT_EOF,
+	ACCEPT_OP, // of a single character
+	ACCEPT_OP2, // of two characters
+	ACCEPT_INT,
+	ACCEPT_STR,
+	ACCEPT_STR_ESCAPED,
+	ACCEPT_CHAR,
+	ERROR_CHAR,
+	ERROR_OP,
+	ERROR_STR,
+	ERROR_CHAR_CONST,
+};
+
+#define LEX_DFA_UNGET 0x40
+
+// The table is generated from these rules when the lexer starts.
+// A rule for CC_COUNT gives the default of its state
+// and must come before the other rules of that state.
+static const struct _lex_dfa_rule_t {
+	unsigned char state;
+	unsigned char cls;
+	unsigned char next;
+} lex_dfa_rules[] = {
+	{ DS_START, CC_COUNT, ERROR_CHAR },
+	{ DS_START, CC_BLANK, RUN_BLANK },
+	{ DS_START, CC_CR, RUN_BLANK },
+	{ DS_START, CC_LF, RUN_BLANK },
+	{ DS_START, CC_DIGIT, DS_INT },
+	// Unlike C, ID cannot start with an underscore.
+	{ DS_START, CC_ALPHA, RUN_ID },
+	{ DS_START, CC_QUOTE, DS_STR },
+	{ DS_START, CC_APOS, DS_CHAR },
+	{ DS_START, CC_SLASH, DS_SLASH },
+	{ DS_START, CC_STAR, ACCEPT_OP },
+	{ DS_START, CC_OP, ACCEPT_OP },
+	{ DS_START, CC_ASSIGN, DS_OP_EQ },
+	{ DS_START, CC_CMP, DS_OP_EQ },
+	{ DS_START, CC_AMP, DS_AMP },
+	{ DS_START, CC_BAR, DS_BAR },
+	{ DS_START, CC_EOF, ACCEPT_EOF },
+	
+	{ DS_INT, CC_COUNT, ACCEPT_INT | LEX_DFA_UNGET },
+	{ DS_INT, CC_DIGIT, DS_INT },
+	
+	// Only step over an escaped character, so that '\"' does not
+	// end the string. Once an escape is seen, the string goes on in
+	// the DS_STR_ESCAPED states, which tell it must be decoded.
+	{ DS_STR, CC_COUNT, DS_STR },
+	{ DS_STR, CC_QUOTE, ACCEPT_STR },
+	{ DS_STR, CC_BACKSLASH, DS_STR_ESCAPE },
+	{ DS_STR, CC_CR, ERROR_STR },
+	{ DS_STR, CC_LF, ERROR_STR },
+	{ DS_STR, CC_EOF, ERROR_STR },
+	{ DS_STR_ESCAPE, CC_COUNT, DS_STR_ESCAPED },
+	{ DS_STR_ESCAPE, CC_CR, ERROR_STR },
+	{ DS_STR_ESCAPE, CC_LF, ERROR_STR },
+	{ DS_STR_ESCAPE, CC_EOF, ERROR_STR },
+	{ DS_STR_ESCAPED, CC_COUNT, DS_STR_ESCAPED },
+	{ DS_STR_ESCAPED, CC_QUOTE, ACCEPT_STR_ESCAPED },
+	{ DS_STR_ESCAPED, CC_BACKSLASH, DS_STR_ESCAPED_ESCAPE },
+	{ DS_STR_ESCAPED, CC_CR, ERROR_STR },
+	{ DS_STR_ESCAPED, CC_LF, ERROR_STR },
+	{ DS_STR_ESCAPED, CC_EOF, ERROR_STR },
+	{ DS_STR_ESCAPED_ESCAPE, CC_COUNT, DS_STR_ESCAPED },
+	{ DS_STR_ESCAPED_ESCAPE, CC_CR, ERROR_STR },
+	{ DS_STR_ESCAPED_ESCAPE, CC_LF, ERROR_STR },
+	{ DS_STR_ESCAPED_ESCAPE, CC_EOF, ERROR_STR },
+	
+	// Escapes are decoded once the character is accepted.
+	{ DS_CHAR, CC_COUNT, DS_CHAR },
+	{ DS_CHAR, CC_APOS, ACCEPT_CHAR },
+	{ DS_CHAR, CC_BACKSLASH, DS_CHAR_ESCAPE },
+	{ DS_CHAR, CC_CR, ERROR_CHAR_CONST },
+	{ DS_CHAR, CC_LF, ERROR_CHAR_CONST },
+	{ DS_CHAR, CC_EOF, ERROR_CHAR_CONST },
+	{ DS_CHAR_ESCAPE, CC_COUNT, DS_CHAR },
+	{ DS_CHAR_ESCAPE, CC_CR, ERROR_CHAR_CONST },
+	{ DS_CHAR_ESCAPE, CC_LF, ERROR_CHAR_CONST },
+	{ DS_CHAR_ESCAPE, CC_EOF, ERROR_CHAR_CONST },
+	
+	{ DS_SLASH, CC_COUNT, ACCEPT_OP | LEX_DFA_UNGET },
+	{ DS_SLASH, CC_SLASH, RUN_LINE_COMMENT },
+	{ DS_SLASH, CC_STAR, RUN_BLOCK_COMMENT },
+	
+	{ DS_OP_EQ, CC_COUNT, ACCEPT_OP | LEX_DFA_UNGET },
+	{ DS_OP_EQ, CC_ASSIGN, ACCEPT_OP2 },
+	
+	// These operators must be followed by themself.
+	{ DS_AMP, CC_COUNT, ERROR_OP },
+	{ DS_AMP, CC_AMP, ACCEPT_OP2 },
+	{ DS_BAR, CC_COUNT, ERROR_OP },
+	{ DS_BAR, CC_BAR, ACCEPT_OP2 },
+};
+
+// The table is expanded to be indexed by the byte itself (and 256 for
+// the end of the source), which saves looking up the class of every
+// byte in the chain of dependent loads.
+static unsigned char lex_dfa[DS_COUNT][257];
+
+// The column of the byte at p.
+#define LEX_BYTE(P, END) ((P) < (END) ? (unsigned char)*(P) : 256)
+
+// The operators by their first character: alone,
+// and followed by a '=' (or, for '&' and '|', by themself).
+static signed char lex_op1[256];
+static signed char lex_op2[256];
+
+static void lex_dfa_build()
+{
+	unsigned char classes[DS_COUNT][CC_COUNT];
+	
+	const struct _lex_dfa_rule_t *rule;
+	for (rule = lex_dfa_rules; rule != lex_dfa_rules + sizeof(lex_dfa_rules) / sizeof(lex_dfa_rules[0]); ++rule) {
+		if (rule->cls == CC_COUNT)
+			memset(classes[rule->state], rule->next, CC_COUNT);
+		else
+			classes[rule->state][rule->cls] = rule->next;
+	}
+	
+	int state;
+	int c;
+	for (state = 0; state < DS_COUNT; ++state) {
+		// Every state must stop at the end of the source,
+		// so the DFA never looks past it.
+		assert((classes[state][CC_EOF] & ~LEX_DFA_UNGET) >= DS_COUNT);
+		
+		for (c = 0; c < 256; ++c)
+			lex_dfa[state][c] = classes[state][lex_char_class[c]];
+		lex_dfa[state][256] = classes[state][CC_EOF];
+	}
+	
+	for (c = 0; c < 256; ++c) {
+		char text[2] = { c, c == '&' || c == '|' ? c : '=' };
+		lex_op1[c] = lex_keyword_lookup(text, 1);
+		lex_op2[c] = lex_keyword_lookup(text, 2);
+	}
+}
+
+// Decode the body of a char const (between the quotes).
+// Returns the first character, and their number in *pn_chars.
+static int lex_decode_char(const char *p, const char *end, int *pn_chars)
+{
+	int first_char = 0;
+	int n_chars = 0;
+	while (p < end) {
+		int c;
+		if (*p == '\\')
+			p = lex_decode_escape(p + 1, end, &c);
+		else
+			c = (unsigned char)*p++;
+		
+		if (c >= 0 && n_chars++ == 0)
+			first_char = c;
+	}
+	
+	*pn_chars = n_chars;
+	return first_char;
+}
 
-	hashtab_destroy(keywords);
+static void lex_get_token(ptoken_t ptoken)
+{
+	assert(ptoken);
+	
+	const char *p = srcptr;
+	const char *end = srcend;
+	const char *start;
+	int code;
+	
+start_over:
+	start = p;
+	code = lex_dfa[DS_START][LEX_BYTE(p, end)];
+	p++;
+	
+	// One jump on the first step tells a token of a single byte,
+	// a run for the kernels, or a state to walk on from.
+dispatch:
+	tokstart = start;
+	srcptr = p;
+	
+	switch (code) {
+	case DS_INT:
+	case DS_STR:
+	case DS_STR_ESCAPE:
+	case DS_STR_ESCAPED:
+	case DS_STR_ESCAPED_ESCAPE:
+	case DS_CHAR:
+	case DS_CHAR_ESCAPE:
+	case DS_SLASH:
+	case DS_OP_EQ:
+	case DS_AMP:
+	case DS_BAR:
+	{
+		int state = code;
+		do {
+			// Stay in a state for as long as it loops on itself:
+			// the row is fixed then, so the lookups for successive
+			// bytes need not wait for each other.
+			const unsigned char *row = lex_dfa[state];
+			int next;
+			while ((next = row[LEX_BYTE(p, end)]) == state)
+				p++;
+			state = next;
+			p++;
+		} while (state < DS_COUNT);
+		
+		if (state & LEX_DFA_UNGET)
+			p--;
+		code = state & ~LEX_DFA_UNGET;
+		goto dispatch;
+	}
+		
+	case RUN_BLANK:
+		p = scanner->skip_spaces(start, end);
+		goto start_over;
+		
+	case RUN_LINE_COMMENT:
+		// The line break is left to the next lexeme.
+		p = scanner->find_eol(p, end);
+		goto start_over;
+		
+	case RUN_BLOCK_COMMENT:
+		// Skip past the closing '*/'.
+		p = scanner->skip_block_comment(p, end);
+		if (!p)
+			lex_fatal("unexpected end of block comment");
+		goto start_over;
+		
+	case ACCEPT_EOF:
+		srcptr = end;
+		ptoken->token_flag_eof = 1;
+		break;
+		
+	case ACCEPT_OP:
+		ptoken->token_type = TOKEN_TYPE_KEYWORD;
+		ptoken->token_value.keyword = lex_op1[(unsigned char)*start];
+		break;
+		
+	case ACCEPT_OP2:
+		ptoken->token_type = TOKEN_TYPE_KEYWORD;
+		ptoken->token_value.keyword = lex_op2[(unsigned char)*start];
+		break;
+		
+	case ACCEPT_INT:
+	{
+		// We only support positive numbers.
+		ptoken->token_type = TOKEN_TYPE_INT_CONST;
+		
+		int value = 0;
+		bool overflow = false;
+		const char *q;
+		for (q = start; q != p; ++q) {
+			int digit = *q - '0';
+			if (value > (INT32_MAX - digit) / 10)
+				overflow = true;
+			else
+				value = value * 10 + digit;
+		}
+		
+		// Make sure the integer not be negative.
+		if (overflow) {
+			lex_warn("interger exceeds INT32_MAX (truncated)");
+			value = INT32_MAX;
+		}
+		ptoken->token_value.integer = value;
+		break;
+	}
+		
+	case RUN_ID:
+		// An id consists of letters, digits and underscores,
+		// find the end of all of them at once.
+		p = srcptr = scanner->skip_id(p, end);
+		ptoken->token_type = TOKEN_TYPE_IDENTIFIER;
+		lex_classify_id(ptoken, start, p);
+		break;
+		
+	case ACCEPT_STR_ESCAPED:
+		ptoken->token_value.escaped = true;
+		// fall through
+	case ACCEPT_STR:
+		// The value stays in the source buffer.
+		ptoken->token_type = TOKEN_TYPE_STRING_CONST;
+		break;
+		
+	case ACCEPT_CHAR:
+	{
+		ptoken->token_type = TOKEN_TYPE_CHAR_CONST;
+		
+		int n_chars;
+		ptoken->token_value.character = lex_decode_char(start + 1, p - 1, &n_chars);
+		if (n_chars != 1)
+			lex_warn("exactly one character required in a char const");
+		break;
+	}
+		
+	case ERROR_CHAR:
+	{
+		int c = (unsigned char)*start;
+		lex_fatal("unrecognized character %c (ascii = %d)", c, c);
+		break;
+	}
+		
+	case ERROR_OP:
+	{
+		int la = start + 1 < end ? (unsigned char)start[1] : EOF;
+		lex_fatal("undefined operator %c%c", *start, la);
+		break;
+	}
+		
+	case ERROR_STR:
+		lex_fatal("unexpected end of string");
+		break;
+		
+	case ERROR_CHAR_CONST:
+	{
+		// The escapes before the line break are still warned about.
+		int n_chars;
+		lex_decode_char(start + 1, p - 1, &n_chars);
+		lex_fatal("unexpected end of character");
+		break;
+	}
+		
+	default:
+		// unexpected code.
+		assert(false);
+		break;
+	}
 }
 
-// The lexer is just a big DFA.
+#ifndef NDEBUG
+
+// The states of lex_get_token_switch().
 enum DFA_STATES {
 	STATE_START,
 	STATE_END,
@@ -87,44 +858,79 @@ enum DFA_STATES {
 	STATE_PARSE_CHAR, // 'x'
 	STATE_TRY_COMMENT,	//  'a / b' OR '//'
 	STATE_PARSE_ESCAPE_IN_STR, // "hello\n"
-	STATE_PARSE_ESCAPE_IN_CHAR, // '\n'
 	STATE_LINE_COMMENT,		// comment like this
 	STATE_BLOCK_COMMENT,	/* comment like this */
-	STATE_TRY_END_BLOCK_COMMENT // comment like this: /* *?
 };
 
-// Helper function to return a string consisting of one character.
-static const char *char2str(char c)
+// The operator consisting of the single character c.
+static int char2keyword(int c)
 {
-	static char buf[2];
-	buf[0] = c;
-	return buf;
+	switch (c) {
+	case '.': return KEYWORD_DOT;
+	case '[': return KEYWORD_LBRACKET;
+	case ']': return KEYWORD_RBRACKET;
+	case '(': return KEYWORD_LPAREN;
+	case ')': return KEYWORD_RPAREN;
+	case '{': return KEYWORD_LBRACE;
+	case '}': return KEYWORD_RBRACE;
+	case ';': return KEYWORD_SEMICOLON;
+	case ',': return KEYWORD_COMMA;
+	case '+': return KEYWORD_PLUS;
+	case '-': return KEYWORD_MINUS;
+	case '*': return KEYWORD_MULTIPLY;
+	case '/': return KEYWORD_DIVIDE;
+	case '%': return KEYWORD_MODULO;
+	case '=': return KEYWORD_ASSIGN;
+	case '<': return KEYWORD_LESS;
+	case '>': return KEYWORD_GREATER;
+	case '!': return KEYWORD_NOT;
+	}
+	
+	assert(false);
+	return KEYWORD_NONE;
 }
 
-#define MAX_TOKEN_LENGTH 100
+// The operator consisting of c followed by a '='.
+static int char2keyword_eq(int c)
+{
+	switch (c) {
+	case '=': return KEYWORD_EQ;
+	case '<': return KEYWORD_LESS_EQ;
+	case '>': return KEYWORD_GREATER_EQ;
+	case '!': return KEYWORD_NEQ;
+	}
+	
+	assert(false);
+	return KEYWORD_NONE;
+}
 
-static void lex_get_token(ptoken_t ptoken)
+static void lex_get_token_switch(ptoken_t ptoken)
 {
 	assert(ptoken);
 	
-	char buf[MAX_TOKEN_LENGTH];
-	int buflen = 0;
+	// Char consts: the number of characters and the first one.
+	int n_chars = 0;
+	int first_char = 0;
+	// Int consts: the value does not fit in 32 bits.
+	bool overflow = false;
 	
 	int state = STATE_START;
 	while (state != STATE_END) {
-		int c = fgetc(input);
+		if (state == STATE_START)
+			tokstart = srcptr;
+		
+		int c = LEX_GETC();
 		switch (state) {
 		case STATE_START:
 			switch (c) {
 			case ' ':
 			case '\t':
 			case '\r':
-				// Ignore these characters,
-				// and remain current state.
-				break;
 			case '\n':
-				// Handle both '\n' and '\r\n'
-				lineno++;
+				// Ignore the whole run of these characters
+				// and remain current state.
+				LEX_UNGETC(c);
+				srcptr = scanner->skip_spaces(srcptr, srcend);
 				break;
 			case '"':
 				// Entering a string.
@@ -152,39 +958,41 @@ static void lex_get_token(ptoken_t ptoken)
 			case '+':
 			case '-':
 			case '*':
+			case '%':
 				// these operators consist of a single character.
 				ptoken->token_type = TOKEN_TYPE_KEYWORD;
-				ptoken->token_value.text = xstrdup(char2str(c));
+				ptoken->token_value.keyword = char2keyword(c);
 				state = STATE_END;
 				break;
 			case '=':
 			case '<':
 			case '>':
 			case '!':
+			{
 				// these operators can be followed by a '='.
 				ptoken->token_type = TOKEN_TYPE_KEYWORD;
-				buf[buflen++] = c;
-				c = fgetc(input);
-				if (c == '=')
-					buf[buflen++] = c;
-				else
-					ungetc(c, input);
-				buf[buflen] = 0;
-				ptoken->token_value.text = xstrdup(buf);
+				int la = LEX_GETC();
+				if (la == '=') {
+					ptoken->token_value.keyword = char2keyword_eq(c);
+				} else {
+					LEX_UNGETC(la);
+					ptoken->token_value.keyword = char2keyword(c);
+				}
 				state = STATE_END;
 				break;
+			}
 			case '&':
 			case '|':
+			{
 				// these operators must be followed by themself.
 				ptoken->token_type = TOKEN_TYPE_KEYWORD;
-				buf[0] = buf[1] = c;
-				int la = fgetc(input);
+				int la = LEX_GETC();
 				if (c != la)
-					fatal("undefined operator %c%c", c, la);
-				buf[2] = '\0';
-				ptoken->token_value.text = xstrdup(buf);
+					lex_fatal("undefined operator %c%c", c, la);
+				ptoken->token_value.keyword = (c == '&' ? KEYWORD_AND : KEYWORD_OR);
 				state = STATE_END;
 				break;
+			}
 			case EOF:
 				ptoken->token_flag_eof = 1;
 				state = STATE_END;
@@ -194,16 +1002,15 @@ static void lex_get_token(ptoken_t ptoken)
 					// Entering an integer.
 					state = STATE_PARSE_INT;
 					ptoken->token_type = TOKEN_TYPE_INT_CONST;
-					buf[buflen++] = c;
+					ptoken->token_value.integer = c - '0';
 				} else if (isalpha(c)) {
 					// Entering an ID or keyword.
 					// Unlike C, ID cannot start with an underscore.
 					state = STATE_PARSE_ID;
 					ptoken->token_type = TOKEN_TYPE_IDENTIFIER;
-					buf[buflen++] = c;
 				} else {
 					// Oops.
-					fatal("unrecognized character %c (ascii = %d)", c, c);
+					lex_fatal("unrecognized character %c (ascii = %d)", c, c);
 					state = STATE_END;
 				}
 				break;
@@ -213,164 +1020,104 @@ static void lex_get_token(ptoken_t ptoken)
 		case STATE_PARSE_INT:
 			// We only support positive numbers.
 			if (isdigit(c)) {
-				buf[buflen++] = c;
+				int digit = c - '0';
+				if (ptoken->token_value.integer > (INT32_MAX - digit) / 10)
+					overflow = true;
+				else
+					ptoken->token_value.integer = ptoken->token_value.integer * 10 + digit;
 			} else {
-				buf[buflen] = '\0';
-				
-				ptoken->token_value.integer = atoi(buf);
-				
 				// Make sure the integer not be negative.
-				if (ptoken->token_value.integer < 0) {
-					warn("interger exceeds INT32_MAX (truncated)");
+				if (overflow) {
+					lex_warn("interger exceeds INT32_MAX (truncated)");
 					ptoken->token_value.integer = INT32_MAX;
 				}
 				
 				state = STATE_END;
-				ungetc(c, input);
+				LEX_UNGETC(c);
 			}
 			break;
 			
 		case STATE_PARSE_ID:
-			if (isalnum(c) || c == '_') {
-				// An id consists of letters, digits and underscores.
-				buf[buflen++] = c;
-			} else {
-				buf[buflen] = '\0';
-				
-				// Maybe a keyword?
-				if (hashtab_lookup(keywords, buf, NULL, 0))
-					ptoken->token_type = TOKEN_TYPE_KEYWORD;
-				ptoken->token_value.text = xstrdup(buf);
-				
-				state = STATE_END;
-				ungetc(c, input);
-			}
+		{
+			// An id consists of letters, digits and underscores,
+			// find the end of all of them at once.
+			LEX_UNGETC(c);
+			srcptr = scanner->skip_id(srcptr, srcend);
+			
+			lex_classify_id(ptoken, tokstart, srcptr);
+			state = STATE_END;
 			break;
+		}
 			
 		case STATE_PARSE_STR:
 			switch (c) {
 			case '"':
-				buf[buflen] = '\0';
-				ptoken->token_value.text = xstrdup(buf);
+				// The value stays in the source buffer.
 				state = STATE_END;
 				break;
 				
 			case '\\':
 				// Meets an escape.
+				ptoken->token_value.escaped = true;
 				state = STATE_PARSE_ESCAPE_IN_STR;
 				break;
 				
 			case '\r':
 			case '\n':
 			case EOF:
-				fatal("unexpected end of string");
+				lex_fatal("unexpected end of string");
 				break;
 			
 			default:
-				buf[buflen++] = c;
+				break;
 			}
 			break;
 			
-		case STATE_PARSE_CHAR:
+		case STATE_PARSE_ESCAPE_IN_STR:
+			// Only step over the escaped character, so that
+			// '\"' does not end the string. The digits of an
+			// ascii escape are plain characters to the DFA.
 			switch (c) {
 			case '\r':
 			case '\n':
 			case EOF:
-				fatal("unexpected end of character");
-				break;
-			case '\\':
-				// Meets an escape.
-				state = STATE_PARSE_ESCAPE_IN_CHAR;
-				break;
-			case '\'':
-				state = STATE_END;
-				if (buflen != 1)
-					warn("exactly one character required in a char const");
-				ptoken->token_value.character = buf[0];
+				lex_fatal("unexpected end of string");
 				break;
 			default:
-				buf[buflen++] = c;
+				state = STATE_PARSE_STR;
 				break;
 			}
 			break;
 			
-		// actually we are combining the processes
-		// of the two states together here,
-		// which saves much duplicate codes
-		// but not violates the rules of a DFA.
-		case STATE_PARSE_ESCAPE_IN_STR:
-		case STATE_PARSE_ESCAPE_IN_CHAR:
+		case STATE_PARSE_CHAR:
 			switch (c) {
-			// Handle some escape characters.
-			case 'n':
-				buf[buflen++] = '\n';
-				break;
-			case 'r':
-				buf[buflen++] = '\r';
-				break;
-			case 't':
-				buf[buflen++] = '\t';
+			case '\r':
+			case '\n':
+			case EOF:
+				lex_fatal("unexpected end of character");
 				break;
 			case '\\':
-			case '"':
-			case '\'':
-				buf[buflen++] = c;
-				break;
-			case '0':
-			case '1':
-			case '2':
-			case '3':
-			case '4':
-			case '5':
-			case '6':
-			case '7':
-			case '8':
-			case '9':
 			{
-				// in-str ascii.
-				int ascii = c - '0';
-				int count;
-				for (count = 1; count < 3; ++count) {
-					c = fgetc(input);
-					if (isdigit(c)) {
-						ascii = ascii * 10 + (c - '0');
-					} else {
-						ungetc(c, input);
-						warn("ascii must be consist of three decimal digits");
-						break;
-					}
-				}
-				
-				if (count < 3)
-					break;
-					
-				if (ascii < 256)
-					buf[buflen++] = ascii;
-				else
-					warn("ascii must be less than 256");
-				break;
-			}
-			default:
-				warn("undefined escape \\%c", c);
+				// Meets an escape, decode it right away.
+				int decoded;
+				srcptr = lex_decode_escape(srcptr, srcend, &decoded);
+				if (decoded >= 0 && n_chars++ == 0)
+					first_char = decoded;
 				break;
 			}
-			
-			// return to the correct previous state
-			// according to the current state.
-			switch (state) {
-			case STATE_PARSE_ESCAPE_IN_STR:
-				state = STATE_PARSE_STR;
-				break;
-			case STATE_PARSE_ESCAPE_IN_CHAR:
-				state = STATE_PARSE_CHAR;
+			case '\'':
+				state = STATE_END;
+				if (n_chars != 1)
+					lex_warn("exactly one character required in a char const");
+				ptoken->token_value.character = first_char;
 				break;
 			default:
-				// how did you get in?
-				assert(false);
+				if (n_chars++ == 0)
+					first_char = c;
 				break;
 			}
 			break;
-		
+			
 		case STATE_TRY_COMMENT:
 			// are we going to enter a comment?
 			switch (c) {
@@ -384,73 +1131,34 @@ static void lex_get_token(ptoken_t ptoken)
 				break;
 			default:
 				// no! it's just a divide operator.
-				ungetc(c, input);
+				LEX_UNGETC(c);
 				ptoken->token_type = TOKEN_TYPE_KEYWORD;
-				ptoken->token_value.text = xstrdup(char2str('/'));
+				ptoken->token_value.keyword = KEYWORD_DIVIDE;
 				state = STATE_END;
 				break;
 			}
 			break;
 			
 		case STATE_LINE_COMMENT:
-			switch (c) {
-			case '\r':
-				state = STATE_START;
-				break;
-			case '\n':
-				// for the line number to be correct:
-				// if we do not put back '\n', 
-				// then line number would not be incremented.
-				ungetc(c, input);
-				state = STATE_START;
-				break;
-			case EOF:
-				ptoken->token_flag_eof = 1;
-				state = STATE_END;
-				break;
-			}
+			// Skip to the line break (or the end of file),
+			// but leave it to STATE_START, so that
+			// the line number would be incremented.
+			LEX_UNGETC(c);
+			srcptr = scanner->find_eol(srcptr, srcend);
+			state = STATE_START;
 			break;
 			
 		case STATE_BLOCK_COMMENT:
-			switch (c) {
-			case '*':
-				// maybe the block comment is ending.
-				state = STATE_TRY_END_BLOCK_COMMENT;
-				break;
-			case '\n':
-				// handle line number increment in the comment.
-				lineno++;
-				break;
-			case EOF:
-				fatal("unexpected end of block comment");
-				break;
-			}
-			break;
-			
-		case STATE_TRY_END_BLOCK_COMMENT:
-			// are we going to end a block comment?
-			switch (c) {
-			case '/':
-				// yes.
-				state = STATE_START;
-				break;
-			case '\n':
-				/*
-				 * handle conditions like this comment.
-				 *
-				 */
-				lineno++;
-				state = STATE_BLOCK_COMMENT;
-				break;
-			case EOF:
-				fatal("unexpected end of block comment");
-				break;
-			default:
-				// no! return to state STATE_BLOCK_COMMENT.
-				state = STATE_BLOCK_COMMENT;
-				break;
-			}
+		{
+			// Skip past the closing '*/'.
+			LEX_UNGETC(c);
+			const char *p = scanner->skip_block_comment(srcptr, srcend);
+			if (!p)
+				lex_fatal("unexpected end of block comment");
+			srcptr = p;
+			state = STATE_START;
 			break;
+		}
 			
 		default:
 			// unexpected state.
@@ -460,77 +1168,1182 @@ static void lex_get_token(ptoken_t ptoken)
 	}
 }
 
-void lex_next_token()
+#endif // NDEBUG
+
+// Append the token spelled start[0..length) to the token buffer.
+static void lex_append_token(const token_t *ptoken, const char *start, int length)
 {
-	// 'text' allocated for the previous token is no longer useful.
-	if (currtok.token_type == TOKEN_TYPE_KEYWORD ||
-		currtok.token_type == TOKEN_TYPE_IDENTIFIER ||
-		currtok.token_type == TOKEN_TYPE_STRING_CONST)
-			xfree(currtok.token_value.text);
-	
-	if (latok.token_flag_valid) {
-		// lex_peek_token() is called.
-		// Prefetched an token for us,
-		// so first use that.
-		currtok = latok;
-		latok.token_flag_valid = 0;
-	} else {
-		// Fetch a token from the file stream.
-		lex_get_token(&currtok);
+	// A streamed source does not stay in memory,
+	// the value of a string is kept from the start.
+	// Decoding may warn, so it comes first (see lex_stream_range()).
+	const char *text = NULL;
+	int text_length = 0;
+	if (srcstreamed && !ptoken->token_flag_eof && ptoken->token_type == TOKEN_TYPE_STRING_CONST) {
+		char *out = arena_alloc(&lextoks.string_arena, length - 1);
+		text_length = lex_decode_string(start + 1, start + length - 1, out);
+		text = out;
+	}
+	
+	if (lextoks.n_toks == lextoks.cap) {
+		// Doubling; the first guess is about one token per 4 bytes of source.
+		lextoks.cap = lextoks.cap ? lextoks.cap * 2 : (int)(srclen / 4) + 64;
+		lextoks.types = xrealloc(lextoks.types, lextoks.cap * sizeof(lextoks.types[0]));
+		lextoks.offsets = xrealloc(lextoks.offsets, lextoks.cap * sizeof(lextoks.offsets[0]));
+		lextoks.lengths = xrealloc(lextoks.lengths, lextoks.cap * sizeof(lextoks.lengths[0]));
+		lextoks.payloads = xrealloc(lextoks.payloads, lextoks.cap * sizeof(lextoks.payloads[0]));
+	}
+	
+	int i = lextoks.n_toks++;
+	lextoks.types[i] = ptoken->token_flag_eof ? TOKEN_TYPE_EOF : ptoken->token_type;
+	lextoks.offsets[i] = start - srcbuf + srcbase;
+	lextoks.lengths[i] = length;
+	
+	if (ptoken->token_flag_eof) {
+		lextoks.payloads[i] = 0;
+		return;
+	}
+	
+	switch (ptoken->token_type) {
+	case TOKEN_TYPE_KEYWORD:
+		lextoks.payloads[i] = ptoken->token_value.keyword;
+		break;
+	case TOKEN_TYPE_IDENTIFIER:
+		lextoks.payloads[i] = ATOM_ID(ptoken->token_value.atom);
+		break;
+	case TOKEN_TYPE_INT_CONST:
+		lextoks.payloads[i] = ptoken->token_value.integer;
+		break;
+	case TOKEN_TYPE_CHAR_CONST:
+		lextoks.payloads[i] = ptoken->token_value.character;
+		break;
+	case TOKEN_TYPE_STRING_CONST:
+		if (!ptoken->token_value.escaped && !text) {
+			lextoks.payloads[i] = -1;
+			break;
+		}
+		
+		if (lextoks.n_strings == lextoks.cap_strings) {
+			lextoks.cap_strings = lextoks.cap_strings ? lextoks.cap_strings * 2 : 64;
+			lextoks.strings = xrealloc(lextoks.strings, lextoks.cap_strings * sizeof(lex_string_t));
+		}
+		lextoks.payloads[i] = lextoks.n_strings;
+		lextoks.strings[lextoks.n_strings].text = text;
+		lextoks.strings[lextoks.n_strings].length = text_length;
+		lextoks.n_strings++;
+		break;
 	}
+}
 
-	assert(currtok.token_flag_valid);
+// The second EOF token ending the buffer.
+static void lex_append_eof()
+{
+	token_t eof;
+	memset(&eof, 0, sizeof(eof));
+	eof.token_flag_eof = 1;
+	
+	lex_append_token(&eof, srcend, 0);
 }
 
-void lex_peek_token()
+// Lex, from p (between two tokens), every token
+// starting before offset limit into the token buffer.
+// Returns true at the end of file; otherwise p is
+// moved to the first token starting at or after limit.
+static bool lex_tokenize_range(const char **pp, size_t limit)
 {
-	// If we have called lex_peek_token() twice or more
-	// before calling lex_next_token().
-	// It should not prefetch more than one token.
-	if (latok.token_flag_valid == 0) {
-		lex_get_token(&latok);
-		latok.token_flag_valid = 1;
+	srcptr = *pp;
+	
+	token_t tok;
+	while (true) {
+		memset(&tok, 0, sizeof(tok));
+		lex_get_token(&tok);
+		
+		if (tokstart - srcbuf >= limit) {
+			*pp = tokstart;
+			return false;
+		}
+		
+		lex_append_token(&tok, tokstart, srcptr - tokstart);
+		if (tok.token_flag_eof)
+			return true;
 	}
+}
+
+// Lex the whole source into the token buffer.
+// Two EOF tokens end it, so the look-ahead of
+// the last (EOF) token is still a valid token.
+static void lex_tokenize_all()
+{
+	memset(&lextoks, 0, sizeof(lextoks));
 	
-	assert(latok.token_flag_valid);
+	const char *p = srcbuf;
+	lex_tokenize_range(&p, srclen + 1);
+	
+	lex_append_eof();
 }
 
-void lex_print_all_tokens()
+// Parallel lexing.
+//
+// The source is cut into chunks at line breaks, and each chunk is
+// lexed by a thread of its own, assuming that it starts between two
+// tokens. That is wrong when the cut falls into a block comment
+// (strings do not span lines), but every token starts the DFA afresh,
+// so a chunk's tokens are right from the first one starting exactly
+// where the previous chunk really ended. The chunks are then checked
+// and stitched in order; whatever cannot be trusted (no token starts
+// at the right place, or the thread met an error) is lexed again,
+// serially, where errors are reported as usual.
+// Chunk threads intern identifiers as they go, the atom table takes
+// any number of threads; a chunk started in a comment may leave a few
+// atoms no token names, which costs nothing but their memory.
+typedef struct _lex_chunk_token_t {
+	token_t tok;
+	int offset;
+	int length;
+} lex_chunk_token_t;
+
+typedef struct _lex_chunk_t {
+	const char *begin;
+	size_t limit;	// Tokens starting at or after this offset are not ours.
+	
+	lex_chunk_token_t *toks;
+	int n_toks;
+	int cap;
+	
+	// The first token starting at or after limit,
+	// unless the end of file is met first.
+	bool eof;
+	const char *next;
+	
+	// An error or warning stopped the chunk early.
+	bool aborted;
+} lex_chunk_t, *plex_chunk_t;
+
+static void *lex_chunk_worker(void *arg)
 {
+	plex_chunk_t chunk = arg;
+	
+	jmp_buf env;
+	lex_abort = &env;
+	
+	srcptr = chunk->begin;
+	
+	if (setjmp(env)) {
+		chunk->aborted = true;
+		return NULL;
+	}
+	
 	while (true) {
-		lex_next_token();
+		token_t tok;
+		memset(&tok, 0, sizeof(tok));
+		lex_get_token(&tok);
 		
-		if (currtok.token_flag_eof) {
-			printf(">>>>> eof <<<<<\n");
+		if (tokstart - srcbuf >= chunk->limit) {
+			chunk->next = tokstart;
 			break;
 		}
-			
-		if (!currtok.token_flag_valid) {
-			printf("invalid token\n");
+		
+		if (chunk->n_toks == chunk->cap) {
+			chunk->cap = chunk->cap ? chunk->cap * 2 : (int)(chunk->limit - (chunk->begin - srcbuf)) / 4 + 64;
+			chunk->toks = xrealloc(chunk->toks, chunk->cap * sizeof(lex_chunk_token_t));
+		}
+		lex_chunk_token_t *ct = &chunk->toks[chunk->n_toks++];
+		ct->tok = tok;
+		ct->offset = tokstart - srcbuf;
+		ct->length = srcptr - tokstart;
+		
+		if (tok.token_flag_eof) {
+			chunk->eof = true;
 			break;
 		}
+	}
+	
+	return NULL;
+}
+
+static void lex_tokenize_parallel(int n_chunks)
+{
+	assert(n_chunks > 1);
+	
+	plex_chunk_t chunks = xmalloc(n_chunks * sizeof(lex_chunk_t));
+	memset(chunks, 0, n_chunks * sizeof(lex_chunk_t));
+	
+	// Cut right after a line break near each n-th of the source.
+	int i;
+	chunks[0].begin = srcbuf;
+	for (i = 1; i < n_chunks; ++i) {
+		const char *cut = srcbuf + srclen / n_chunks * i;
+		if (cut < chunks[i - 1].begin)
+			cut = chunks[i - 1].begin;
+		const char *nl = memchr(cut, '\n', srcend - cut);
+		chunks[i].begin = nl ? nl + 1 : srcend;
+		chunks[i - 1].limit = chunks[i].begin - srcbuf;
+	}
+	chunks[n_chunks - 1].limit = srclen + 1;
+	
+	// Every thread interns identifiers, until all are joined.
+	atom_share(true);
+	pthread_t *threads = xmalloc(n_chunks * sizeof(pthread_t));
+	for (i = 1; i < n_chunks; ++i) {
+		if (pthread_create(&threads[i], NULL, lex_chunk_worker, &chunks[i]))
+			fatal("cannot create lexer thread");
+	}
+	
+	// The first chunk does start between tokens,
+	// lex it on this thread meanwhile.
+	memset(&lextoks, 0, sizeof(lextoks));
+	const char *p = srcbuf;
+	bool eof = lex_tokenize_range(&p, chunks[0].limit);
+	
+	for (i = 1; i < n_chunks; ++i)
+		pthread_join(threads[i], NULL);
+	atom_share(false);
+	
+	// Stitch. p is where the next token really starts.
+	for (i = 1; i < n_chunks && !eof; ++i) {
+		plex_chunk_t chunk = &chunks[i];
+		if (p - srcbuf >= chunk->limit)
+			continue; // Swallowed by a long comment.
+		
+		// Find the chunk's token starting at p.
+		int k = 0;
+		while (k < chunk->n_toks && chunk->toks[k].offset < p - srcbuf)
+			k++;
+		
+		if (k < chunk->n_toks && chunk->toks[k].offset == p - srcbuf) {
+			// In step from here on.
+			for (; k < chunk->n_toks; ++k) {
+				lex_chunk_token_t *ct = &chunk->toks[k];
+				lex_append_token(&ct->tok, srcbuf + ct->offset, ct->length);
+				p = srcbuf + ct->offset + ct->length;
+			}
+			
+			if (chunk->eof)
+				break;
+			
+			if (!chunk->aborted) {
+				p = chunk->next;
+				continue;
+			}
 			
-		switch (currtok.token_type) {
+			// The last token taken ends between two tokens,
+			// go on serially from there.
+		}
+		
+		eof = lex_tokenize_range(&p, chunk->limit);
+	}
+	
+	for (i = 0; i < n_chunks; ++i)
+		xfree(chunks[i].toks);
+	xfree(threads);
+	xfree(chunks);
+	
+	lex_append_eof();
+}
+
+// Streaming.
+//
+// A source that cannot be mapped is read through two fixed blocks:
+// a reader thread fills one with large read() calls while the lexer
+// empties the other into its window. The window is only lexed up to
+// its last line break; no token but a block comment spans lines, so
+// none is cut in two, and a block comment running past the cut is
+// skipped as more of the source comes in. Consumed bytes are dropped,
+// so memory stays at two blocks plus the window (about two blocks,
+// or the longest line), however long the source is. Nothing keeps
+// pointing into the window: identifiers are interned, and strings
+// are copied out as they are appended to the token buffer.
+#define LEX_STREAM_BLOCK (1 << 18)
+
+// Smaller in lex_unittest(), to put many tokens across blocks.
+static size_t lex_stream_block = LEX_STREAM_BLOCK;
+
+typedef struct _lex_stream_t {
+	int fd;
+	const char *name;
+	size_t cap;	// Of the window, srcbuf.
+	
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	char *blocks[2];
+	size_t lengths[2];
+	bool full[2];	// Filled, and not taken by the lexer yet.
+	bool last[2];	// Ends the source.
+	int errors[2];	// errno of a failed read(), or 0.
+} lex_stream_t, *plex_stream_t;
+
+static void *lex_stream_reader(void *arg)
+{
+	plex_stream_t stream = arg;
+	
+	int i;
+	for (i = 0; ; i ^= 1) {
+		pthread_mutex_lock(&stream->lock);
+		while (stream->full[i])
+			pthread_cond_wait(&stream->cond, &stream->lock);
+		pthread_mutex_unlock(&stream->lock);
+		
+		// A pipe returns what it has, keep on until the block is full.
+		size_t n = 0;
+		bool last = false;
+		int error = 0;
+		while (n < lex_stream_block) {
+			ssize_t r = read(stream->fd, stream->blocks[i] + n, lex_stream_block - n);
+			if (r < 0 && errno == EINTR)
+				continue;
+			if (r <= 0) {
+				error = r < 0 ? errno : 0;
+				last = true;
+				break;
+			}
+			n += r;
+		}
+		
+		pthread_mutex_lock(&stream->lock);
+		stream->lengths[i] = n;
+		stream->last[i] = last;
+		stream->errors[i] = error;
+		stream->full[i] = true;
+		pthread_cond_signal(&stream->cond);
+		pthread_mutex_unlock(&stream->lock);
+		
+		if (last)
+			return NULL;
+	}
+}
+
+// Append block i to the window, and give it back to the reader.
+// Returns false if it was the last one.
+static bool lex_stream_take(plex_stream_t stream, int i)
+{
+	// What the reader wrote of the block is read under the lock,
+	// the reader goes on with the other block meanwhile.
+	pthread_mutex_lock(&stream->lock);
+	while (!stream->full[i])
+		pthread_cond_wait(&stream->cond, &stream->lock);
+	size_t n = stream->lengths[i];
+	bool last = stream->last[i];
+	int error = stream->errors[i];
+	pthread_mutex_unlock(&stream->lock);
+	
+	size_t used = srcend - srcbuf;
+	if (used + n > stream->cap) {
+		// A line longer than the window.
+		while (used + n > stream->cap)
+			stream->cap *= 2;
+		srcbuf = xrealloc(srcbuf, stream->cap);
+		srcend = srcbuf + used;
+	}
+	
+	char *p = srcbuf + used;
+	memcpy(p, stream->blocks[i], n);
+	srcend = p + n;
+	srclen += n;
+	lex_index_lines(p, srcend);
+	
+	pthread_mutex_lock(&stream->lock);
+	stream->full[i] = false;
+	pthread_cond_signal(&stream->cond);
+	pthread_mutex_unlock(&stream->lock);
+	
+	if (error || srclen > TREE_MAX_OFFSET) {
+		// Not about a position in the source.
+		srcpos = -1;
+		if (error)
+			fatal("cannot read file %s", stream->name);
+		fatal("file %s is too large (the limit is %d MB)",
+			stream->name, (TREE_MAX_OFFSET >> 20) + 1);
+	}
+	
+	return !last;
+}
+
+// Lex the window from *pp as lex_tokenize_range() does.
+// An error or a warning stops it at the token causing it, which is
+// then lexed again to report it, unless it is a block comment that
+// may go on past the cut: *pp is left on it, and *pcomment set.
+static bool lex_stream_range(const char **pp, size_t limit, bool *pcomment)
+{
+	jmp_buf env;
+	while (true) {
+		lex_abort = &env;
+		if (!setjmp(env)) {
+			bool eof = lex_tokenize_range(pp, limit);
+			lex_abort = NULL;
+			return eof;
+		}
+		lex_abort = NULL;
+		
+		if (limit <= srcend - srcbuf && tokstart[0] == '/' && tokstart[1] == '*') {
+			*pp = tokstart;
+			*pcomment = true;
+			return false;
+		}
+		
+		srcptr = tokstart;
+		token_t tok;
+		memset(&tok, 0, sizeof(tok));
+		lex_get_token(&tok);
+		lex_append_token(&tok, tokstart, srcptr - tokstart);
+		*pp = srcptr;
+	}
+}
+
+static void lex_tokenize_stream(int fd, const char *name)
+{
+	lex_stream_t stream;
+	memset(&stream, 0, sizeof(stream));
+	stream.fd = fd;
+	stream.name = name;
+	stream.cap = 2 * lex_stream_block;
+	stream.blocks[0] = xmalloc(lex_stream_block);
+	stream.blocks[1] = xmalloc(lex_stream_block);
+	pthread_mutex_init(&stream.lock, NULL);
+	pthread_cond_init(&stream.cond, NULL);
+	
+	srcbuf = xmalloc(stream.cap);
+	srcend = srcbuf;
+	srclen = srcbase = 0;
+	srcmapped = false;
+	srcstreamed = true;
+	n_srclines = 0;
+	memset(&lextoks, 0, sizeof(lextoks));
+	
+	pthread_t reader;
+	if (pthread_create(&reader, NULL, lex_stream_reader, &stream))
+		fatal("cannot create reader thread");
+	
+	const char *p = srcbuf;	// The next byte to lex.
+	int comment = -1;		// Offset of a block comment being skipped.
+	bool more = true;
+	int i = 0;
+	while (true) {
+		// Drop what is consumed, then take the next block
+		// (which may move the window).
+		size_t keep = srcend - p;
+		srcbase += p - srcbuf;
+		memmove(srcbuf, p, keep);
+		srcend = srcbuf + keep;
+		
+		if (more) {
+			more = lex_stream_take(&stream, i);
+			i ^= 1;
+		}
+		p = srcbuf;
+		
+		if (comment >= 0) {
+			const char *q = scanner->skip_block_comment(p, srcend);
+			if (!q) {
+				if (!more) {
+					srcpos = comment;
+					fatal("unexpected end of block comment");
+				}
+				
+				// A '*' at the end may start the closing "*/".
+				p = srcend > p && srcend[-1] == '*' ? srcend - 1 : srcend;
+				continue;
+			}
+			p = q;
+			comment = -1;
+		}
+		
+		// The cut is past the last line break,
+		// the end of the window once it ends the source.
+		const char *cut = srcend;
+		if (more) {
+			while (cut > p && cut[-1] != '\n')
+				cut--;
+			if (cut == p)
+				continue;
+		}
+		
+		// The lexer must not look past the cut.
+		const char *end = srcend;
+		srcend = cut;
+		bool open = false;
+		bool eof = lex_stream_range(&p, cut - srcbuf + !more, &open);
+		srcend = end;
+		
+		if (eof)
+			break;
+		if (open) {
+			comment = p - srcbuf + srcbase;
+			p += 2;
+		}
+	}
+	
+	lex_append_eof();
+	
+	pthread_join(reader, NULL);
+	pthread_mutex_destroy(&stream.lock);
+	pthread_cond_destroy(&stream.cond);
+	xfree(stream.blocks[0]);
+	xfree(stream.blocks[1]);
+}
+
+static void lex_free_tokens()
+{
+	arena_free(&lextoks.string_arena);
+	
+	xfree(lextoks.types);
+	xfree(lextoks.offsets);
+	xfree(lextoks.lengths);
+	xfree(lextoks.payloads);
+	xfree(lextoks.strings);
+	memset(&lextoks, 0, sizeof(lextoks));
+}
+
+void lex_next_token()
+{
+	// Stay on the first EOF token once reached,
+	// fetching past the end keeps returning EOF.
+	if (lexstate.pos < 0 || !CURREOF())
+		lexstate.pos++;
+	
+	srcpos = lextoks.offsets[lexstate.pos];
+}
+
+void lex_peek_token()
+{
+	// Every token is in the buffer already,
+	// and so is the look-ahead (see lex_tokenize_all()).
+	assert(lexstate.pos + 1 < lextoks.n_toks);
+}
+
+// Returns the index of the n-th token after the current one
+// (n = 1 is the look-ahead token), or of the EOF token
+// if the file ends before that.
+int lex_peek_nth(int n)
+{
+	assert(n >= 0);
+	
+	int i = lexstate.pos + n;
+	if (i >= lextoks.n_toks)
+		i = lextoks.n_toks - 1;
+	
+	return i;
+}
+
+// Returns the value of the i-th token, a string const, and its length
+// in *plength. The value is not terminated: unless the literal has
+// escapes, it is the source between the quotes. Literals with escapes
+// are decoded on the first call and kept until lex_finit().
+const char *lex_token_string(int i, int *plength)
+{
+	assert(i >= 0 && i < lextoks.n_toks);
+	assert(TOKTYPE(i) == TOKEN_TYPE_STRING_CONST);
+	assert(plength);
+	
+	// The literal without its quotes.
+	const char *p = srcbuf + lextoks.offsets[i] + 1;
+	int len = lextoks.lengths[i] - 2;
+	
+	int k = TOKPAYLOAD(i);
+	if (k < 0) {
+		*plength = len;
+		return p;
+	}
+	
+	lex_string_t *str = &lextoks.strings[k];
+	if (!str->text) {
+		// Warnings are about the literal.
+		tokstart = srcbuf + lextoks.offsets[i];
+		char *out = arena_alloc(&lextoks.string_arena, len + 1);
+		str->length = lex_decode_string(p, p + len, out);
+		str->text = out;
+	}
+	
+	*plength = str->length;
+	return str->text;
+}
+
+// Checkpoints: save the cursor, parse speculatively,
+// then restore it to backtrack. Both are O(1).
+void lex_save(plex_state_t pstate)
+{
+	assert(pstate);
+	
+	*pstate = lexstate;
+}
+
+void lex_restore(const lex_state_t *pstate)
+{
+	assert(pstate);
+	assert(pstate->pos >= -1 && pstate->pos < lextoks.n_toks);
+	
+	lexstate = *pstate;
+	srcpos = pstate->pos < 0 ? 0 : lextoks.offsets[pstate->pos];
+}
+
+void lex_print_all_tokens()
+{
+	int i;
+	for (i = 0; ; ++i) {
+		if (TOKEOF(i)) {
+			printf(">>>>> eof <<<<<\n");
+			break;
+		}
+		
+		switch (TOKTYPE(i)) {
 		case TOKEN_TYPE_KEYWORD:
-			printf("keyword: %s\n", currtok.token_value.text);
+			printf("keyword: %s\n", lex_keyword_text(TOKKW(i)));
 			break;
 		case TOKEN_TYPE_IDENTIFIER:
-			printf("id: %s\n", currtok.token_value.text);
+			printf("id: %s\n", ATOM_TEXT(TOKATOM(i)));
 			break;
 		case TOKEN_TYPE_INT_CONST:
-			printf("int: %d\n", currtok.token_value.integer);
+			printf("int: %d\n", TOKINT(i));
 			break;
 		case TOKEN_TYPE_CHAR_CONST:
-			printf("char: %c (ascii = %d)\n", currtok.token_value.character, currtok.token_value.character);
+			printf("char: %c (ascii = %d)\n", TOKCHAR(i), TOKCHAR(i));
+			break;
+		case TOKEN_TYPE_STRING_CONST:
+		{
+			int len;
+			const char *str = lex_token_string(i, &len);
+			printf("string: %.*s\n", len, str);
+			break;
+		}
+		}
+	}
+}
+
+// Add the line breaks in p[0..end), a part of the window,
+// to the index.
+static void lex_index_lines(const char *p, const char *end)
+{
+	while (p < end && (p = memchr(p, '\n', end - p))) {
+		if (n_srclines == cap_srclines) {
+			cap_srclines = cap_srclines ? cap_srclines * 2 : (int)(srclen / 32) + 64;
+			srclines = xrealloc(srclines, cap_srclines * sizeof(int));
+		}
+		srclines[n_srclines++] = p - srcbuf + srcbase;
+		p++;
+	}
+}
+
+static void lex_free_lines()
+{
+	xfree(srclines);
+	srclines = NULL;
+	n_srclines = -1;
+	cap_srclines = 0;
+}
+
+// Turn a source offset into a line and a column, both from 1.
+// A line ends at '\n' (so '\r\n' is one break), and the column
+// counts bytes, a tab being one.
+void lex_locate(int offset, int *pline, int *pcolumn)
+{
+	assert(offset >= 0 && offset <= srclen);
+	assert(pline && pcolumn);
+	
+	// A streamed source is indexed as it is read.
+	if (n_srclines < 0) {
+		n_srclines = 0;
+		lex_index_lines(srcbuf, srcend);
+	}
+	
+	// The number of line breaks before offset.
+	int lo = 0, hi = n_srclines;
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+		if (srclines[mid] < offset)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	
+	*pline = lo + 1;
+	*pcolumn = offset - (lo ? srclines[lo - 1] + 1 : 0) + 1;
+}
+
+
+#ifndef NDEBUG
+
+// Everything a token carries, flattened for comparison in lex_unittest().
+typedef struct _lex_test_token_t {
+	int type;
+	int eof;
+	int offset;
+	int integer;
+	int escaped;
+	char text[256];
+} lex_test_token_t;
+
+typedef void (*lex_get_token_fn)(ptoken_t ptoken);
+
+// Tokenize buf with the given lexer and kernels,
+// return the number of tokens. A lexing error or warning
+// ends the stream with a token of type -1 telling where.
+static int lex_test_tokenize(lex_get_token_fn get_token, const lex_scanner_t *s,
+	const char *buf, size_t len, lex_test_token_t *toks, int max_toks)
+{
+	scanner = s;
+	srcptr = buf;
+	srcend = buf + len;
+	
+	jmp_buf abort;
+	volatile int n = 0;
+	if (setjmp(abort)) {
+		lex_abort = NULL;
+		lex_test_token_t *t = &toks[n - 1];
+		memset(t, 0, sizeof(*t));
+		t->type = -1;
+		t->offset = tokstart - buf;
+		return n;
+	}
+	lex_abort = &abort;
+	
+	while (n < max_toks) {
+		token_t tok;
+		memset(&tok, 0, sizeof(tok));
+		lex_test_token_t *t = &toks[n++];
+		get_token(&tok);
+		
+		memset(t, 0, sizeof(*t));
+		t->eof = tok.token_flag_eof;
+		t->offset = tokstart - buf;
+		if (t->eof)
+			break;
+		
+		t->type = tok.token_type;
+		switch (tok.token_type) {
+		case TOKEN_TYPE_KEYWORD:
+			t->integer = tok.token_value.keyword;
+			break;
+		case TOKEN_TYPE_IDENTIFIER:
+			strcpy(t->text, ATOM_TEXT(tok.token_value.atom));
 			break;
 		case TOKEN_TYPE_STRING_CONST:
-			printf("string: %s\n", currtok.token_value.text);
+			t->integer = lex_decode_string(tokstart + 1, srcptr - 1, t->text);
+			t->escaped = tok.token_value.escaped;
+			break;
+		case TOKEN_TYPE_INT_CONST:
+			t->integer = tok.token_value.integer;
+			break;
+		case TOKEN_TYPE_CHAR_CONST:
+			t->integer = tok.token_value.character;
 			break;
 		}
 	}
 	
-	// Seek to the beginning of the input file
-	// for the parser to work right.
-	fseek(input, 0, SEEK_SET);
+	lex_abort = NULL;
+	return n;
+}
+
+// Lex buf serially, then in several numbers of chunks in parallel;
+// the token buffers must be the same.
+static void lex_test_parallel(char *buf, size_t len)
+{
+	static const int n_chunks[] = { 2, 3, 7, 16 };
+	
+	srcbuf = buf;
+	srclen = len;
+	srcend = buf + len;
+	lex_tokenize_all();
+	lex_tokens_t serial = lextoks;
+	memset(&lextoks, 0, sizeof(lextoks));
+	
+	int i;
+	for (i = 0; i < sizeof(n_chunks) / sizeof(n_chunks[0]); ++i) {
+		lex_tokenize_parallel(n_chunks[i]);
+		
+		int n = serial.n_toks;
+		assert(lextoks.n_toks == n);
+		assert(!memcmp(lextoks.types, serial.types, n * sizeof(serial.types[0])));
+		assert(!memcmp(lextoks.offsets, serial.offsets, n * sizeof(serial.offsets[0])));
+		assert(!memcmp(lextoks.lengths, serial.lengths, n * sizeof(serial.lengths[0])));
+		assert(!memcmp(lextoks.payloads, serial.payloads, n * sizeof(serial.payloads[0])));
+		assert(lextoks.n_strings == serial.n_strings);
+		
+		lex_free_tokens();
+	}
+	
+	lextoks = serial;
+	lex_free_tokens();
+}
+
+// Lex buf serially, then streamed through blocks of several sizes;
+// the token buffers must be the same, and so must the values of
+// strings and the line index.
+static void lex_test_stream(char *buf, size_t len)
+{
+	static const size_t block_sizes[] = { 5, 61, 4096 };
+	
+	srcbuf = buf;
+	srclen = len;
+	srcend = buf + len;
+	lex_tokenize_all();
+	lex_tokens_t serial = lextoks;
+	memset(&lextoks, 0, sizeof(lextoks));
+	
+	lex_free_lines();
+	n_srclines = 0;
+	lex_index_lines(buf, buf + len);
+	int *lines = srclines;
+	int n_lines = n_srclines;
+	srclines = NULL;
+	lex_free_lines();
+	
+	FILE *f = tmpfile();
+	assert(f);
+	size_t written = fwrite(buf, 1, len, f);
+	assert(written == len);
+	fflush(f);
+	
+	int i;
+	for (i = 0; i < sizeof(block_sizes) / sizeof(block_sizes[0]); ++i) {
+		lseek(fileno(f), 0, SEEK_SET);
+		lex_stream_block = block_sizes[i];
+		lex_tokenize_stream(fileno(f), "test");
+		
+		int n = serial.n_toks;
+		assert(lextoks.n_toks == n);
+		assert(!memcmp(lextoks.types, serial.types, n * sizeof(serial.types[0])));
+		assert(!memcmp(lextoks.offsets, serial.offsets, n * sizeof(serial.offsets[0])));
+		assert(!memcmp(lextoks.lengths, serial.lengths, n * sizeof(serial.lengths[0])));
+		
+		int k;
+		for (k = 0; k < n; ++k) {
+			if (TOKEOF(k) || TOKTYPE(k) != TOKEN_TYPE_STRING_CONST) {
+				assert(lextoks.payloads[k] == serial.payloads[k]);
+				continue;
+			}
+			
+			char value[256];
+			int length = lex_decode_string(buf + serial.offsets[k] + 1,
+				buf + serial.offsets[k] + serial.lengths[k] - 1, value);
+			lex_string_t *str = &lextoks.strings[lextoks.payloads[k]];
+			assert(str->length == length && !memcmp(str->text, value, length));
+		}
+		
+		assert(n_srclines == n_lines && !memcmp(srclines, lines, n_lines * sizeof(int)));
+		
+		lex_free_tokens();
+		lex_free_lines();
+		xfree(srcbuf);
+	}
+	
+	fclose(f);
+	xfree(lines);
+	lex_stream_block = LEX_STREAM_BLOCK;
+	srcstreamed = false;
+	srcbase = 0;
+	srcbuf = buf;
+	srclen = len;
+	srcend = buf + len;
+	
+	lextoks = serial;
+	lex_free_tokens();
+}
+
+// Append a random but well-formed piece of source to buf.
+static size_t lex_test_piece(char *buf, unsigned *seed)
+{
+	static const char *pieces[] = {
+		"int", "while", "record", "=", "==", "<=", "!", "&&", "||",
+		"(", ")", "{", "}", ";", "/", "%", "12345", "'x'", "'\\n'",
+		"\"str\\t\\\"ing\\065\"", "\"plain string\"", "'\\''", "'\\101'",
+		// Tokens used to be limited to 100 characters.
+		"\"0123456789" "0123456789" "0123456789" "0123456789" "0123456789"
+		"0123456789" "0123456789" "0123456789" "0123456789" "0123456789"
+		"0123456789" "0123456789\"",
+		"// line comment\n", "//\r\n", "/**/",
+		"/* block\n * comment **/", "/*\n\n*/",
+		// Comments that do not look like comments from the inside.
+		"/* \"a\n b 'c' // */", "/*\n\"unterminated\n*/", "/*\n/* x\n*/",
+	};
+	
+	*seed = *seed * 1103515245 + 12345;
+	unsigned r = *seed >> 8;
+	size_t len = 0;
+	int i;
+	
+	switch (r % 4) {
+	case 0:
+		// A run of blanks crossing vector boundaries.
+		for (i = 0; i < (r >> 4) % 70; ++i)
+			buf[len++] = " \t\n \r\n  "[(r >> (i % 20)) % 8];
+		buf[len++] = ' ';
+		break;
+	case 1:
+		// An identifier of up to 90 characters.
+		buf[len++] = 'a' + (r >> 4) % 26;
+		for (i = 0; i < (r >> 6) % 90; ++i)
+			buf[len++] = "aZ_09xy"[(r >> (i % 20)) % 7];
+		buf[len++] = ' ';
+		break;
+	case 2:
+		// A block comment spanning several vectors.
+		len += sprintf(buf, "/*");
+		for (i = 0; i < (r >> 4) % 80; ++i)
+			buf[len++] = "* \n\rx"[(r >> (i % 20)) % 5];
+		len += sprintf(buf + len, "*/");
+		break;
+	default:
+		len += sprintf(buf, "%s ", pieces[(r >> 4) % (sizeof(pieces) / sizeof(pieces[0]))]);
+		break;
+	}
+	
+	return len;
+}
+
+// Differential fuzzing of the table DFA against the switch:
+// random lines of fragments must give the same tokens, and fail
+// at the same token on the same line. Most fragments are well-formed,
+// so that a run gets deep into the input before the first error;
+// a line break at least every 64 bytes keeps the tokens short.
+static void lex_test_fuzz(char *buf, lex_test_token_t *expected,
+	lex_test_token_t *actual, int max_toks, unsigned *seed)
+{
+	static const char *fragments[] = {
+		"a", "Zq_9", "while", "0", "123", " ", "  ", "\t", "\r", "\r\n",
+		"/", "*", "/**/", "/* * / \n */", "// x", "=", "==", "<", "<=",
+		">", ">=", "!", "!=", "&&", "||", ".", ";", ",", "(", ")", "{", "}",
+		"[", "]", "+", "-", "%", "\"s\"", "\"\\t\\\"\\101\"", "'c'", "'\\''",
+	};
+	static const char *hazards[] = {
+		"\"", "'", "\\", "&", "|", "_", "#", "@", "/*", "9999999999",
+		"'ab'", "''", "'\\q'", "'\\12'", "\"\\q\"", "\"\\1x\"",
+	};
+	
+	size_t len = 0;
+	int i;
+	for (i = 0; i < 32; ++i) {
+		if (i % 8 == 0) {
+			// Keep the pieces of the well-formed test among the noise.
+			len += lex_test_piece(buf + len, seed);
+			buf[len++] = '\n';
+			continue;
+		}
+		
+		size_t line = len;
+		while (len - line < 48) {
+			*seed = *seed * 1103515245 + 12345;
+			unsigned r = *seed >> 8;
+			if (r % 512)
+				len += sprintf(buf + len, "%s", fragments[(r >> 9) % (sizeof(fragments) / sizeof(fragments[0]))]);
+			else if ((r >> 9) % 8)
+				len += sprintf(buf + len, "%s", hazards[(r >> 12) % (sizeof(hazards) / sizeof(hazards[0]))]);
+			else
+				buf[len++] = r >> 12;
+		}
+		buf[len++] = '\n';
+	}
+	
+	// The input may also end inside a comment.
+	if (*seed % 4 == 0)
+		len += sprintf(buf + len, "/* eof\n\n");
+	
+	int n = lex_test_tokenize(lex_get_token_switch, &lex_scanner_scalar,
+		buf, len, expected, max_toks);
+	int m = lex_test_tokenize(lex_get_token, &lex_scanner_scalar,
+		buf, len, actual, max_toks);
+	assert(m == n);
+	assert(!memcmp(expected, actual, n * sizeof(lex_test_token_t)));
 }
 
+#endif // NDEBUG
+
+// Differential test: every available set of scanning kernels
+// must produce exactly the token stream of the scalar kernels,
+// and the table DFA exactly that of the switch.
+void lex_unittest()
+{
+	lex_scan_unittest();
+	
+#	ifndef NDEBUG
+	// Every keyword must be found in its own slot,
+	// and map to itself.
+	static const char *not_keywords[] = {
+		"a", "i", "in", "ifs", "nul", "whilee", "Return", "|", "&", "=>", NULL
+	};
+	
+	int n_keywords = 0;
+	int i;
+	for (i = 0; i < KEYWORD_SLOTS; ++i) {
+		const struct _keyword_slot_t *slot = &keyword_slots[i];
+		if (!slot->len)
+			continue;
+		assert(slot->len == strlen(slot->text));
+		assert(keyword_hash(slot->text, slot->len) == i);
+		assert(!strcmp(lex_keyword_text(slot->keyword), slot->text));
+		n_keywords++;
+	}
+	assert(n_keywords == KEYWORD_COUNT);
+	
+	for (i = 0; i < KEYWORD_COUNT; ++i)
+		assert(lex_keyword_lookup(lex_keyword_text(i), strlen(lex_keyword_text(i))) == i);
+	
+	const char **nk;
+	for (nk = not_keywords; *nk; ++nk)
+		assert(lex_keyword_lookup(*nk, strlen(*nk)) == KEYWORD_NONE);
+	
+	// Preserve the state of the file being compiled.
+	const lex_scanner_t *saved_scanner = scanner;
+	char *saved_buf = srcbuf;
+	size_t saved_len = srclen;
+	const char *saved_ptr = srcptr;
+	const char *saved_end = srcend;
+	int saved_srcpos = srcpos;
+	int *saved_lines = srclines;
+	int saved_n_lines = n_srclines;
+	lex_tokens_t saved_toks = lextoks;
+	lex_state_t saved_state = lexstate;
+	
+	// Identifiers are interned, into a table of their own.
+	atom_init();
+	lex_dfa_build();
+	
+	const lex_scanner_t *scanners[LEX_MAX_SCANNERS + 1];
+	lex_scanner_available(scanners);
+	
+	enum { MAX_SRC = 1 << 15, MAX_TOKS = 1 << 13 };
+	char *src = xmalloc(MAX_SRC);
+	lex_test_token_t *expected = xmalloc(MAX_TOKS * sizeof(lex_test_token_t));
+	lex_test_token_t *actual = xmalloc(MAX_TOKS * sizeof(lex_test_token_t));
+	
+	unsigned seed = 2012;
+	size_t len = 0;
+	int n = 0;
+	int round;
+	for (round = 0; round < 300; ++round)
+		lex_test_fuzz(src, expected, actual, MAX_TOKS, &seed);
+	
+	for (round = 0; round < 4; ++round) {
+		len = 0;
+		while (len < MAX_SRC - 256)
+			len += lex_test_piece(src + len, &seed);
+		
+		// Ending the input inside a line comment must also work.
+		len += sprintf(src + len, "// eof");
+		
+		n = lex_test_tokenize(lex_get_token_switch, &lex_scanner_scalar,
+			src, len, expected, MAX_TOKS);
+		assert(n < MAX_TOKS && expected[n - 1].eof);
+		
+		const lex_scanner_t **s;
+		for (s = scanners + 1; *s; ++s) {
+			int m = lex_test_tokenize(lex_get_token_switch, *s, src, len, actual, MAX_TOKS);
+			assert(m == n);
+			assert(!memcmp(expected, actual, n * sizeof(lex_test_token_t)));
+		}
+		
+		int m = lex_test_tokenize(lex_get_token, &lex_scanner_scalar,
+			src, len, actual, MAX_TOKS);
+		assert(m == n);
+		assert(!memcmp(expected, actual, n * sizeof(lex_test_token_t)));
+		
+		scanner = &lex_scanner_scalar;
+		lex_test_parallel(src, len);
+		
+		// Streaming in 5-byte blocks is slow; one source is enough.
+		if (!round)
+			lex_test_stream(src, len);
+	}
+	
+	// The token buffer holds the same stream, plus one more EOF,
+	// and every token points back at its own spelling.
+	scanner = &lex_scanner_scalar;
+	srcbuf = src;
+	srclen = len;
+	srcend = src + len;
+	lex_tokenize_all();
+	
+	assert(lextoks.n_toks == n + 1);
+	assert(TOKEOF(n - 1) && TOKEOF(n));
+	for (i = 0; i < n - 1; ++i) {
+		assert(TOKTYPE(i) == expected[i].type);
+		assert(lextoks.offsets[i] == expected[i].offset);
+		
+		const char *spelling = src + lextoks.offsets[i];
+		int length = lextoks.lengths[i];
+		switch (TOKTYPE(i)) {
+		case TOKEN_TYPE_KEYWORD:
+			assert(length == strlen(lex_keyword_text(TOKKW(i))));
+			assert(!memcmp(spelling, lex_keyword_text(TOKKW(i)), length));
+			break;
+		case TOKEN_TYPE_IDENTIFIER:
+			assert(length == ATOM_LEN(TOKATOM(i)));
+			assert(!memcmp(spelling, ATOM_TEXT(TOKATOM(i)), length));
+			break;
+		case TOKEN_TYPE_STRING_CONST:
+		{
+			assert(spelling[0] == '"' && spelling[length - 1] == '"');
+			
+			// Plain strings are not copied,
+			// those with escapes are decoded once.
+			int value_len;
+			const char *value = lex_token_string(i, &value_len);
+			assert(value_len == expected[i].integer);
+			assert(!memcmp(value, expected[i].text, value_len));
+			if (TOKPAYLOAD(i) < 0)
+				assert(value == spelling + 1);
+			else
+				assert(value == lex_token_string(i, &value_len));
+			break;
+		}
+		case TOKEN_TYPE_CHAR_CONST:
+			assert(spelling[0] == '\'' && spelling[length - 1] == '\'');
+			break;
+		}
+	}
+	
+	// Checkpoints and arbitrary look-ahead.
+	lexstate.pos = -1;
+	lex_next_token();
+	lex_peek_token();
+	assert(lexstate.pos == 0 && srcpos == lextoks.offsets[0]);
+	
+	lex_state_t checkpoint;
+	lex_save(&checkpoint);
+	assert(lex_peek_nth(3) == 3);
+	for (i = 0; i < 3; ++i)
+		lex_next_token();
+	assert(lexstate.pos == 3);
+	lex_restore(&checkpoint);
+	assert(lexstate.pos == 0 && srcpos == lextoks.offsets[0]);
+	
+	assert(lex_peek_nth(n + 100) == n);
+	for (i = 0; i < n + 100; ++i)
+		lex_next_token();
+	assert(CURREOF() && LAEOF() && lexstate.pos == n - 1);
+	
+	// Positions are located the slow way, counting every byte.
+	n_srclines = -1;
+	int line = 1, column = 1;
+	const char *p = src;
+	for (i = 0; i < n; ++i) {
+		for (; p != src + lextoks.offsets[i]; ++p) {
+			column++;
+			if (*p == '\n')
+				line++, column = 1;
+		}
+		
+		int l, c;
+		lex_locate(lextoks.offsets[i], &l, &c);
+		assert(l == line && c == column);
+	}
+	
+	lex_free_tokens();
+	lex_free_lines();
+	
+	xfree(actual);
+	xfree(expected);
+	xfree(src);
+	atom_finit();
+	
+	scanner = saved_scanner;
+	srcbuf = saved_buf;
+	srclen = saved_len;
+	srcptr = saved_ptr;
+	srcend = saved_end;
+	srcpos = saved_srcpos;
+	srclines = saved_lines;
+	n_srclines = saved_n_lines;
+	lextoks = saved_toks;
+	lexstate = saved_state;
+#	endif
+	
+	printf("test lex ok\n");
+}
@@ -1,24 +1,27 @@
 #include "javac.h"
 
-static void errout(int lineno, const char *kind, const char *fmt, va_list args)
+static void errout(int offset, const char *kind, const char *fmt, va_list args)
 {
 	fprintf(stderr, "%s: ", kind);
 	vfprintf(stderr, fmt, args);
 	
-	// We do not display line number until
-	// it is set to be positive
-	// after successfully opening the file.
-	if (!lineno)
+	// We do not display the position until
+	// the file is successfully opened.
+	if (offset < 0) {
 		fprintf(stderr, "\n");
-	else
-		fprintf(stderr, " (@%d)\n", lineno);
+		return;
+	}
+	
+	int line, column;
+	lex_locate(offset, &line, &column);
+	fprintf(stderr, " (@%d:%d)\n", line, column);
 }
 
 void fatal(const char *fmt, ...)
 {
 	va_list args;
 	va_start(args, fmt);
-	errout(lineno, "fatal", fmt, args);
+	errout(srcpos, "fatal", fmt, args);
 	va_end(args);
 	exit(1);
 }
@@ -27,7 +30,7 @@ void warn(const char *fmt, ...)
 {
 	va_list args;
 	va_start(args, fmt);
-	errout(lineno, "warning", fmt, args);
+	errout(srcpos, "warning", fmt, args);
 	va_end(args);
 }
 
@@ -35,7 +38,7 @@ void fatal_tree(tree_t tree, const char *fmt, ...)
 {
 	va_list args;
 	va_start(args, fmt);
-	errout(TREE_NODE_LNO(tree), "fatal", fmt, args);
+	errout(TREE_NODE_OFFSET(tree), "fatal", fmt, args);
 	va_end(args);
 	exit(1);
 }
@@ -44,43 +47,132 @@ void warn_tree(tree_t tree, const char *fmt, ...)
 {
 	va_list args;
 	va_start(args, fmt);
-	errout(TREE_NODE_LNO(tree), "warning", fmt, args);
+	errout(TREE_NODE_OFFSET(tree), "warning", fmt, args);
 	va_end(args);
 }
 
 static void show_usage(const char *name)
 {
-	printf("usage: %s <java file>\n", name);
+	printf("usage: %s [options] <java file>\n", name);
+	printf("       %s [options] -    (read the source from stdin)\n", name);
+	printf("options:\n");
+	printf("  -fmem-report         report memory use on stderr at exit\n");
+	printf("  -fmem-report=<file>  report memory use into <file> at exit\n");
+	printf("  -flist-functions     list the function heads, keeping no body\n");
+	printf("  -fsyntax-only        check the syntax only, building no tree\n");
+}
+
+// Where -fmem-report goes, NULL for no report.
+static const char *mem_report;
+
+// Also runs when fatal() exits, failed compiles use memory too.
+static void report_memory()
+{
+	FILE *fp = stderr;
+	if (*mem_report) {
+		fp = fopen(mem_report, "w");
+		if (!fp) {
+			fprintf(stderr, "cannot write memory report to %s\n", mem_report);
+			return;
+		}
+	}
+	
+	xmem_report(fp);
+	
+	if (fp != stderr)
+		fclose(fp);
 }
 
 int main(int argc, char **argv)
 {
-	if (argc != 2) {
+	const char *filename = NULL;
+	bool list_functions = false;
+	bool syntax_only = false;
+	int i;
+	for (i = 1; i < argc; ++i) {
+		const char *arg = argv[i];
+		if (!strcmp(arg, "-fmem-report"))
+			mem_report = "";
+		else if (!strncmp(arg, "-fmem-report=", 13))
+			mem_report = arg + 13;
+		else if (!strcmp(arg, "-flist-functions"))
+			list_functions = true;
+		else if (!strcmp(arg, "-fsyntax-only"))
+			syntax_only = true;
+		else if (arg[0] == '-' && arg[1]) {
+			show_usage(argv[0]);
+			return 0;
+		} else if (!filename)
+			filename = arg;
+		else {
+			show_usage(argv[0]);
+			return 0;
+		}
+	}
+	
+	if (!filename) {
 		show_usage(argv[0]);
 		return 0;
 	}
 	
+	if (mem_report)
+		atexit(report_memory);
+	
 #	ifndef NDEBUG
+	xmem_unittest();
+	pool_unittest();
 	slist_unittest();
 	hashtab_unittest();
+	atom_unittest();
+	symtab_unittest();
+	lex_unittest();
+	check_unittest();
 #	endif
 	
+	atom_init();
+	
 	// lex and parse.
-	lex_init(argv[1]);
+	xmem_phase(XMEM_PHASE_LEX);
+	lex_init(filename);
 	// lex_print_all_tokens();
+	xmem_phase(XMEM_PHASE_PARSE);
 	parser_init();
+	parser_lazy_bodies = list_functions;
+	parser_syntax_only = syntax_only;
 	tree_t tree = parser_file();
 	parser_finit();
-	lex_finit();
 	
 #	ifndef NDEBUG
-	parser_visit_tree(&print_visitor, tree);
+	// To see if atoms are spreading evenly.
+	atom_stat();
+	
+	if (tree && !list_functions)
+		parser_visit_tree(&print_visitor, tree);
 #	endif
 	
-	// semantic check.
-	parser_visit_tree(&check_visitor, tree);
+	if (!tree) {
+		// Checked the syntax only, there is no tree.
+	} else if (list_functions) {
+		// No body is asked for, a broken one is still an error.
+		parser_check_bodies(tree);
+		print_function_heads(tree);
+	} else {
+		// semantic check.
+		xmem_phase(XMEM_PHASE_CHECK);
+		parser_visit_tree(&check_visitor, tree);
+	}
+	
+	// The tree goes at once, after the last pass.
+	parser_free_tree();
+	
+	// Names and strings in the tree point into the atom table
+	// and the source buffer, keep them until the last pass is done.
+	lex_finit();
+	atom_finit();
+	pool_finit();
 	
 	// gen IR.
+	xmem_phase(XMEM_PHASE_CODEGEN);
 	
 #	ifndef NDEBUG
 	// this function is useful for us
@@ -1,14 +1,27 @@
 #include "javac.h"
 
+#include <limits.h>
+#include <pthread.h>
+#include <setjmp.h>
+
 // If set to true, 'entering ...' will be printed.
 #define PARSER_TRACE 0
 
+// How many stmts and exprs may be open, each in another,
+// unless $JAVAC_MAX_NESTING says otherwise.
+#define PARSER_MAX_NESTING (1 << 22)
+
+// Below this many tokens per thread, parsing in parallel does not pay.
+#define PARSER_MIN_TOKENS (1 << 16)
+
 static tree_t parser_translation_unit();
 static tree_t parser_external_decl();
 static tree_t parser_prototype_decl();
 static tree_t parser_record_def();
 static tree_t parser_function_def();
 static void   parser_function_head(tree_t decl);
+static void   parser_function_body(tree_t fun);
+static void   parser_skip_body(tree_t fun);
 static tree_t parser_variable_decl_list();
 static tree_t parser_stmt_list();
 static tree_t parser_type_specifier();
@@ -16,29 +29,28 @@ static tree_t parser_parameter_list();
 static tree_t parser_variable_decl();
 static tree_t parser_parameter_decl();
 static tree_t parser_stmt();
-static tree_t parser_compound_stmt();
+static bool   parser_stmt_begin(tree_t *pstmt);
+static bool   parser_stmt_end(tree_t *pstmt);
 static tree_t parser_expr_stmt();
-static tree_t parser_selection_stmt();
-static tree_t parser_iteration_stmt();
 static tree_t parser_jump_stmt();
 static tree_t parser_expr();
-static tree_t parser_assignment_expr();
-static tree_t parser_unary_expr(tree_t unary_subst);
-static tree_t parser_logical_or_expr(tree_t unary_subst);
-static tree_t parser_postfix();
-static tree_t parser_primary();
-static tree_t parser_logical_and_expr(tree_t unary_subst);
-static tree_t parser_equality_expr(tree_t unary_subst);
-static tree_t parser_relational_expr(tree_t unary_subst);
-static tree_t parser_additive_expr(tree_t unary_subst);
-static tree_t parser_mult_expr(tree_t unary_subst);
-
+static void   parser_expr_begin();
+static bool   parser_exp_end(tree_t *pexp);
+static bool   parser_unary_begin(tree_t *pexp);
+static bool   parser_binary_begin(tree_t *pexp, int min_prec);
+static bool   parser_postfix(tree_t *pexp);
+static bool   parser_primary_begin(tree_t *pexp);
+
+static void parser_fatal(const char *fmt, ...);
 static bool parser_next_token_is_eof();
-static void parser_eat_next_token(int token_type, const char *text);
-static bool parser_next_token_is(int token_type, const char *text);
+static int  parser_next_keyword();
+static void parser_eat_next_token(int keyword);
+static bool parser_next_token_is(int token_type);
+static bool parser_next_token_is_keyword(int keyword);
 static bool parser_next_token_indicates_typespec();
-static void parser_current_token_should_be(int token_type, const char *text);
-static bool parser_current_token_is(int token_type, const char *text);
+static void parser_current_token_should_be(int token_type);
+static void parser_current_token_should_be_keyword(int keyword);
+static bool parser_current_token_is_keyword(int keyword);
 
 static tree_t parser_id();
 static tree_t parser_int_const();
@@ -47,20 +59,374 @@ static tree_t parser_string_const();
 static tree_t parser_null();
 
 static void _parser_print_fun(tree_t decl);
-static void _parser_print_type(tree_t typespec);
 static void _parser_print_var(tree_t var);
 static void _parser_print_param(tree_t param);
 
-static phashtab_t typetab;
-
+// The binary operators by keyword: the tree op and the precedence,
+// from PARSER_PREC_LOWEST up. Other keywords have precedence 0.
+enum {
+	PARSER_PREC_NONE,
+	PARSER_PREC_LOWEST,
+	PARSER_PREC_OR = PARSER_PREC_LOWEST,
+	PARSER_PREC_AND,
+	PARSER_PREC_EQUALITY,
+	PARSER_PREC_RELATIONAL,
+	PARSER_PREC_ADDITIVE,
+	PARSER_PREC_MULT,
+};
+
+static const struct _parser_binop_t {
+	unsigned char op;
+	unsigned char prec;
+} parser_binops[KEYWORD_COUNT] = {
+	[KEYWORD_OR] = { EXP_OP_LOGICAL_OR, PARSER_PREC_OR },
+	[KEYWORD_AND] = { EXP_OP_LOGICAL_AND, PARSER_PREC_AND },
+	[KEYWORD_EQ] = { EXP_OP_EQ, PARSER_PREC_EQUALITY },
+	[KEYWORD_NEQ] = { EXP_OP_NEQ, PARSER_PREC_EQUALITY },
+	[KEYWORD_LESS] = { EXP_OP_LESS, PARSER_PREC_RELATIONAL },
+	[KEYWORD_LESS_EQ] = { EXP_OP_LESS_EQ, PARSER_PREC_RELATIONAL },
+	[KEYWORD_GREATER] = { EXP_OP_GREATER, PARSER_PREC_RELATIONAL },
+	[KEYWORD_GREATER_EQ] = { EXP_OP_GREATER_EQ, PARSER_PREC_RELATIONAL },
+	[KEYWORD_PLUS] = { EXP_OP_PLUS, PARSER_PREC_ADDITIVE },
+	[KEYWORD_MINUS] = { EXP_OP_MINUS, PARSER_PREC_ADDITIVE },
+	[KEYWORD_MULTIPLY] = { EXP_OP_MULTIPLY, PARSER_PREC_MULT },
+	[KEYWORD_DIVIDE] = { EXP_OP_DIVIDE, PARSER_PREC_MULT },
+	[KEYWORD_MODULO] = { EXP_OP_MODULO, PARSER_PREC_MULT },
+};
+
+static __thread tree_t *list_stack;
+static __thread int n_list_stack;
+static __thread int cap_list_stack;
+
+// Checking the syntax only, where each list open began in tree_arena.
+static __thread arena_mark_t *list_marks;
+static __thread int n_list_marks;
+static __thread int cap_list_marks;
+
+// The stmts and exprs being parsed, innermost on top. Each frame is
+// one waiting for a stmt or an expr nested in it, see parser_stmt()
+// and parser_expr(): nesting takes room on this stack, and none on
+// the C stack.
+enum {
+	PARSER_FRAME_STMTS,		// compound stmt, for its next stmt.
+	PARSER_FRAME_IF_THEN,		// if stmt, for the then part.
+	PARSER_FRAME_IF_ELSE,		// if stmt, for the else part.
+	PARSER_FRAME_BODY,		// while or for stmt, for the body.
+	PARSER_FRAME_EXPR,		// expr, for its next assignment expr.
+	PARSER_FRAME_ASSIGN,		// assignment expr, for its first unary expr.
+	PARSER_FRAME_ASSIGN_RHS,	// assignment expr, for the right side.
+	PARSER_FRAME_UNARY,		// unary expr, for the operand.
+	PARSER_FRAME_BINARY,		// binary expr, for the right operand.
+	PARSER_FRAME_PAREN,		// '(' expr ')', for the expr.
+	PARSER_FRAME_CALL,		// call, for the arguments.
+	PARSER_FRAME_INDEX,		// index, for the index.
+	PARSER_FRAME_NEW,		// new, for the dimension.
+};
+
+typedef struct _parser_frame_t {
+	int kind;		// PARSER_FRAME_*.
+	tree_t node;	// The stmt or exp being built, if any.
+	int base;		// stmts, expr: where its items begin on the list stack.
+	int prec;		// binary: the precedence of the operator.
+	int min_prec;	// binary: the least precedence it may take in.
+} parser_frame_t, *pparser_frame_t;
+
+static __thread pparser_frame_t frames;
+static __thread int n_frames;
+static __thread int cap_frames;
+static int max_frames;
+
+tree_visits_t tree_visits;
+
+// Record names are not kept in a table of their own:
+// parser_record_def() marks the atom of the name with
+// ATOM_FLAG_TYPENAME, which is all the parser needs to tell
+// a type specifier from an expression (but see typename_defs).
 void parser_init()
 {
-	typetab = hashtab_create(31);
+	const char *env = getenv("JAVAC_MAX_NESTING");
+	max_frames = env ? atoi(env) : PARSER_MAX_NESTING;
+	if (max_frames <= 0)
+		max_frames = PARSER_MAX_NESTING;
 }
 
+// Frees the stacks of this thread.
 void parser_finit()
 {
-	hashtab_destroy(typetab);
+	xfree(list_stack);
+	list_stack = NULL;
+	n_list_stack = cap_list_stack = 0;
+	xfree(list_marks);
+	list_marks = NULL;
+	n_list_marks = cap_list_marks = 0;
+	xfree(frames);
+	frames = NULL;
+	n_frames = cap_frames = 0;
+}
+
+static pparser_frame_t parser_push_frame(int kind, tree_t node)
+{
+	if (n_frames == max_frames)
+		parser_fatal("statements or expressions nested too deeply");
+	
+	if (n_frames == cap_frames) {
+		cap_frames = cap_frames ? cap_frames * 2 : 64;
+		frames = xrealloc(frames, cap_frames * sizeof(parser_frame_t));
+	}
+	
+	pparser_frame_t frame = &frames[n_frames++];
+	frame->kind = kind;
+	frame->node = node;
+	return frame;
+}
+
+__thread arena_t tree_arena;
+
+bool parser_lazy_bodies;
+
+// Checking the syntax only, nothing is kept: lists are not built, and
+// once an item of a list is parsed, tree_arena gives back every node
+// made for it. Only the nodes still open stay, so memory grows with
+// the nesting, not with the file. The nodes themselves are still made,
+// the parse writes into those it has open and reads some of them back.
+bool parser_syntax_only;
+
+#ifndef NDEBUG
+// Debug builds print what is parsed, but for the syntax only:
+// nothing is kept then, and printing would be most of the work.
+static bool parser_printing()
+{
+	return !parser_syntax_only;
+}
+#endif
+
+// The token of the first definition of each record name, by atom id,
+// INT_MAX for none. NULL when the file is parsed in order.
+static int *typename_defs;
+
+// The children of lists being parsed are pushed on one stack.
+// A list nested in another one is done before the outer one goes on,
+// so every list owns the top of the stack from where it began, and
+// parser_list_freeze() moves its children to an array of their own.
+static int parser_list_begin()
+{
+	if (parser_syntax_only) {
+		if (n_list_marks == cap_list_marks) {
+			cap_list_marks = cap_list_marks ? cap_list_marks * 2 : 64;
+			list_marks = xrealloc(list_marks, cap_list_marks * sizeof(arena_mark_t));
+		}
+		
+		list_marks[n_list_marks++] = arena_mark(&tree_arena);
+	}
+	
+	return n_list_stack;
+}
+
+static void parser_list_push(tree_t item)
+{
+	if (parser_syntax_only) {
+		arena_release(&tree_arena, list_marks[n_list_marks - 1]);
+		return;
+	}
+	
+	if (n_list_stack == cap_list_stack) {
+		cap_list_stack = cap_list_stack ? cap_list_stack * 2 : 64;
+		list_stack = xrealloc(list_stack, cap_list_stack * sizeof(tree_t));
+	}
+	
+	list_stack[n_list_stack++] = item;
+}
+
+static void parser_list_freeze(tree_t list, int base)
+{
+	if (parser_syntax_only) {
+		TREE_LIST_COUNT(list) = 0;
+		TREE_LIST_ITEMS(list) = NULL;
+		n_list_marks--;
+		return;
+	}
+	
+	assert(base <= n_list_stack);
+	
+	int n_items = n_list_stack - base;
+	TREE_LIST_COUNT(list) = n_items;
+	TREE_LIST_ITEMS(list) = arena_alloc(&tree_arena, n_items * sizeof(tree_t));
+	memcpy(TREE_LIST_ITEMS(list), list_stack + base, n_items * sizeof(tree_t));
+	
+	n_list_stack = base;
+}
+
+// Release every node made so far, in O(chunks),
+// and what was kept to parse lazy bodies.
+void parser_free_tree()
+{
+	arena_free(&tree_arena);
+	
+	xfree(typename_defs);
+	typename_defs = NULL;
+	parser_finit();
+}
+
+// Set while a thread parses with errors not to be reported yet:
+// they abandon the parse instead, see parser_file().
+static __thread jmp_buf *parser_abort;
+
+static void parser_fatal(const char *fmt, ...)
+{
+	if (parser_abort)
+		longjmp(*parser_abort, 1);
+	
+	char msg[256];
+	va_list args;
+	va_start(args, fmt);
+	vsnprintf(msg, sizeof(msg), fmt, args);
+	va_end(args);
+	
+	fatal("%s", msg);
+}
+
+// Parsing bodies later.
+//
+// A file can be parsed in order but for the bodies of function defs:
+// parser_skip_body() only finds where each one ends, by matching braces
+// over the token buffer, and leaves the function def with a lazy body.
+// Records are typenames from their definition on, and the bodies are
+// only parsed after all of the heads: typename_defs tells where each
+// record is defined, so that an earlier body does not take it for one.
+//
+// With parser_lazy_bodies, a body is parsed by parser_parse_body()
+// when a pass first asks for its vars or stmts, and never otherwise.
+// An error in a body is then only reported when it is parsed, after
+// any error in the heads.
+//
+// A large file is otherwise parsed in parallel. Threads parse the
+// bodies, each taking the next one nobody took yet, into an arena of
+// its own, and fill the function defs in. The tree is the same as when
+// parsed in order, lists in source order.
+//
+// The first error a thread meets may not be the first one in the file,
+// none are reported as met: the thread gives up its body, and the whole
+// file is then parsed again in order, which reports the first one.
+// Only warnings about string literals come out of order: they are
+// given as the bodies are skipped, before any error in the parse.
+typedef struct _parser_body_t {
+	tree_t fun;
+	bool failed;
+} parser_body_t, *pparser_body_t;
+
+static pparser_body_t bodies;
+static int n_bodies;
+static int cap_bodies;
+static int next_body;	// The next one to take, atomic.
+
+// Set while the heads are parsed.
+static bool skip_bodies;
+
+typedef struct _parser_worker_t {
+	pthread_t thread;
+	arena_t arena;	// The nodes it made.
+} parser_worker_t, *pparser_worker_t;
+
+// The number of threads parsing a large file: $JAVAC_PARSE_JOBS, or 1.
+// Bodies are parsed in parallel only when asked for, it has not been
+// shown to pay yet: the heads are parsed on their own first, and the
+// arenas of the workers are merged afterwards, serially.
+static int parser_jobs()
+{
+	const char *env = getenv("JAVAC_PARSE_JOBS");
+	int jobs = env ? atoi(env) : 1;
+	
+	return jobs > 0 ? jobs : 1;
+}
+
+// The translation unit, bodies skipped. NULL on an error.
+static tree_t parser_try_heads()
+{
+	jmp_buf env;
+	parser_abort = &env;
+	skip_bodies = true;
+	
+	if (setjmp(env)) {
+		parser_abort = NULL;
+		skip_bodies = false;
+		n_list_stack = n_frames = 0;
+		return NULL;
+	}
+	
+	tree_t tu = parser_translation_unit();
+	
+	parser_abort = NULL;
+	skip_bodies = false;
+	return tu;
+}
+
+// Returns false on an error.
+static bool parser_try_body(pparser_body_t body)
+{
+	jmp_buf env;
+	parser_abort = &env;
+	
+	if (setjmp(env)) {
+		parser_abort = NULL;
+		n_list_stack = n_frames = 0;
+		return false;
+	}
+	
+	parser_parse_body(body->fun);
+	
+	parser_abort = NULL;
+	return true;
+}
+
+static void parser_take_bodies()
+{
+	while (true) {
+		int i = __atomic_fetch_add(&next_body, 1, __ATOMIC_RELAXED);
+		if (i >= n_bodies)
+			break;
+		
+		bodies[i].failed = !parser_try_body(&bodies[i]);
+	}
+}
+
+static void *parser_body_worker(void *arg)
+{
+	pparser_worker_t worker = arg;
+	
+	parser_take_bodies();
+	
+	worker->arena = tree_arena;
+	parser_finit();
+	
+	return NULL;
+}
+
+static void parser_parse_bodies(int jobs)
+{
+	if (jobs > n_bodies)
+		jobs = n_bodies;
+	if (jobs < 1)
+		return;
+	
+	next_body = 0;
+	pparser_worker_t workers = xmalloc(jobs * sizeof(parser_worker_t));
+	memset(workers, 0, jobs * sizeof(parser_worker_t));
+	
+	int i;
+	for (i = 1; i < jobs; ++i) {
+		if (pthread_create(&workers[i].thread, NULL, parser_body_worker, &workers[i]))
+			fatal("cannot create parser thread");
+	}
+	
+	// This thread takes bodies too.
+	parser_take_bodies();
+	
+	for (i = 1; i < jobs; ++i) {
+		pthread_join(workers[i].thread, NULL);
+		arena_merge(&tree_arena, &workers[i].arena);
+	}
+	
+	xfree(workers);
 }
 
 tree_t parser_file()
@@ -69,15 +435,97 @@ tree_t parser_file()
 	printf("entering 'file'\n");
 #	endif
 	
-	return parser_translation_unit();
+	if (parser_syntax_only)
+		return parser_translation_unit();
+	
+	int jobs = parser_jobs();
+	if (jobs > lextoks.n_toks / PARSER_MIN_TOKENS)
+		jobs = lextoks.n_toks / PARSER_MIN_TOKENS;
+	
+	if (jobs <= 1 && !parser_lazy_bodies)
+		return parser_translation_unit();
+	
+	unsigned n_atoms = atom_count();
+	typename_defs = xmalloc((n_atoms ? n_atoms : 1) * sizeof(int));
+	unsigned i;
+	for (i = 0; i != n_atoms; ++i)
+		typename_defs[i] = INT_MAX;
+	
+	if (parser_lazy_bodies) {
+		// typename_defs is kept for the bodies.
+		skip_bodies = true;
+		tree_t tu = parser_translation_unit();
+		skip_bodies = false;
+		return tu;
+	}
+	
+	tree_t tu = parser_try_heads();
+	if (tu) {
+		parser_parse_bodies(jobs);
+		
+		int k;
+		for (k = 0; k != n_bodies; ++k) {
+			if (bodies[k].failed) {
+				tu = NULL;
+				break;
+			}
+		}
+	}
+	
+	xfree(bodies);
+	bodies = NULL;
+	n_bodies = cap_bodies = 0;
+	
+	if (!tu) {
+		// Again, in order, to report the first error.
+		lex_state_t start = { -1 };
+		lex_restore(&start);
+		tu = parser_translation_unit();
+	}
+	
+	xfree(typename_defs);
+	typename_defs = NULL;
+	
+	return tu;
+}
+
+void parser_visit_grow()
+{
+	tree_visits.cap = tree_visits.cap ? tree_visits.cap * 2 : 64;
+	tree_visits.visits = xrealloc(tree_visits.visits, tree_visits.cap * sizeof(tree_visit_t));
 }
 
+// Makes the visits on the stack, top first. The ones a visit pushes
+// are turned around to be made first to last, before those pushed
+// earlier, so the tree is walked in the same order as if the visits
+// called each other, however deep it is.
 void parser_visit_tree(tree_node_visitor_t *visitor, tree_t tree)
 {
 	assert(visitor);
 	assert(tree);
 	
-	visitor->visit_tree(visitor, tree, 0);
+	int base = tree_visits.n_visits;
+	parser_visit_push(visitor->visit_tree, tree, 0);
+	while (tree_visits.n_visits > base) {
+		tree_visit_t item = tree_visits.visits[--tree_visits.n_visits];
+		int top = tree_visits.n_visits;
+		item.visit(visitor, item.tree, item.depth);
+		
+		tree_visit_t *visits = tree_visits.visits;
+		int i = top;
+		int j = tree_visits.n_visits - 1;
+		for (; i < j; ++i, --j) {
+			tree_visit_t t = visits[i];
+			visits[i] = visits[j];
+			visits[j] = t;
+		}
+	}
+	
+	if (!base) {
+		xfree(tree_visits.visits);
+		tree_visits.visits = NULL;
+		tree_visits.cap = 0;
+	}
 }
 
 // translation_unit : external_decl
@@ -89,28 +537,26 @@ static tree_t parser_translation_unit()
 #	endif
 
 	if (parser_next_token_is_eof()) {
-		fatal("empty translation unit is not allowed");
+		parser_fatal("empty translation unit is not allowed");
 		return NULL;
 	}
 	
 	tree_t tu = TREE_ALLOC(tree_list_t);
 	TREE_NODE_KIND(tu) = NODE_KIND_LIST;
-	TREE_NODE_LNO(tu) = lineno;
+	TREE_NODE_OFFSET(tu) = srcpos;
 	TREE_LIST_KIND(tu) = LIST_KIND_TU;
 	
 	// Multiple external decls.
-	TREE_LIST(tu) = slist_create();
-	slist_iter_t iter;
-	slist_iter_begin(TREE_LIST(tu), &iter);
+	int base = parser_list_begin();
 	do {
 		tree_t edecl = parser_external_decl();
-		slist_insert(&iter, &edecl, sizeof(ptree_t));
-		
-		// Move to the end of the list to preserve the insertion sequence.
-		slist_iter_move_next(&iter);
+		parser_list_push(edecl);
 	} while (!parser_next_token_is_eof());
 	
-	return tu;
+	parser_list_freeze(tu, base);
+	
+	// Checking the syntax only, there is no tree to give.
+	return parser_syntax_only ? NULL : tu;
 }
 
 // external_decl : prototype_decl
@@ -122,16 +568,15 @@ static tree_t parser_external_decl()
 	printf("entering 'external decl'\n");
 #	endif
 	
-	lex_peek_token();
-	if (LATYPE_IS(TOKEN_TYPE_KEYWORD)) {
-		if (LATEXT_EQUALS("native"))
-			return parser_prototype_decl();
-		else if (LATEXT_EQUALS("record"))
-			return parser_record_def();
+	switch (parser_next_keyword()) {
+	case KEYWORD_NATIVE:
+		return parser_prototype_decl();
+	case KEYWORD_RECORD:
+		return parser_record_def();
+	default:
+		// function decl.
+		return parser_function_def();
 	}
-	
-	// function decl.
-	return parser_function_def();
 }
 
 // prototype_decl : NATIVE function_head SEMICOLON
@@ -141,17 +586,18 @@ static tree_t parser_prototype_decl()
 	printf("entering 'prototype decl'\n");
 #	endif
 	
-	parser_eat_next_token(TOKEN_TYPE_KEYWORD, "native");
+	parser_eat_next_token(KEYWORD_NATIVE);
 	
 	tree_t proto = TREE_ALLOC(tree_decl_t);
 	TREE_NODE_KIND(proto) = NODE_KIND_DECL;
-	TREE_NODE_LNO(proto) = lineno;
+	TREE_NODE_OFFSET(proto) = srcpos;
 	TREE_DECL_KIND(proto) = DECL_KIND_FUNCTION;
 	TREE_DECL_NATIVE(proto) = true;
+	TREE_DECL_LAZY(proto) = false;
 	
 	parser_function_head(proto);
 	
-	parser_eat_next_token(TOKEN_TYPE_KEYWORD, ";");
+	parser_eat_next_token(KEYWORD_SEMICOLON);
 	
 	return proto;
 }
@@ -165,26 +611,27 @@ static tree_t parser_record_def()
 	
 	tree_t rdef = TREE_ALLOC(tree_decl_t);
 	TREE_NODE_KIND(rdef) = NODE_KIND_DECL;
-	TREE_NODE_LNO(rdef) = lineno;
+	TREE_NODE_OFFSET(rdef) = srcpos;
 	TREE_DECL_KIND(rdef) = DECL_KIND_TYPENAME;
+	TREE_DECL_LAZY(rdef) = false;
 	
-	parser_eat_next_token(TOKEN_TYPE_KEYWORD, "record");
+	parser_eat_next_token(KEYWORD_RECORD);
 	
 	TREE_DECL_ID(rdef) = parser_id();
-	hashtab_insert(typetab, CURRTEXT(), NULL, 0);
-
-#	ifndef NDEBUG
-	assert(hashtab_lookup(typetab, CURRTEXT(), NULL, 0));
-#	endif
+	patom_t name = TREE_ID_ATOM(TREE_DECL_ID(rdef));
+	ATOM_SET_FLAGS(name, ATOM_FLAG_TYPENAME);
+	if (typename_defs && typename_defs[ATOM_ID(name)] > lexstate.pos)
+		typename_defs[ATOM_ID(name)] = lexstate.pos;
 	
-	parser_eat_next_token(TOKEN_TYPE_KEYWORD, "{");
+	parser_eat_next_token(KEYWORD_LBRACE);
 	
 	TREE_DECL_VARS(rdef) = parser_variable_decl_list();
 	
-	parser_eat_next_token(TOKEN_TYPE_KEYWORD, "}");
+	parser_eat_next_token(KEYWORD_RBRACE);
 	
 #	ifndef NDEBUG
-	printf("    record: %s\n", TREE_ID_NAME(TREE_DECL_ID(rdef)));
+	if (parser_printing())
+		printf("    record: %s\n", TREE_ID_NAME(TREE_DECL_ID(rdef)));
 #	endif
 
 	return rdef;
@@ -200,21 +647,130 @@ static tree_t parser_function_def()
 
 	tree_t fun = TREE_ALLOC(tree_decl_t);
 	TREE_NODE_KIND(fun) = NODE_KIND_DECL;
-	TREE_NODE_LNO(fun) = lineno;
+	TREE_NODE_OFFSET(fun) = srcpos;
 	TREE_DECL_KIND(fun) = DECL_KIND_FUNCTION;
 	TREE_DECL_NATIVE(fun) = false;
+	TREE_DECL_LAZY(fun) = false;
 	
 	parser_function_head(fun);
 	
-	parser_eat_next_token(TOKEN_TYPE_KEYWORD, "{");
+	if (skip_bodies)
+		parser_skip_body(fun);
+	else
+		parser_function_body(fun);
+	
+	return fun;
+}
+
+// The LBRACE variable_decl_list stmt_list RBRACE of a function def.
+static void parser_function_body(tree_t fun)
+{
+#	if !defined(NDEBUG) && PARSER_TRACE
+	printf("entering 'function body'\n");
+#	endif
+	
+	parser_eat_next_token(KEYWORD_LBRACE);
 	
 	TREE_DECL_VARS(fun) = parser_variable_decl_list();
 	
 	TREE_DECL_STMTS(fun) = parser_stmt_list();
 	
-	parser_eat_next_token(TOKEN_TYPE_KEYWORD, "}");
+	parser_eat_next_token(KEYWORD_RBRACE);
+}
+
+// Parses the body of a function def left lazy by parser_skip_body().
+// The cursor is put back where it was, a pass may call it any time.
+void parser_parse_body(tree_t fun)
+{
+	assert(TREE_DECL_LAZY(fun));
+	
+	lex_state_t saved;
+	lex_save(&saved);
+	lex_state_t start = { TREE_DECL_BODY(fun) };
+	lex_restore(&start);
 	
-	return fun;
+	TREE_DECL_LAZY(fun) = false;
+	parser_function_body(fun);
+	
+	lex_restore(&saved);
+}
+
+// Checks the syntax of every lazy body in tu, which all stay lazy:
+// each is parsed into a copy of its function def, for the syntax only,
+// and what was made for it is released.
+void parser_check_bodies(tree_t tu)
+{
+	bool syntax_only = parser_syntax_only;
+	parser_syntax_only = true;
+	
+	int i;
+	for (i = 0; i != TREE_LIST_COUNT(tu); ++i) {
+		tree_t decl = TREE_LIST_ITEM(tu, i);
+		if (TREE_DECL_KIND(decl) != DECL_KIND_FUNCTION || !TREE_DECL_LAZY(decl))
+			continue;
+		
+		arena_mark_t mark = arena_mark(&tree_arena);
+		tree_node_t fun = *decl;
+		parser_parse_body(&fun);
+		arena_release(&tree_arena, mark);
+	}
+	
+	parser_syntax_only = syntax_only;
+}
+
+// Leaves the body of fun lazy, and goes past it.
+// Bodies going to other threads have their string literals with
+// escapes decoded on the way: lex_token_string() must not be called
+// from them.
+static void parser_skip_body(tree_t fun)
+{
+	parser_eat_next_token(KEYWORD_LBRACE);
+	
+	TREE_DECL_VARS(fun) = NULL;
+	TREE_DECL_STMTS(fun) = NULL;
+	TREE_DECL_BODY(fun) = lexstate.pos - 1;
+	TREE_DECL_LAZY(fun) = true;
+	
+	if (!parser_lazy_bodies) {
+		if (n_bodies == cap_bodies) {
+			cap_bodies = cap_bodies ? cap_bodies * 2 : 64;
+			bodies = xrealloc(bodies, cap_bodies * sizeof(parser_body_t));
+		}
+		pparser_body_t body = &bodies[n_bodies++];
+		body->fun = fun;
+		body->failed = false;
+	}
+	
+	int i = lexstate.pos;
+	int depth = 1;
+	do {
+		switch (TOKTYPE(++i)) {
+		case TOKEN_TYPE_EOF:
+			if (parser_abort)
+				parser_fatal("unbalanced braces");
+			
+			// Parsed, the body tells what is wrong.
+			parser_parse_body(fun);
+			return;
+		case TOKEN_TYPE_KEYWORD:
+			if (TOKKW(i) == KEYWORD_LBRACE)
+				depth++;
+			else if (TOKKW(i) == KEYWORD_RBRACE)
+				depth--;
+			break;
+		case TOKEN_TYPE_STRING_CONST:
+			if (!parser_lazy_bodies) {
+				int len;
+				lex_token_string(i, &len);
+			}
+			break;
+		default:
+			break;
+		}
+	} while (depth);
+	
+	lex_state_t end = { i };
+	lex_restore(&end);
 }
 
 // function_head : type_specifier ID LPAREN parameter_list RPAREN
@@ -229,19 +785,21 @@ static void parser_function_head(tree_t decl)
 	
 	TREE_DECL_ID(decl) = parser_id();
 	
-	parser_eat_next_token(TOKEN_TYPE_KEYWORD, "(");
+	parser_eat_next_token(KEYWORD_LPAREN);
 	
-	if (parser_next_token_is(TOKEN_TYPE_KEYWORD, ")")) {
+	if (parser_next_token_is_keyword(KEYWORD_RPAREN)) {
 		lex_next_token();
 		TREE_DECL_PARAMS(decl) = NULL;
 	} else {
 		TREE_DECL_PARAMS(decl) = parser_parameter_list();
-		parser_eat_next_token(TOKEN_TYPE_KEYWORD, ")");
+		parser_eat_next_token(KEYWORD_RPAREN);
 	}
 	
 #	ifndef NDEBUG
-	printf("    fun: ");
-	_parser_print_fun(decl);
+	if (parser_printing()) {
+		printf("    fun: ");
+		_parser_print_fun(decl);
+	}
 #	endif
 }
 
@@ -255,21 +813,19 @@ static tree_t parser_variable_decl_list()
 	
 	tree_t vars = TREE_ALLOC(tree_list_t);
 	TREE_NODE_KIND(vars) = NODE_KIND_LIST;
-	TREE_NODE_LNO(vars) = lineno;
+	TREE_NODE_OFFSET(vars) = srcpos;
 	TREE_LIST_KIND(vars) = LIST_KIND_VARS;
 	
-	slist_iter_t iter;
-	TREE_LIST(vars) = slist_create();
-	slist_iter_begin(TREE_LIST(vars), &iter);
+	int base = parser_list_begin();
 	
 	// There must exist at least one local variable
 	// though it seems very strange?!?!
 	do {
 		tree_t var = parser_variable_decl();
-		slist_insert(&iter, &var, sizeof(ptree_t));
-		slist_iter_move_next(&iter); // Insert to the end.
+		parser_list_push(var);
 	} while (parser_next_token_indicates_typespec());
 	
+	parser_list_freeze(vars, base);
 	return vars;
 }
 
@@ -282,20 +838,18 @@ static tree_t parser_stmt_list() {
 	
 	tree_t stmts = TREE_ALLOC(tree_list_t);
 	TREE_NODE_KIND(stmts) = NODE_KIND_LIST;
-	TREE_NODE_LNO(stmts) = lineno;
+	TREE_NODE_OFFSET(stmts) = srcpos;
 	TREE_LIST_KIND(stmts) = LIST_KIND_STMTS;
 	
-	slist_iter_t iter;
-	TREE_LIST(stmts) = slist_create();
-	slist_iter_begin(TREE_LIST(stmts), &iter);
+	int base = parser_list_begin();
 	
 	// There must be at least one statement.
 	do {
 		tree_t stmt = parser_stmt();
-		slist_insert(&iter, &stmt, sizeof(ptree_t));
-		slist_iter_move_next(&iter); // Insert to the end.
-	} while (!parser_next_token_is(TOKEN_TYPE_KEYWORD, "}"));
+		parser_list_push(stmt);
+	} while (!parser_next_token_is_keyword(KEYWORD_RBRACE));
 	
+	parser_list_freeze(stmts, base);
 	return stmts;
 }
 
@@ -312,29 +866,35 @@ static tree_t parser_type_specifier()
 	
 	tree_t typespec = TREE_ALLOC(tree_typespec_t);
 	TREE_NODE_KIND(typespec) = NODE_KIND_TYPESPEC;
-	TREE_NODE_LNO(typespec) = lineno;
+	TREE_NODE_OFFSET(typespec) = srcpos;
 
-	if (parser_next_token_is(TOKEN_TYPE_KEYWORD, NULL)) {
+	if (parser_next_token_is(TOKEN_TYPE_KEYWORD)) {
 		lex_next_token();
 		
-		if (CURRTEXT_EQUALS("int"))
+		switch (CURRKW()) {
+		case KEYWORD_INT:
 			TREE_TYPESPEC_KIND(typespec) = TYPESPEC_INT;
-		else if (CURRTEXT_EQUALS("string"))
+			break;
+		case KEYWORD_STRING:
 			TREE_TYPESPEC_KIND(typespec) = TYPESPEC_STRING;
-		else if (CURRTEXT_EQUALS("char"))
+			break;
+		case KEYWORD_CHAR:
 			TREE_TYPESPEC_KIND(typespec) = TYPESPEC_CHAR;
-		else
-			fatal("unknown type specifier %s", CURRTEXT());
-	} else if (parser_next_token_is(TOKEN_TYPE_IDENTIFIER, NULL)) {
+			break;
+		default:
+			parser_fatal("unknown type specifier %s", lex_keyword_text(CURRKW()));
+			break;
+		}
+	} else if (parser_next_token_is(TOKEN_TYPE_IDENTIFIER)) {
 		TREE_TYPESPEC_KIND(typespec) = TYPESPEC_ID;
 		TREE_TYPESPEC_ID(typespec) = parser_id();
 	} else {
-		fatal("unknown type specifier");
+		parser_fatal("unknown type specifier");
 	}
 	
 	// Is it an array?
 	TREE_TYPESPEC_ARRAY(typespec) = false;
-	if (parser_next_token_is(TOKEN_TYPE_KEYWORD, "[")) {
+	if (parser_next_token_is_keyword(KEYWORD_LBRACKET)) {
 		TREE_TYPESPEC_ARRAY(typespec) = true;
 		TREE_TYPESPEC_DIM(typespec) = 0;
 		
@@ -344,7 +904,7 @@ static tree_t parser_type_specifier()
 			
 			// If meet '[expr]', we consume the '[' and left 'expr]'
 			// to 'primary'. (the current token is '[')
-			if (!parser_next_token_is(TOKEN_TYPE_KEYWORD, "]")) {
+			if (!parser_next_token_is_keyword(KEYWORD_RBRACKET)) {
 				// dim is zero:  new x[i], type is not array,
 				// dim is nonzero: new x[]...[i], type is array.
 				TREE_TYPESPEC_ARRAY(typespec) = (TREE_TYPESPEC_DIM(typespec) > 0);
@@ -355,13 +915,15 @@ static tree_t parser_type_specifier()
 			lex_next_token();
 
 			TREE_TYPESPEC_DIM(typespec)++;
-		} while (parser_next_token_is(TOKEN_TYPE_KEYWORD, "["));
+		} while (parser_next_token_is_keyword(KEYWORD_LBRACKET));
 	}
 	
 #	ifndef NDEBUG
-	printf("    type: ");
-	_parser_print_type(typespec);
-	printf("\n");
+	if (parser_printing()) {
+		printf("    type: ");
+		parser_print_type(typespec);
+		printf("\n");
+	}
 #	endif
 
 	return typespec;
@@ -377,26 +939,24 @@ static tree_t parser_parameter_list()
 	
 	tree_t params = TREE_ALLOC(tree_list_t);
 	TREE_NODE_KIND(params) = NODE_KIND_LIST;
-	TREE_NODE_LNO(params) = lineno;
+	TREE_NODE_OFFSET(params) = srcpos;
 	TREE_LIST_KIND(params) = LIST_KIND_PARAMS;
 	
-	slist_iter_t iter;
-	TREE_LIST(params) = slist_create();
-	slist_iter_begin(TREE_LIST(params), &iter);
+	int base = parser_list_begin();
 	
 	// There must exist at least one parameter.
 	while (true) {
 		tree_t param = parser_parameter_decl();
-		slist_insert(&iter, &param, sizeof(ptree_t));
-		slist_iter_move_next(&iter); // Insert to the end.
+		parser_list_push(param);
 		
-		if (!parser_next_token_is(TOKEN_TYPE_KEYWORD, ","))
+		if (!parser_next_token_is_keyword(KEYWORD_COMMA))
 			break;
 		
 		// Skip ','.
 		lex_next_token();
 	}
 	
+	parser_list_freeze(params, base);
 	return params;
 }
 
@@ -409,7 +969,7 @@ static tree_t parser_variable_decl()
 	
 	tree_t var = TREE_ALLOC(tree_decl_t);
 	TREE_NODE_KIND(var) = NODE_KIND_DECL;
-	TREE_NODE_LNO(var) = lineno;
+	TREE_NODE_OFFSET(var) = srcpos;
 	TREE_DECL_KIND(var) = DECL_KIND_VARIABLE;
 	TREE_DECL_PARAM(var) = false; // Not a parameter.
 	
@@ -420,15 +980,17 @@ static tree_t parser_variable_decl()
 	// This grammer was not defined in language specification,
 	// but appeared in queens.java.
 	// For example: int a, b;
-	if (parser_next_token_is(TOKEN_TYPE_KEYWORD, ","))
-		fatal("multiple variable definitions in one statement are not allowed");
+	if (parser_next_token_is_keyword(KEYWORD_COMMA))
+		parser_fatal("multiple variable definitions in one statement are not allowed");
 	
-	parser_eat_next_token(TOKEN_TYPE_KEYWORD, ";");
+	parser_eat_next_token(KEYWORD_SEMICOLON);
 	
 #	ifndef NDEBUG
-	printf("    var: ");
-	_parser_print_var(var);
-	printf("\n");
+	if (parser_printing()) {
+		printf("    var: ");
+		_parser_print_var(var);
+		printf("\n");
+	}
 #	endif
 	
 	return var;
@@ -443,7 +1005,7 @@ static tree_t parser_parameter_decl()
 	
 	tree_t param = TREE_ALLOC(tree_decl_t);
 	TREE_NODE_KIND(param) = NODE_KIND_DECL;
-	TREE_NODE_LNO(param) = lineno;
+	TREE_NODE_OFFSET(param) = srcpos;
 	TREE_DECL_KIND(param) = DECL_KIND_VARIABLE;
 	TREE_DECL_PARAM(param) = true;
 	
@@ -452,9 +1014,11 @@ static tree_t parser_parameter_decl()
 	TREE_DECL_ID(param) = parser_id();
 	
 #	ifndef NDEBUG
-	printf("    param: ");
-	_parser_print_param(param);
-	printf("\n");
+	if (parser_printing()) {
+		printf("    param: ");
+		_parser_print_param(param);
+		printf("\n");
+	}
 #	endif
 	
 	return param;
@@ -465,131 +1029,37 @@ static tree_t parser_parameter_decl()
 //      | selection_stmt
 //      | iteration_stmt
 //      | jump_stmt
+//
+// A stmt with stmts nested in it is parsed by a loop, not by
+// recursion: parser_stmt_begin() opens a frame for each stmt waiting
+// for a nested one, until one is complete, and parser_stmt_end()
+// hands that one to the frame on top, which is complete in turn or
+// waits for another.
 static tree_t parser_stmt()
 {
 #	if !defined(NDEBUG) && PARSER_TRACE
 	printf("entering 'stmt'\n");
 #	endif
 	
-	if (parser_next_token_is(TOKEN_TYPE_KEYWORD, "{"))
-		return parser_compound_stmt();
-	
-	if (parser_next_token_is(TOKEN_TYPE_KEYWORD, "if"))
-		return parser_selection_stmt();
-	
-	if (parser_next_token_is(TOKEN_TYPE_KEYWORD, "while") ||
-		parser_next_token_is(TOKEN_TYPE_KEYWORD, "for"))
-		return parser_iteration_stmt();
+	int base = n_frames;
+	tree_t stmt;
 	
-	if (parser_next_token_is(TOKEN_TYPE_KEYWORD, "return") ||
-		parser_next_token_is(TOKEN_TYPE_KEYWORD, "break") ||
-		parser_next_token_is(TOKEN_TYPE_KEYWORD, "continue"))
-		return parser_jump_stmt();
+	do {
+		while (!parser_stmt_begin(&stmt))
+			continue;
+		while (n_frames > base && parser_stmt_end(&stmt))
+			continue;
+	} while (n_frames > base);
 	
-	// Not one of above statements, assume it to be expression statement.
-	return parser_expr_stmt();
+	return stmt;
 }
 
 // compound_stmt : LBRACE stmt_list RBRACE
 //               | LBRACE           RBRACE
-static tree_t parser_compound_stmt()
-{
-#	if !defined(NDEBUG) && PARSER_TRACE
-	printf("entering 'compound stmt'\n");
-#	endif
-	
-	parser_eat_next_token(TOKEN_TYPE_KEYWORD, "{");
-	
-	if (parser_next_token_is(TOKEN_TYPE_KEYWORD, "}")) {
-		lex_next_token();
-		
-#		ifndef NDEBUG
-		printf("    compound stmt: empty\n");
-#		endif
-		
-		return NULL;
-	}
-	
-	tree_t compound = TREE_ALLOC(tree_stmt_t);
-	TREE_NODE_KIND(compound) = NODE_KIND_STMT;
-	TREE_STMT_KIND(compound) = STMT_KIND_COMPOUND;
-	TREE_NODE_LNO(compound) = lineno;
-	
-	TREE_STMT_BODY(compound) = parser_stmt_list();
-	
-	parser_eat_next_token(TOKEN_TYPE_KEYWORD, "}");
-	
-#	ifndef NDEBUG
-	printf("    compound stmt\n");
-#	endif
-	
-	return compound;
-}
-
-// expr_stmt : expr SEMICOLON
-static tree_t parser_expr_stmt()
-{
-#	if !defined(NDEBUG) && PARSER_TRACE
-	printf("entering 'expr stmt'\n");
-#	endif
-	
-	tree_t stmt = TREE_ALLOC(tree_stmt_t);
-	TREE_NODE_KIND(stmt) = NODE_KIND_STMT;
-	TREE_NODE_LNO(stmt) = lineno;
-	TREE_STMT_KIND(stmt) = STMT_KIND_EXPR;
-	
-	TREE_STMT_EXP(stmt) = parser_expr();
-	
-	parser_eat_next_token(TOKEN_TYPE_KEYWORD, ";");
-	
-#	ifndef NDEBUG
-	printf("    expr stmt\n");
-#	endif
-	
-	return stmt;
-}
-
+//
 // selection_stmt : IF LPAREN expr RPAREN stmt
 //                | IF LPAREN expr RPAREN stmt ELSE stmt
-static tree_t parser_selection_stmt()
-{
-#	if !defined(NDEBUG) && PARSER_TRACE
-	printf("entering 'selection stmt'\n");
-#	endif
-	
-	tree_t stmt = TREE_ALLOC(tree_stmt_t);
-	TREE_NODE_KIND(stmt) = NODE_KIND_STMT;
-	TREE_NODE_LNO(stmt) = lineno;
-	TREE_STMT_KIND(stmt) = STMT_KIND_IF;
-	
-#	ifndef NDEBUG
-	printf("    sel stmt: if\n");
-#	endif
-	
-	parser_eat_next_token(TOKEN_TYPE_KEYWORD, "if");
-	parser_eat_next_token(TOKEN_TYPE_KEYWORD, "(");
-	
-	TREE_STMT_EXP(stmt) = parser_expr();
-	
-	parser_eat_next_token(TOKEN_TYPE_KEYWORD, ")");
-	
-	TREE_IF_THEN(stmt) = parser_stmt();
-	
-	if (parser_next_token_is(TOKEN_TYPE_KEYWORD, "else")) {
-#		ifndef NDEBUG
-		printf("    sel stmt: else\n");
-#		endif
-		
-		lex_next_token();
-		
-		TREE_IF_ELSE(stmt) = parser_stmt();
-	} else {
-		TREE_IF_ELSE(stmt) = NULL;
-	}
-	
-	return stmt;
-}
-
+//
 // iteration_stmt : WHILE LPAREN expr RPAREN stmt
 //                | FOR LPAREN expr_stmt expr_stmt expr RPAREN stmt
 //                | FOR LPAREN expr_stmt expr_stmt      RPAREN stmt
@@ -599,74 +1069,222 @@ static tree_t parser_selection_stmt()
 //                | FOR LPAREN SEMICOLON expr_stmt      RPAREN stmt
 //                | FOR LPAREN SEMICOLON SEMICOLON expr RPAREN stmt
 //                | FOR LPAREN SEMICOLON SEMICOLON      RPAREN stmt
-static tree_t parser_iteration_stmt()
+//
+// Parses a stmt up to the first stmt nested in it, and opens a frame
+// for it. Returns true if there is none, with the stmt in *pstmt.
+static bool parser_stmt_begin(tree_t *pstmt)
 {
-#	if !defined(NDEBUG) && PARSER_TRACE
-	printf("entering 'iteration stmt'\n");
-#	endif
+	tree_t stmt;
 	
-	tree_t stmt = NULL;
-	
-	if (parser_next_token_is(TOKEN_TYPE_KEYWORD, "while")) {
-#		ifndef NDEBUG
-		printf("    iter stmt: while\n");
-#		endif
-		
-		lex_next_token();
+	switch (parser_next_keyword()) {
+	case KEYWORD_LBRACE:
+		parser_eat_next_token(KEYWORD_LBRACE);
 		
-		stmt = TREE_ALLOC(tree_stmt_t);
+		if (parser_next_token_is_keyword(KEYWORD_RBRACE)) {
+			lex_next_token();
+			
+#			ifndef NDEBUG
+			if (parser_printing())
+				printf("    compound stmt: empty\n");
+#			endif
+			
+			*pstmt = NULL;
+			return true;
+		}
+		
+		stmt = TREE_ALLOC(tree_stmt_t);
+		TREE_NODE_KIND(stmt) = NODE_KIND_STMT;
+		TREE_STMT_KIND(stmt) = STMT_KIND_COMPOUND;
+		TREE_NODE_OFFSET(stmt) = srcpos;
+		
+		tree_t stmts = TREE_ALLOC(tree_list_t);
+		TREE_NODE_KIND(stmts) = NODE_KIND_LIST;
+		TREE_NODE_OFFSET(stmts) = srcpos;
+		TREE_LIST_KIND(stmts) = LIST_KIND_STMTS;
+		TREE_STMT_BODY(stmt) = stmts;
+		
+		// There must be at least one statement.
+		parser_push_frame(PARSER_FRAME_STMTS, stmt)->base = parser_list_begin();
+		return false;
+		
+	case KEYWORD_IF:
+		stmt = TREE_ALLOC(tree_stmt_t);
+		TREE_NODE_KIND(stmt) = NODE_KIND_STMT;
+		TREE_NODE_OFFSET(stmt) = srcpos;
+		TREE_STMT_KIND(stmt) = STMT_KIND_IF;
+		
+#		ifndef NDEBUG
+		if (parser_printing())
+			printf("    sel stmt: if\n");
+#		endif
+		
+		parser_eat_next_token(KEYWORD_IF);
+		parser_eat_next_token(KEYWORD_LPAREN);
+		
+		TREE_STMT_EXP(stmt) = parser_expr();
+		
+		parser_eat_next_token(KEYWORD_RPAREN);
+		
+		parser_push_frame(PARSER_FRAME_IF_THEN, stmt);
+		return false;
+		
+	case KEYWORD_WHILE:
+#		ifndef NDEBUG
+		if (parser_printing())
+			printf("    iter stmt: while\n");
+#		endif
+		
+		lex_next_token();
+		
+		stmt = TREE_ALLOC(tree_stmt_t);
 		TREE_NODE_KIND(stmt) = NODE_KIND_STMT;
-		TREE_NODE_LNO(stmt) = lineno;
+		TREE_NODE_OFFSET(stmt) = srcpos;
 		TREE_STMT_KIND(stmt) = STMT_KIND_WHILE;
 		
-		parser_eat_next_token(TOKEN_TYPE_KEYWORD, "(");
+		parser_eat_next_token(KEYWORD_LPAREN);
 		
 		TREE_STMT_EXP(stmt) = parser_expr();
 		
-		parser_eat_next_token(TOKEN_TYPE_KEYWORD, ")");
+		parser_eat_next_token(KEYWORD_RPAREN);
 		
-		TREE_STMT_BODY(stmt) = parser_stmt();
+		parser_push_frame(PARSER_FRAME_BODY, stmt);
+		return false;
 		
-	} else if (parser_next_token_is(TOKEN_TYPE_KEYWORD, "for")) {
+	case KEYWORD_FOR:
 #		ifndef NDEBUG
-		printf("    iter stmt: for\n");
+		if (parser_printing())
+			printf("    iter stmt: for\n");
 #		endif
 		
 		lex_next_token();
 		
 		stmt = TREE_ALLOC(tree_stmt_t);
 		TREE_NODE_KIND(stmt) = NODE_KIND_STMT;
-		TREE_NODE_LNO(stmt) = lineno;
+		TREE_NODE_OFFSET(stmt) = srcpos;
 		TREE_STMT_KIND(stmt) = STMT_KIND_FOR;
 		
-		parser_eat_next_token(TOKEN_TYPE_KEYWORD, "(");
+		parser_eat_next_token(KEYWORD_LPAREN);
 		
-		if (parser_next_token_is(TOKEN_TYPE_KEYWORD, ";")) {
+		if (parser_next_token_is_keyword(KEYWORD_SEMICOLON)) {
 			lex_next_token();
 			
 			TREE_FOR_INIT(stmt) = NULL;
 		} else {
 			TREE_FOR_INIT(stmt) = parser_expr_stmt();
 		}
-			
-		if (parser_next_token_is(TOKEN_TYPE_KEYWORD, ";")) {
+		
+		if (parser_next_token_is_keyword(KEYWORD_SEMICOLON)) {
 			lex_next_token();
 			
 			TREE_STMT_EXP(stmt) = NULL;
 		} else {
 			TREE_STMT_EXP(stmt) = parser_expr_stmt();
 		}
-			
-		if (parser_next_token_is(TOKEN_TYPE_KEYWORD, ")")) {
+		
+		if (parser_next_token_is_keyword(KEYWORD_RPAREN)) {
 			TREE_FOR_INCR(stmt) = NULL;
 		} else {
 			TREE_FOR_INCR(stmt) = parser_expr();
 		}
 		
-		parser_eat_next_token(TOKEN_TYPE_KEYWORD, ")");
+		parser_eat_next_token(KEYWORD_RPAREN);
+		
+		parser_push_frame(PARSER_FRAME_BODY, stmt);
+		return false;
 		
-		TREE_STMT_BODY(stmt) = parser_stmt();
+	case KEYWORD_RETURN:
+	case KEYWORD_BREAK:
+	case KEYWORD_CONTINUE:
+		*pstmt = parser_jump_stmt();
+		return true;
+		
+	default:
+		// Not one of above statements, assume it to be expression statement.
+		*pstmt = parser_expr_stmt();
+		return true;
 	}
+}
+
+// Hands the stmt in *pstmt to the frame on top. Returns true if that
+// completes the stmt of the frame, which is then in *pstmt, and false
+// if the frame waits for one more stmt.
+static bool parser_stmt_end(tree_t *pstmt)
+{
+	pparser_frame_t frame = &frames[n_frames - 1];
+	tree_t stmt = frame->node;
+	
+	switch (frame->kind) {
+	case PARSER_FRAME_STMTS:
+		parser_list_push(*pstmt);
+		if (!parser_next_token_is_keyword(KEYWORD_RBRACE))
+			return false;
+		
+		parser_list_freeze(TREE_STMT_BODY(stmt), frame->base);
+		
+		parser_eat_next_token(KEYWORD_RBRACE);
+		
+#		ifndef NDEBUG
+		if (parser_printing())
+			printf("    compound stmt\n");
+#		endif
+		break;
+		
+	case PARSER_FRAME_IF_THEN:
+		TREE_IF_THEN(stmt) = *pstmt;
+		
+		if (parser_next_token_is_keyword(KEYWORD_ELSE)) {
+#			ifndef NDEBUG
+			if (parser_printing())
+				printf("    sel stmt: else\n");
+#			endif
+			
+			lex_next_token();
+			
+			frame->kind = PARSER_FRAME_IF_ELSE;
+			return false;
+		}
+		
+		TREE_IF_ELSE(stmt) = NULL;
+		break;
+		
+	case PARSER_FRAME_IF_ELSE:
+		TREE_IF_ELSE(stmt) = *pstmt;
+		break;
+		
+	case PARSER_FRAME_BODY:
+		TREE_STMT_BODY(stmt) = *pstmt;
+		break;
+		
+	default:
+		assert(false);
+		break;
+	}
+	
+	n_frames--;
+	*pstmt = stmt;
+	return true;
+}
+
+// expr_stmt : expr SEMICOLON
+static tree_t parser_expr_stmt()
+{
+#	if !defined(NDEBUG) && PARSER_TRACE
+	printf("entering 'expr stmt'\n");
+#	endif
+	
+	tree_t stmt = TREE_ALLOC(tree_stmt_t);
+	TREE_NODE_KIND(stmt) = NODE_KIND_STMT;
+	TREE_NODE_OFFSET(stmt) = srcpos;
+	TREE_STMT_KIND(stmt) = STMT_KIND_EXPR;
+	
+	TREE_STMT_EXP(stmt) = parser_expr();
+	
+	parser_eat_next_token(KEYWORD_SEMICOLON);
+	
+#	ifndef NDEBUG
+	if (parser_printing())
+		printf("    expr stmt\n");
+#	endif
 	
 	return stmt;
 }
@@ -682,28 +1300,31 @@ static tree_t parser_jump_stmt()
 	
 	tree_t stmt = TREE_ALLOC(tree_stmt_t);
 	TREE_NODE_KIND(stmt) = NODE_KIND_STMT;
-	TREE_NODE_LNO(stmt) = lineno;
+	TREE_NODE_OFFSET(stmt) = srcpos;
 	
-	if (parser_next_token_is(TOKEN_TYPE_KEYWORD, "return")) {
+	if (parser_next_token_is_keyword(KEYWORD_RETURN)) {
 #		ifndef NDEBUG
-		printf("    jump stmt: return\n");
+		if (parser_printing())
+			printf("    jump stmt: return\n");
 #		endif
 		
 		lex_next_token();
 		
 		TREE_STMT_KIND(stmt) = STMT_KIND_RETURN;
 		TREE_STMT_EXP(stmt) = parser_expr();
-	} else if (parser_next_token_is(TOKEN_TYPE_KEYWORD, "break")) {
+	} else if (parser_next_token_is_keyword(KEYWORD_BREAK)) {
 #		ifndef NDEBUG
-		printf("    jump stmt: break\n");
+		if (parser_printing())
+			printf("    jump stmt: break\n");
 #		endif
 		
 		lex_next_token();
 		
 		TREE_STMT_KIND(stmt) = STMT_KIND_BREAK;
-	} else if (parser_next_token_is(TOKEN_TYPE_KEYWORD, "continue")) {
+	} else if (parser_next_token_is_keyword(KEYWORD_CONTINUE)) {
 #		ifndef NDEBUG
-		printf("    jump stmt: continue\n");
+		if (parser_printing())
+			printf("    jump stmt: continue\n");
 #		endif
 		
 		lex_next_token();
@@ -711,165 +1332,263 @@ static tree_t parser_jump_stmt()
 		TREE_STMT_KIND(stmt) = STMT_KIND_CONTINUE;
 	}
 	
-	parser_eat_next_token(TOKEN_TYPE_KEYWORD, ";");
+	parser_eat_next_token(KEYWORD_SEMICOLON);
 	
 	return stmt;
 }
 
 // expr : assignment_expr
 // expr : expr COMMA assignment_expr
+//
+// Parsed by a loop like stmts are, see parser_stmt(): a frame is
+// opened for each expr waiting for one nested in it, and every
+// nested expr begins with a unary expr. parser_unary_begin() parses
+// up to the end of one, and parser_exp_end() hands what is complete
+// to the frame on top.
 static tree_t parser_expr()
 {
 #	if !defined(NDEBUG) && PARSER_TRACE
 	printf("entering 'expr'\n");
 #	endif
 	
+	int base = n_frames;
+	tree_t exp;
+	
+	parser_expr_begin();
+	do {
+		while (!parser_unary_begin(&exp))
+			continue;
+		while (n_frames > base && parser_exp_end(&exp))
+			continue;
+	} while (n_frames > base);
+	
+	return exp;
+}
+
+// Opens the frames of an expr and of its first assignment expr.
+static void parser_expr_begin()
+{
 	tree_t expr = TREE_ALLOC(tree_list_t);
 	TREE_NODE_KIND(expr) = NODE_KIND_LIST;
-	TREE_NODE_LNO(expr) = lineno;
+	TREE_NODE_OFFSET(expr) = srcpos;
 	TREE_LIST_KIND(expr) = LIST_KIND_EXPR;
 	
-	slist_iter_t iter;
-	TREE_LIST(expr) = slist_create();
-	slist_iter_begin(TREE_LIST(expr), &iter);
-	
 	// There must be at least one assignment expr.
-	while (true) {
-		tree_t assgn = parser_assignment_expr();
-
-		slist_insert(&iter, &assgn, sizeof(ptree_t));
-		slist_iter_move_next(&iter); // Insert to the end.
-		
-		if (!parser_next_token_is(TOKEN_TYPE_KEYWORD, ","))
-			break;
-		
-#		ifndef NDEBUG
-		printf("    op: ,\n");
-#		endif
-		
-		lex_next_token();
-	}
-	
-	return expr;
+	parser_push_frame(PARSER_FRAME_EXPR, expr)->base = parser_list_begin();
+	parser_push_frame(PARSER_FRAME_ASSIGN, NULL);
 }
 
-// assignment_expr : logical_or_expr
+// assignment_expr : binary_expr
 // assignment_expr : unary_expr ASSIGN assignment_expr
-static tree_t parser_assignment_expr()
+//
+// Hands the expr in *pexp to the frame on top. Returns true if that
+// completes the expr of the frame, which is then in *pexp, and false
+// if a frame waits for a unary expr.
+static bool parser_exp_end(tree_t *pexp)
 {
-#	if !defined(NDEBUG) && PARSER_TRACE
-	printf("entering 'assignment expr'\n");
-#	endif
-	
-	tree_t unary = parser_unary_expr(NULL);
+	pparser_frame_t frame = &frames[n_frames - 1];
+	tree_t exp = frame->node;
+	int keyword;
+	int min_prec;
 	
-	if (parser_next_token_is(TOKEN_TYPE_KEYWORD, "=")) {
-#		ifndef NDEBUG
-		printf("    op: =\n");
-#		endif
+	switch (frame->kind) {
+	case PARSER_FRAME_EXPR:
+		parser_list_push(*pexp);
 		
-		lex_next_token();
+		if (parser_next_token_is_keyword(KEYWORD_COMMA)) {
+#			ifndef NDEBUG
+			if (parser_printing())
+				printf("    op: ,\n");
+#			endif
+			
+			lex_next_token();
+			
+			parser_push_frame(PARSER_FRAME_ASSIGN, NULL);
+			return false;
+		}
 		
-		tree_t exp = TREE_ALLOC(tree_exp_t);
-		TREE_NODE_KIND(exp) = NODE_KIND_EXP;
-		TREE_NODE_LNO(exp) = lineno;
-		TREE_EXP_OP(exp) = EXP_OP_ASSIGNMENT;
+		parser_list_freeze(exp, frame->base);
+		break;
+		
+	case PARSER_FRAME_ASSIGN:
+		// Both start with a unary expr, which is the one in *pexp.
+		// It is the left side of ASSIGN or the leftmost operand.
+		if (parser_next_token_is_keyword(KEYWORD_ASSIGN)) {
+#			ifndef NDEBUG
+			if (parser_printing())
+				printf("    op: =\n");
+#			endif
+			
+			lex_next_token();
+			
+			exp = TREE_ALLOC(tree_exp_t);
+			TREE_NODE_KIND(exp) = NODE_KIND_EXP;
+			TREE_NODE_OFFSET(exp) = srcpos;
+			TREE_EXP_OP(exp) = EXP_OP_ASSIGNMENT;
+			
+			TREE_EXP_FIRST(exp) = *pexp;
+			
+			frame->kind = PARSER_FRAME_ASSIGN_RHS;
+			frame->node = exp;
+			parser_push_frame(PARSER_FRAME_ASSIGN, NULL);
+			return false;
+		}
+		
+		n_frames--;
+		return parser_binary_begin(pexp, PARSER_PREC_LOWEST);
+		
+	case PARSER_FRAME_ASSIGN_RHS:
+		TREE_EXP_SECOND(exp) = *pexp;
+		break;
+		
+	case PARSER_FRAME_UNARY:
+		TREE_EXP_FIRST(exp) = *pexp;
+		break;
+		
+	case PARSER_FRAME_BINARY:
+		// The right operand takes in every operator binding tighter.
+		keyword = parser_next_keyword();
+		if (keyword != KEYWORD_NONE && parser_binops[keyword].prec > frame->prec)
+			return parser_binary_begin(pexp, frame->prec + 1);
+		
+		TREE_EXP_SECOND(exp) = *pexp;
+		
+		min_prec = frame->min_prec;
+		n_frames--;
+		*pexp = exp;
+		return parser_binary_begin(pexp, min_prec);
+		
+	case PARSER_FRAME_PAREN:
+		parser_eat_next_token(KEYWORD_RPAREN);
+		
+		n_frames--;
+		return parser_postfix(pexp);
 		
-		TREE_EXP_FIRST(exp) = unary;
+	case PARSER_FRAME_CALL:
+		TREE_EXP_SECOND(exp) = *pexp;
 		
-		TREE_EXP_SECOND(exp) = parser_assignment_expr();
+		parser_eat_next_token(KEYWORD_RPAREN);
 		
-		return exp;
+		n_frames--;
+		*pexp = exp;
+		return parser_postfix(pexp);
+		
+	case PARSER_FRAME_INDEX:
+	case PARSER_FRAME_NEW:
+		TREE_EXP_SECOND(exp) = *pexp;
+		
+		parser_eat_next_token(KEYWORD_RBRACKET);
+		
+		n_frames--;
+		*pexp = exp;
+		return parser_postfix(pexp);
+		
+	default:
+		assert(false);
+		break;
 	}
 	
-	return parser_logical_or_expr(unary);
+	n_frames--;
+	*pexp = exp;
+	return true;
 }
 
 // unary_expr : postfix
 // unary_expr : PLUS  unary_expr
 //            | MINUS unary_expr
 //            | NOT   unary_expr
-static tree_t parser_unary_expr(tree_t unary_subst)
+//
+// Parses a unary expr up to the first expr nested in it, and opens
+// a frame for it. Returns true if there is none, with the unary expr
+// in *pexp.
+static bool parser_unary_begin(tree_t *pexp)
 {
 #	if !defined(NDEBUG) && PARSER_TRACE
 	printf("entering 'unary expr'\n");
 #	endif
-
-	if (unary_subst)
-		return unary_subst;
-	
-	tree_t exp = TREE_ALLOC(tree_exp_t);
-	TREE_NODE_KIND(exp) = NODE_KIND_EXP;
-	TREE_NODE_LNO(exp) = lineno;
 	
-	if (parser_next_token_is(TOKEN_TYPE_KEYWORD, "+")) {
+	int op;
+	switch (parser_next_keyword()) {
+	case KEYWORD_PLUS:
+		op = EXP_OP_U_PLUS;
 #		ifndef NDEBUG
-		printf("    op: +u\n");
+		if (parser_printing())
+			printf("    op: +u\n");
 #		endif
-		
-		lex_next_token();
-		
-		TREE_EXP_OP(exp) = EXP_OP_U_PLUS;
-		TREE_EXP_FIRST(exp) = parser_unary_expr(NULL);
-		return exp;
-	}
-	
-	if (parser_next_token_is(TOKEN_TYPE_KEYWORD, "-")) {
+		break;
+	case KEYWORD_MINUS:
+		op = EXP_OP_U_MINUS;
 #		ifndef NDEBUG
-		printf("    op: -u\n");
+		if (parser_printing())
+			printf("    op: -u\n");
 #		endif
-		
-		lex_next_token();
-		
-		TREE_EXP_OP(exp) = EXP_OP_U_MINUS;
-		TREE_EXP_FIRST(exp) = parser_unary_expr(NULL);
-		return exp;
-	}
-	
-	if (parser_next_token_is(TOKEN_TYPE_KEYWORD, "!")) {
+		break;
+	case KEYWORD_NOT:
+		op = EXP_OP_NOT;
 #		ifndef NDEBUG
-		printf("    op: !\n");
+		if (parser_printing())
+			printf("    op: !\n");
 #		endif
-		
-		lex_next_token();
-		
-		TREE_EXP_OP(exp) = EXP_OP_NOT;
-		TREE_EXP_FIRST(exp) = parser_unary_expr(NULL);
-		return exp;
+		break;
+	default:
+		return parser_primary_begin(pexp) && parser_postfix(pexp);
 	}
 	
-	return parser_postfix();
+	lex_next_token();
+	
+	tree_t exp = TREE_ALLOC(tree_exp_t);
+	TREE_NODE_KIND(exp) = NODE_KIND_EXP;
+	TREE_NODE_OFFSET(exp) = srcpos;
+	TREE_EXP_OP(exp) = op;
+	
+	parser_push_frame(PARSER_FRAME_UNARY, exp);
+	return false;
 }
 
-// logical_or_expr : logical_and_expr
-// logical_or_expr : logical_or_expr OR logical_and_expr
-static tree_t parser_logical_or_expr(tree_t unary_subst)
+// binary_expr : unary_expr
+// binary_expr : binary_expr binop binary_expr
+//
+// The binary operators, loosest first, all left associative:
+//     OR
+//     AND
+//     EQ NEQ
+//     LESS LESS_EQ GREATER GREATER_EQ
+//     PLUS MINUS
+//     MULTIPLY DIVIDE MODULO
+//
+// Parsed by precedence climbing over parser_binops: *pexp is the
+// operand on the left, and if the next operator binds at least as
+// tightly as min_prec, it is taken and a frame is opened for its
+// right operand. Returns true otherwise, when *pexp is complete.
+static bool parser_binary_begin(tree_t *pexp, int min_prec)
 {
-#	if !defined(NDEBUG) && PARSER_TRACE
-	printf("entering 'logical or expr'\n");
+	int keyword = parser_next_keyword();
+	if (keyword == KEYWORD_NONE)
+		return true;
+	
+	// Other keywords have precedence 0, which ends it as well.
+	int prec = parser_binops[keyword].prec;
+	if (prec < min_prec)
+		return true;
+	
+#	ifndef NDEBUG
+	if (parser_printing())
+		printf("    op: %s\n", lex_keyword_text(keyword));
 #	endif
 	
-	tree_t exp = parser_logical_and_expr(unary_subst);
+	lex_next_token();
 	
-	while (parser_next_token_is(TOKEN_TYPE_KEYWORD, "||")) {
-#		ifndef NDEBUG
-		printf("    op: ||\n");
-#		endif
-		
-		lex_next_token();
-		
-		tree_t new_exp = TREE_ALLOC(tree_exp_t);
-		TREE_NODE_KIND(new_exp) = NODE_KIND_EXP;
-		TREE_NODE_LNO(new_exp) = lineno;
-		TREE_EXP_OP(new_exp) = EXP_OP_LOGICAL_OR;
-		
-		TREE_EXP_FIRST(new_exp) = exp;
-		exp = new_exp;
-		
-		TREE_EXP_SECOND(new_exp) = parser_logical_and_expr(NULL);
-	}
+	tree_t exp = TREE_ALLOC(tree_exp_t);
+	TREE_NODE_KIND(exp) = NODE_KIND_EXP;
+	TREE_NODE_OFFSET(exp) = srcpos;
+	TREE_EXP_OP(exp) = parser_binops[keyword].op;
 	
-	return exp;
+	TREE_EXP_FIRST(exp) = *pexp;
+	
+	pparser_frame_t frame = parser_push_frame(PARSER_FRAME_BINARY, exp);
+	frame->prec = prec;
+	frame->min_prec = min_prec;
+	return false;
 }
 
 // postfix : primary
@@ -877,32 +1596,33 @@ static tree_t parser_logical_or_expr(tree_t unary_subst)
 //         | postfix LPAREN expr RPAREN
 //         | postfix LPAREN      RPAREN
 //         | postfix DOT ID
-static tree_t parser_postfix()
+//
+// Applies the postfix operators after the postfix in *pexp, and
+// opens a frame for the first expr nested in them. Returns true if
+// there is none, with the postfix in *pexp.
+static bool parser_postfix(tree_t *pexp)
 {
-#	if !defined(NDEBUG) && PARSER_TRACE
-	printf("entering 'postfix'\n");
-#	endif
-	
-	tree_t exp = parser_primary();
 	tree_t new_exp;
 	
 	while (true) {
-		if (parser_next_token_is(TOKEN_TYPE_KEYWORD, "(")) {
+		switch (parser_next_keyword()) {
+		case KEYWORD_LPAREN:
 #			ifndef NDEBUG
-			printf("    op: ()\n");
+			if (parser_printing())
+				printf("    op: ()\n");
 #			endif
 			
 			lex_next_token();
 			
 			new_exp = TREE_ALLOC(tree_exp_t);
 			TREE_NODE_KIND(new_exp) = NODE_KIND_EXP;
-			TREE_NODE_LNO(new_exp) = lineno;
+			TREE_NODE_OFFSET(new_exp) = srcpos;
 			TREE_EXP_OP(new_exp) = EXP_OP_CALL;
 			
-			TREE_EXP_FIRST(new_exp) = exp;
-			exp = new_exp;
+			TREE_EXP_FIRST(new_exp) = *pexp;
+			*pexp = new_exp;
 			
-			if (parser_next_token_is(TOKEN_TYPE_KEYWORD, ")")) {
+			if (parser_next_token_is_keyword(KEYWORD_RPAREN)) {
 				lex_next_token();
 				
 				TREE_EXP_SECOND(new_exp) = NULL;
@@ -910,59 +1630,53 @@ static tree_t parser_postfix()
 				continue;
 			}
 			
-			TREE_EXP_SECOND(new_exp) = parser_expr();
-			
-			parser_eat_next_token(TOKEN_TYPE_KEYWORD, ")");
+			parser_push_frame(PARSER_FRAME_CALL, new_exp);
+			parser_expr_begin();
+			return false;
 			
-			continue;
-		}
-		
-		if (parser_next_token_is(TOKEN_TYPE_KEYWORD, "[")) {
+		case KEYWORD_LBRACKET:
 #			ifndef NDEBUG
-			printf("    op: []\n");
+			if (parser_printing())
+				printf("    op: []\n");
 #			endif
 			
 			lex_next_token();
 			
 			new_exp = TREE_ALLOC(tree_exp_t);
 			TREE_NODE_KIND(new_exp) = NODE_KIND_EXP;
-			TREE_NODE_LNO(new_exp) = lineno;
+			TREE_NODE_OFFSET(new_exp) = srcpos;
 			TREE_EXP_OP(new_exp) = EXP_OP_INDEX;
 			
-			TREE_EXP_FIRST(new_exp) = exp;
-			exp = new_exp;
-			
-			TREE_EXP_SECOND(new_exp) = parser_expr();
+			TREE_EXP_FIRST(new_exp) = *pexp;
+			*pexp = new_exp;
 			
-			parser_eat_next_token(TOKEN_TYPE_KEYWORD, "]");
+			parser_push_frame(PARSER_FRAME_INDEX, new_exp);
+			parser_expr_begin();
+			return false;
 			
-			continue;
-		}
-		
-		if (parser_next_token_is(TOKEN_TYPE_KEYWORD, ".")) {
+		case KEYWORD_DOT:
 #			ifndef NDEBUG
-			printf("    op: .\n");
+			if (parser_printing())
+				printf("    op: .\n");
 #			endif
 			
 			lex_next_token();
 			
 			new_exp = TREE_ALLOC(tree_exp_t);
 			TREE_NODE_KIND(new_exp) = NODE_KIND_EXP;
-			TREE_NODE_LNO(new_exp) = lineno;
+			TREE_NODE_OFFSET(new_exp) = srcpos;
 			TREE_EXP_OP(new_exp) = EXP_OP_DOT;
 			
-			TREE_EXP_FIRST(new_exp) = exp;
-			exp = new_exp;
+			TREE_EXP_FIRST(new_exp) = *pexp;
+			*pexp = new_exp;
 			
 			TREE_EXP_SECOND(new_exp) = parser_id();
 			
 			continue;
 		}
 		
-		break;
+		return true;
 	}
-
-	return exp;
 }
 
 // primary : ID
@@ -973,47 +1687,58 @@ static tree_t parser_postfix()
 //         | LPAREN expr RPAREN
 //         | NEW type_specifier LBRACKET expr RBRACKET
 //         | NEW ID
-static tree_t parser_primary()
+//
+// Parses a primary up to the expr nested in it, and opens a frame
+// for it. Returns true if there is none, with the primary in *pexp.
+static bool parser_primary_begin(tree_t *pexp)
 {
 #	if !defined(NDEBUG) && PARSER_TRACE
 	printf("entering 'primary'\n");
 #	endif
 	
-	if (parser_next_token_is(TOKEN_TYPE_IDENTIFIER, NULL))
-		return parser_id();
-	
-	if (parser_next_token_is(TOKEN_TYPE_INT_CONST, NULL))
-		return parser_int_const();
-	
-	if (parser_next_token_is(TOKEN_TYPE_CHAR_CONST, NULL))
-		return parser_char_const();
-	
-	if (parser_next_token_is(TOKEN_TYPE_STRING_CONST, NULL))
-		return parser_string_const();
+	lex_peek_token();
+	if (LAEOF())
+		parser_fatal("primary expression expected");
 	
-	if (parser_next_token_is(TOKEN_TYPE_KEYWORD, "null"))
-		return parser_null();
+	switch (LATYPE()) {
+	case TOKEN_TYPE_IDENTIFIER:
+		*pexp = parser_id();
+		return true;
+	case TOKEN_TYPE_INT_CONST:
+		*pexp = parser_int_const();
+		return true;
+	case TOKEN_TYPE_CHAR_CONST:
+		*pexp = parser_char_const();
+		return true;
+	case TOKEN_TYPE_STRING_CONST:
+		*pexp = parser_string_const();
+		return true;
+	}
 	
-	if (parser_next_token_is(TOKEN_TYPE_KEYWORD, "(")) {
-		lex_next_token();
-		
-		tree_t exp = parser_expr();
+	switch (LAKW()) {
+	case KEYWORD_NULL:
+		*pexp = parser_null();
+		return true;
 		
-		parser_eat_next_token(TOKEN_TYPE_KEYWORD, ")");
+	case KEYWORD_LPAREN:
+		lex_next_token();
 		
-		return exp;
-	}
+		parser_push_frame(PARSER_FRAME_PAREN, NULL);
+		parser_expr_begin();
+		return false;
 	
-	if (parser_next_token_is(TOKEN_TYPE_KEYWORD, "new")) {
+	case KEYWORD_NEW:
+	{
 #		ifndef NDEBUG
-		printf("    op: new\n");
+		if (parser_printing())
+			printf("    op: new\n");
 #		endif
 		
 		lex_next_token();
 		
 		tree_t exp = TREE_ALLOC(tree_exp_t);
 		TREE_NODE_KIND(exp) = NODE_KIND_EXP;
-		TREE_NODE_LNO(exp) = lineno;
+		TREE_NODE_OFFSET(exp) = srcpos;
 		TREE_EXP_OP(exp) = EXP_OP_NEW;
 		
 		TREE_EXP_FIRST(exp) = parser_type_specifier();
@@ -1023,398 +1748,75 @@ static tree_t parser_primary()
 		case TYPESPEC_CHAR:
 		case TYPESPEC_INT:
 		case TYPESPEC_STRING:
-			parser_current_token_should_be(TOKEN_TYPE_KEYWORD, "[");
-			TREE_EXP_SECOND(exp) = parser_expr();
-			parser_eat_next_token(TOKEN_TYPE_KEYWORD, "]");
+			parser_current_token_should_be_keyword(KEYWORD_LBRACKET);
 			break;
 		case TYPESPEC_ID:
-			if (parser_current_token_is(TOKEN_TYPE_KEYWORD, "[")) {
-				TREE_EXP_SECOND(exp) = parser_expr();
-				parser_eat_next_token(TOKEN_TYPE_KEYWORD, "]");
-			} else {
-				TREE_EXP_SECOND(exp) = NULL;
-			}
-			break;
+			if (parser_current_token_is_keyword(KEYWORD_LBRACKET))
+				break;
+			
+			TREE_EXP_SECOND(exp) = NULL;
+			*pexp = exp;
+			return true;
 		default:
 			assert(false);
 			break;
 		}
 		
-		return exp;
+		// The dimension.
+		parser_push_frame(PARSER_FRAME_NEW, exp);
+		parser_expr_begin();
+		return false;
 	}
-
-	fatal("primary expression expected");
-	
-	return NULL;
-}
-
-// logical_and_expr : equality_expr
-// logical_and_expr : logical_and_expr AND equality_expr
-static tree_t parser_logical_and_expr(tree_t unary_subst)
-{
-#	if !defined(NDEBUG) && PARSER_TRACE
-	printf("entering 'logical and expr'\n");
-#	endif
-	
-	tree_t exp = parser_equality_expr(unary_subst);
-	
-	while (parser_next_token_is(TOKEN_TYPE_KEYWORD, "&&")) {
-#		ifndef NDEBUG
-		printf("    op: &&\n");
-#		endif
-		
-		lex_next_token();
-		
-		tree_t new_exp = TREE_ALLOC(tree_exp_t);
-		TREE_NODE_KIND(new_exp) = NODE_KIND_EXP;
-		TREE_NODE_LNO(new_exp) = lineno;
-		TREE_EXP_OP(new_exp) = EXP_OP_LOGICAL_AND;
-		
-		TREE_EXP_FIRST(new_exp) = exp;
-		exp = new_exp;
-		
-		TREE_EXP_SECOND(new_exp) = parser_equality_expr(NULL);
 	}
-	
-	return exp;
-}
 
-// equality_expr : relational_expr
-// equality_expr : equality_expr EQ  relational_expr
-//               | equality_expr NEQ relational_expr
-static tree_t parser_equality_expr(tree_t unary_subst)
-{
-#	if !defined(NDEBUG) && PARSER_TRACE
-	printf("entering 'equality expr'\n");
-#	endif
+	parser_fatal("primary expression expected");
 	
-	tree_t exp = parser_relational_expr(unary_subst);
-	
-	while (true) {
-		if (parser_next_token_is(TOKEN_TYPE_KEYWORD, "==")) {
-#			ifndef NDEBUG
-			printf("    op: ==\n");
-#			endif
-			
-			lex_next_token();
-			
-			tree_t new_exp = TREE_ALLOC(tree_exp_t);
-			TREE_NODE_KIND(new_exp) = NODE_KIND_EXP;
-			TREE_NODE_LNO(new_exp) = lineno;
-			TREE_EXP_OP(new_exp) = EXP_OP_EQ;
-			
-			TREE_EXP_FIRST(new_exp) = exp;
-			exp = new_exp;
-			
-			TREE_EXP_SECOND(new_exp) = parser_relational_expr(NULL);
-			
-			continue;
-		}
-		
-		if (parser_next_token_is(TOKEN_TYPE_KEYWORD, "!=")) {
-#			ifndef NDEBUG
-			printf("    op: !=\n");
-#			endif
-			
-			lex_next_token();
-			
-			tree_t new_exp = TREE_ALLOC(tree_exp_t);
-			TREE_NODE_KIND(new_exp) = NODE_KIND_EXP;
-			TREE_NODE_LNO(new_exp) = lineno;
-			TREE_EXP_OP(new_exp) = EXP_OP_NEQ;
-			
-			TREE_EXP_FIRST(new_exp) = exp;
-			exp = new_exp;
-			
-			TREE_EXP_SECOND(new_exp) = parser_relational_expr(NULL);
-			
-			continue;
-		}
-		
-		break;
-	}
-	
-	return exp;
+	return false;
 }
 
-// relational_expr : additive_expr
-// relational_expr : relational_expr LESS       additive_expr
-//                 | relational_expr LESS_EQ    additive_expr
-//                 | relational_expr GREATER    additive_expr
-//                 | relational_expr GREATER_EQ additive_expr
-static tree_t parser_relational_expr(tree_t unary_subst)
+static bool parser_next_token_is_eof()
 {
-#	if !defined(NDEBUG) && PARSER_TRACE
-	printf("entering 'relational expr'\n");
-#	endif
-	
-	tree_t exp = parser_additive_expr(unary_subst);
-	
-	while (true) {
-		if (parser_next_token_is(TOKEN_TYPE_KEYWORD, "<")) {
-#			ifndef NDEBUG
-			printf("    op: <\n");
-#			endif
-			
-			lex_next_token();
-			
-			tree_t new_exp = TREE_ALLOC(tree_exp_t);
-			TREE_NODE_KIND(new_exp) = NODE_KIND_EXP;
-			TREE_NODE_LNO(new_exp) = lineno;
-			TREE_EXP_OP(new_exp) = EXP_OP_LESS;
-			
-			TREE_EXP_FIRST(new_exp) = exp;
-			exp = new_exp;
-			
-			TREE_EXP_SECOND(new_exp) = parser_additive_expr(NULL);
-			
-			continue;
-		}
-		
-		if (parser_next_token_is(TOKEN_TYPE_KEYWORD, "<=")) {
-#			ifndef NDEBUG
-			printf("    op: <=\n");
-#			endif
-			
-			lex_next_token();
-			
-			tree_t new_exp = TREE_ALLOC(tree_exp_t);
-			TREE_NODE_KIND(new_exp) = NODE_KIND_EXP;
-			TREE_NODE_LNO(new_exp) = lineno;
-			TREE_EXP_OP(new_exp) = EXP_OP_LESS_EQ;
-			
-			TREE_EXP_FIRST(new_exp) = exp;
-			exp = new_exp;
-			
-			TREE_EXP_SECOND(new_exp) = parser_additive_expr(NULL);
-			
-			continue;
-		}
-		
-		if (parser_next_token_is(TOKEN_TYPE_KEYWORD, ">")) {
-#			ifndef NDEBUG
-			printf("    op: >\n");
-#			endif
-			
-			lex_next_token();
-			
-			tree_t new_exp = TREE_ALLOC(tree_exp_t);
-			TREE_NODE_KIND(new_exp) = NODE_KIND_EXP;
-			TREE_NODE_LNO(new_exp) = lineno;
-			TREE_EXP_OP(new_exp) = EXP_OP_GREATER;
-			
-			TREE_EXP_FIRST(new_exp) = exp;
-			exp = new_exp;
-			
-			TREE_EXP_SECOND(new_exp) = parser_additive_expr(NULL);
-			
-			continue;
-		}
-		
-		if (parser_next_token_is(TOKEN_TYPE_KEYWORD, ">=")) {
-#			ifndef NDEBUG
-			printf("    op: >=\n");
-#			endif
-			
-			lex_next_token();
-			
-			tree_t new_exp = TREE_ALLOC(tree_exp_t);
-			TREE_NODE_KIND(new_exp) = NODE_KIND_EXP;
-			TREE_NODE_LNO(new_exp) = lineno;
-			TREE_EXP_OP(new_exp) = EXP_OP_GREATER_EQ;
-			
-			TREE_EXP_FIRST(new_exp) = exp;
-			exp = new_exp;
-			
-			TREE_EXP_SECOND(new_exp) = parser_additive_expr(NULL);
-			
-			continue;
-		}
-		
-		break;
-	}
+	lex_peek_token();
 	
-	return exp;
+	return LAEOF();
 }
 
-// additive_expr : mult_expr
-// additive_expr : additive_expr PLUS  mult_expr
-//               | additive_expr MINUS mult_expr
-static tree_t parser_additive_expr(tree_t unary_subst)
+// Returns the keyword of the next token,
+// or KEYWORD_NONE if it is not a keyword.
+// This function only peeks a token.
+static int parser_next_keyword()
 {
-#	if !defined(NDEBUG) && PARSER_TRACE
-	printf("entering 'additive expr'\n");
-#	endif
-	
-	tree_t exp = parser_mult_expr(unary_subst);
+	lex_peek_token();
 	
-	while (true) {
-		if (parser_next_token_is(TOKEN_TYPE_KEYWORD, "+")) {
-#			ifndef NDEBUG
-			printf("    op: +\n");
-#			endif
-			
-			lex_next_token();
-			
-			tree_t new_exp = TREE_ALLOC(tree_exp_t);
-			TREE_NODE_KIND(new_exp) = NODE_KIND_EXP;
-			TREE_NODE_LNO(new_exp) = lineno;
-			TREE_EXP_OP(new_exp) = EXP_OP_PLUS;
-			
-			TREE_EXP_FIRST(new_exp) = exp;
-			exp = new_exp;
-		
-			TREE_EXP_SECOND(new_exp) = parser_mult_expr(NULL);
-			
-			continue;
-		}
-
-		if (parser_next_token_is(TOKEN_TYPE_KEYWORD, "-")) {
-#			ifndef NDEBUG
-			printf("    op: -\n");
-#			endif
-			
-			lex_next_token();
-			
-			tree_t new_exp = TREE_ALLOC(tree_exp_t);
-			TREE_NODE_KIND(new_exp) = NODE_KIND_EXP;
-			TREE_NODE_LNO(new_exp) = lineno;
-			TREE_EXP_OP(new_exp) = EXP_OP_MINUS;
-			
-			TREE_EXP_FIRST(new_exp) = exp;
-			exp = new_exp;
-		
-			TREE_EXP_SECOND(new_exp) = parser_mult_expr(NULL);
-			
-			continue;
-		}
-		
-		break;
-	}
+	if (LAEOF() || !LATYPE_IS(TOKEN_TYPE_KEYWORD))
+		return KEYWORD_NONE;
 	
-	return exp;
+	return LAKW();
 }
 
-// mult_expr : unary_expr
-// mult_expr : mult_expr MULTIPLY unary_expr
-//           | mult_expr  DIVIDE  unary_expr
-//           | mult_expr  MODULO  unary_expr
-static tree_t parser_mult_expr(tree_t unary_subst)
+// This function fetches a token,
+// which should be the given keyword.
+static void parser_eat_next_token(int keyword)
 {
-#	if !defined(NDEBUG) && PARSER_TRACE
-	printf("entering 'mult expr'\n");
-#	endif
-	
-	tree_t exp = parser_unary_expr(unary_subst);
-	
-	while (true) {
-		if (parser_next_token_is(TOKEN_TYPE_KEYWORD, "*")) {
-#			ifndef NDEBUG
-			printf("    op: *\n");
-#			endif
-
-			lex_next_token();
-			
-			tree_t new_exp = TREE_ALLOC(tree_exp_t);
-			TREE_NODE_KIND(new_exp) = NODE_KIND_EXP;
-			TREE_NODE_LNO(new_exp) = lineno;
-			TREE_EXP_OP(new_exp) = EXP_OP_MULTIPLY;
-			
-			TREE_EXP_FIRST(new_exp) = exp;
-			exp = new_exp;
-		
-			TREE_EXP_SECOND(new_exp) = parser_unary_expr(NULL);
-			
-			continue;
-		}
-		
-		if (parser_next_token_is(TOKEN_TYPE_KEYWORD, "/")){
-#			ifndef NDEBUG
-			printf("    op: /\n");
-#			endif
-			
-			lex_next_token();
-			
-			tree_t new_exp = TREE_ALLOC(tree_exp_t);
-			TREE_NODE_KIND(new_exp) = NODE_KIND_EXP;
-			TREE_NODE_LNO(new_exp) = lineno;
-			TREE_EXP_OP(new_exp) = EXP_OP_DIVIDE;
-			
-			TREE_EXP_FIRST(new_exp) = exp;
-			exp = new_exp;
-		
-			TREE_EXP_SECOND(new_exp) = parser_unary_expr(NULL);
-			
-			continue;
-		}
-		
-		if (parser_next_token_is(TOKEN_TYPE_KEYWORD, "%")) {
-#			ifndef NDEBUG
-			printf("    op: %\n");
-#			endif
-			
-			lex_next_token();
-			
-			tree_t new_exp = TREE_ALLOC(tree_exp_t);
-			TREE_NODE_KIND(new_exp) = NODE_KIND_EXP;
-			TREE_NODE_LNO(new_exp) = lineno;
-			TREE_EXP_OP(new_exp) = EXP_OP_MODULO;
-			
-			TREE_EXP_FIRST(new_exp) = exp;
-			exp = new_exp;
-		
-			TREE_EXP_SECOND(new_exp) = parser_unary_expr(NULL);
-			
-			continue;
-		}
-		
-		break;
-	}
+	lex_next_token();
 	
-	return exp;
+	parser_current_token_should_be_keyword(keyword);
 }
 
-
-
-static bool parser_next_token_is_eof()
+// This function only peeks a token.
+static bool parser_next_token_is(int token_type)
 {
 	lex_peek_token();
 	
-	return LAEOF();
+	return !LAEOF() && LATYPE_IS(token_type);
 }
 
-// When token_type is keyword:
-//     if text is not null, then text is also compared.
-// This function fetches a token.
-static void parser_eat_next_token(int token_type, const char *text)
-{
-	lex_next_token();
-	
-	parser_current_token_should_be(token_type, text);
-}
-
-// When token_type is keyword:
-//     if text is not null, then text is also compared.
 // This function only peeks a token.
-static bool parser_next_token_is(int token_type, const char *text)
+static bool parser_next_token_is_keyword(int keyword)
 {
 	lex_peek_token();
 	
-	switch (token_type) {
-	case TOKEN_TYPE_KEYWORD:
-		if (LAEOF() ||
-			!LATYPE_IS(TOKEN_TYPE_KEYWORD) ||
-			(text ? !LATEXT_EQUALS(text) : 0))
-			return false;
-		break;
-	default:
-		if (LAEOF() ||
-			!LATYPE_IS(token_type))
-			return false;
-		break;
-	}
-	
-	return true;
+	return LAKW_IS(keyword);
 }
 
 // The next token should be int, char, string or typename
@@ -1425,49 +1827,52 @@ static bool parser_next_token_indicates_typespec()
 	if (LAEOF())
 		return false;
 	
-	if (LATYPE_IS(TOKEN_TYPE_KEYWORD) &&
-		(LATEXT_EQUALS("int") ||
-		 LATEXT_EQUALS("char") ||
-		 LATEXT_EQUALS("string")))
-		return true;
+	if (LATYPE_IS(TOKEN_TYPE_KEYWORD)) {
+		switch (LAKW()) {
+		case KEYWORD_INT:
+		case KEYWORD_CHAR:
+		case KEYWORD_STRING:
+			return true;
+		default:
+			return false;
+		}
+	}
 	
 	if (LATYPE_IS(TOKEN_TYPE_IDENTIFIER) &&
-		hashtab_lookup(typetab, LATEXT(), NULL, 0))
+		ATOM_IS(LAATOM(), ATOM_FLAG_TYPENAME) &&
+		(!typename_defs || typename_defs[ATOM_ID(LAATOM())] <= lexstate.pos))
 		return true;
 
 	return false;
 }
 
-// When token_type is keyword:
-//     if text is not null, then text is also compared.
-static void parser_current_token_should_be(int token_type, const char *text)
+static void parser_current_token_should_be(int token_type)
 {
 	switch (token_type) {
 	case TOKEN_TYPE_KEYWORD:
 		if (CURREOF() ||
-			!CURRTYPE_IS(TOKEN_TYPE_KEYWORD) ||
-			(text ? !CURRTEXT_EQUALS(text) : false))
-			fatal("keyword '%s' expected", text);
+			!CURRTYPE_IS(TOKEN_TYPE_KEYWORD))
+			parser_fatal("keyword expected");
 		break;
 	case TOKEN_TYPE_IDENTIFIER:
 		if (CURREOF() ||
 			!CURRTYPE_IS(TOKEN_TYPE_IDENTIFIER))
-			fatal("identifier expected");
+			parser_fatal("identifier expected");
 		break;
 	case TOKEN_TYPE_INT_CONST:
 		if (CURREOF() ||
 			!CURRTYPE_IS(TOKEN_TYPE_INT_CONST))
-			fatal("int const expected");
+			parser_fatal("int const expected");
 		break;
 	case TOKEN_TYPE_CHAR_CONST:
 		if (CURREOF() ||
 			!CURRTYPE_IS(TOKEN_TYPE_CHAR_CONST))
-			fatal("char const expected");
+			parser_fatal("char const expected");
 		break;
 	case TOKEN_TYPE_STRING_CONST:
 		if (CURREOF() ||
 			!CURRTYPE_IS(TOKEN_TYPE_STRING_CONST))
-			fatal("string const expected");
+			parser_fatal("string const expected");
 		break;
 	default:
 		// How did you get here?
@@ -1476,25 +1881,15 @@ static void parser_current_token_should_be(int token_type, const char *text)
 	}
 }
 
-// When token_type is keyword:
-//     if text is not null, then text is also compared.
-static bool parser_current_token_is(int token_type, const char *text)
+static void parser_current_token_should_be_keyword(int keyword)
 {
-	switch (token_type) {
-	case TOKEN_TYPE_KEYWORD:
-		if (CURREOF() ||
-			!CURRTYPE_IS(TOKEN_TYPE_KEYWORD) ||
-			(text ? !LATEXT_EQUALS(text) : 0))
-			return false;
-		break;
-	default:
-		if (CURREOF() ||
-			!CURRTYPE_IS(token_type))
-			return false;
-		break;
-	}
-	
-	return true;
+	if (!CURRKW_IS(keyword))
+		parser_fatal("keyword '%s' expected", lex_keyword_text(keyword));
+}
+
+static bool parser_current_token_is_keyword(int keyword)
+{
+	return CURRKW_IS(keyword);
 }
 
 
@@ -1506,15 +1901,17 @@ static tree_t parser_id()
 #	endif
 	
 	lex_next_token();
-	parser_current_token_should_be(TOKEN_TYPE_IDENTIFIER, NULL);
+	parser_current_token_should_be(TOKEN_TYPE_IDENTIFIER);
 	
 	tree_t id = TREE_ALLOC(tree_id_t);
 	TREE_NODE_KIND(id) = NODE_KIND_ID;
-	TREE_NODE_LNO(id) = lineno;
-	TREE_ID_NAME(id) = xstrdup(CURRTEXT());
+	TREE_NODE_OFFSET(id) = srcpos;
+	TREE_ID_ATOM(id) = CURRATOM();
+	TREE_ID_DECL(id) = NULL;
 	
 #	ifndef NDEBUG
-	printf("    id: %s\n", CURRTEXT());
+	if (parser_printing())
+		printf("    id: %s\n", ATOM_TEXT(CURRATOM()));
 #	endif
 	
 	return id;
@@ -1527,16 +1924,17 @@ static tree_t parser_int_const()
 #	endif
 	
 	lex_next_token();
-	parser_current_token_should_be(TOKEN_TYPE_INT_CONST, NULL);
+	parser_current_token_should_be(TOKEN_TYPE_INT_CONST);
 	
 	tree_t ic = TREE_ALLOC(tree_const_t);
 	TREE_NODE_KIND(ic) = NODE_KIND_CONST;
-	TREE_NODE_LNO(ic) = lineno;
+	TREE_NODE_OFFSET(ic) = srcpos;
 	TREE_CONST_KIND(ic) = CONST_KIND_INTEGER;
 	TREE_CONST_INT(ic) = CURRINT();
 	
 #	ifndef NDEBUG
-	printf("    int const: %d\n", CURRINT());
+	if (parser_printing())
+		printf("    int const: %d\n", CURRINT());
 #	endif
 	
 	return ic;
@@ -1549,16 +1947,17 @@ static tree_t parser_char_const()
 #	endif
 	
 	lex_next_token();
-	parser_current_token_should_be(TOKEN_TYPE_CHAR_CONST, NULL);
+	parser_current_token_should_be(TOKEN_TYPE_CHAR_CONST);
 	
 	tree_t cc = TREE_ALLOC(tree_const_t);
 	TREE_NODE_KIND(cc) = NODE_KIND_CONST;
-	TREE_NODE_LNO(cc) = lineno;
+	TREE_NODE_OFFSET(cc) = srcpos;
 	TREE_CONST_KIND(cc) = CONST_KIND_CHARACTER;
 	TREE_CONST_CHAR(cc) = CURRCHAR();
 	
 #	ifndef NDEBUG
-	printf("    char const: 0x%02x\n", CURRCHAR());
+	if (parser_printing())
+		printf("    char const: 0x%02x\n", CURRCHAR());
 #	endif
 	
 	return cc;
@@ -1571,16 +1970,19 @@ static tree_t parser_string_const()
 #	endif
 	
 	lex_next_token();
-	parser_current_token_should_be(TOKEN_TYPE_STRING_CONST, NULL);
+	parser_current_token_should_be(TOKEN_TYPE_STRING_CONST);
 	
 	tree_t sc = TREE_ALLOC(tree_const_t);
 	TREE_NODE_KIND(sc) = NODE_KIND_CONST;
-	TREE_NODE_LNO(sc) = lineno;
+	TREE_NODE_OFFSET(sc) = srcpos;
 	TREE_CONST_KIND(sc) = CONST_KIND_STRING;
-	TREE_CONST_STRING(sc) = xstrdup(CURRTEXT());
+	int len;
+	TREE_CONST_STRING(sc) = CURRSTRING(&len);
+	TREE_CONST_STRLEN(sc) = len;
 	
 #	ifndef NDEBUG
-	printf("    string const: %s\n", CURRTEXT());
+	if (parser_printing())
+		printf("    string const: %.*s\n", len, TREE_CONST_STRING(sc));
 #	endif
 	
 	return sc;
@@ -1593,15 +1995,16 @@ static tree_t parser_null()
 #	endif
 	
 	lex_next_token();
-	parser_current_token_should_be(TOKEN_TYPE_KEYWORD, "null");
+	parser_current_token_should_be_keyword(KEYWORD_NULL);
 	
 	tree_t null = TREE_ALLOC(tree_const_t);
 	TREE_NODE_KIND(null) = NODE_KIND_CONST;
-	TREE_NODE_LNO(null) = lineno;
+	TREE_NODE_OFFSET(null) = srcpos;
 	TREE_CONST_KIND(null) = CONST_KIND_NULL;
 	
 #	ifndef NDEBUG
-	printf("    null\n");
+	if (parser_printing())
+		printf("    null\n");
 #	endif
 	
 	return null;
@@ -1612,26 +2015,25 @@ static tree_t parser_null()
 static void _parser_print_fun(tree_t decl)
 {
 	printf("'%s' returns ", TREE_ID_NAME(TREE_DECL_ID(decl)));
-	_parser_print_type(TREE_DECL_TYPESPEC(decl));
+	parser_print_type(TREE_DECL_TYPESPEC(decl));
 	
 	if (TREE_DECL_PARAMS(decl)) {
 		printf(", with:\n");
 		
-		slist_iter_t iter;
-		slist_iter_begin(TREE_LIST(TREE_DECL_PARAMS(decl)), &iter);
-		while (slist_iter_not_end(&iter)) {
+		tree_t params = TREE_DECL_PARAMS(decl);
+		int i;
+		for (i = 0; i != TREE_LIST_COUNT(params); ++i) {
 			printf("        param: ");
-			_parser_print_param(SLIST_ITER_GET_T(iter, tree_t));
+			_parser_print_param(TREE_LIST_ITEM(params, i));
 			printf("\n");
-			
-			slist_iter_move_next(&iter);
 		}
 	} else {
 		printf(", with no params\n");
 	}
 }
 
-static void _parser_print_type(tree_t typespec)
+// Prints a type specifier on stdout, as in "1-dim array of int".
+void parser_print_type(tree_t typespec)
 {
 	if (TREE_TYPESPEC_ARRAY(typespec))
 		printf("%d-dim array of ", TREE_TYPESPEC_DIM(typespec));
@@ -1641,7 +2043,7 @@ static void _parser_print_type(tree_t typespec)
 		printf("char");
 		break;
 	case TYPESPEC_ID:
-		printf(TREE_ID_NAME(TREE_TYPESPEC_ID(typespec)));
+		printf("%s", TREE_ID_NAME(TREE_TYPESPEC_ID(typespec)));
 		break;
 	case TYPESPEC_INT:
 		printf("int");
@@ -1655,11 +2057,11 @@ static void _parser_print_type(tree_t typespec)
 static void _parser_print_var(tree_t var)
 {
 	printf("'%s' of type ", TREE_ID_NAME(TREE_DECL_ID(var)));
-	_parser_print_type(TREE_DECL_TYPESPEC(var));
+	parser_print_type(TREE_DECL_TYPESPEC(var));
 }
 
 static void _parser_print_param(tree_t param)
 {
 	printf("'%s' of type ", TREE_ID_NAME(TREE_DECL_ID(param)));
-	_parser_print_type(TREE_DECL_TYPESPEC(param));
+	parser_print_type(TREE_DECL_TYPESPEC(param));
 }
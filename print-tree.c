@@ -35,7 +35,7 @@ static void visit_tree(tree_node_visitor_t *visitor, tree_t tree, int depth)
 	
 	assert(TREE_NODE_KIND(tree) == NODE_KIND_LIST);
 	assert(TREE_LIST_KIND(tree) == LIST_KIND_TU);
-	visitor->visit_list(visitor, tree, depth + 1);
+	parser_visit_push(visitor->visit_list, tree, depth + 1);
 }
 
 static void visit_const(tree_node_visitor_t *visitor, tree_t tree, int depth)
@@ -53,7 +53,7 @@ static void visit_const(tree_node_visitor_t *visitor, tree_t tree, int depth)
 		printf("null\n");
 		break;
 	case CONST_KIND_STRING:
-		printf("string literal = \"%s\"\n", TREE_CONST_STRING(tree));
+		printf("string literal = \"%.*s\"\n", TREE_CONST_STRLEN(tree), TREE_CONST_STRING(tree));
 		break;
 	default:
 		assert(false);
@@ -79,20 +79,20 @@ static void visit_decl(tree_node_visitor_t *visitor, tree_t tree, int depth)
 			typespec = TREE_DECL_TYPESPEC(tree);
 			assert(typespec);
 			assert(TREE_NODE_KIND(typespec) == NODE_KIND_TYPESPEC);
-			visitor->visit_typespec(visitor, typespec, depth + 1);
+			parser_visit_push(visitor->visit_typespec, typespec, depth + 1);
 			
 			// id.
 			id = TREE_DECL_ID(tree);
 			assert(id);
 			assert(TREE_NODE_KIND(id) == NODE_KIND_ID);
-			visitor->visit_id(visitor, id, depth + 1);
+			parser_visit_push(visitor->visit_id, id, depth + 1);
 			
 			// parameter list.
 			params = TREE_DECL_PARAMS(tree);
 			if (params) {
 				assert(TREE_NODE_KIND(params) == NODE_KIND_LIST);
 				assert(TREE_LIST_KIND(params) == LIST_KIND_PARAMS);
-				visitor->visit_list(visitor, params, depth + 1);
+				parser_visit_push(visitor->visit_list, params, depth + 1);
 			}
 		} else {
 			printf("function def\n");
@@ -101,20 +101,20 @@ static void visit_decl(tree_node_visitor_t *visitor, tree_t tree, int depth)
 			typespec = TREE_DECL_TYPESPEC(tree);
 			assert(typespec);
 			assert(TREE_NODE_KIND(typespec) == NODE_KIND_TYPESPEC);
-			visitor->visit_typespec(visitor, typespec, depth + 1);
+			parser_visit_push(visitor->visit_typespec, typespec, depth + 1);
 			
 			// id.
 			id = TREE_DECL_ID(tree);
 			assert(id);
 			assert(TREE_NODE_KIND(id) == NODE_KIND_ID);
-			visitor->visit_id(visitor, id, depth + 1);
+			parser_visit_push(visitor->visit_id, id, depth + 1);
 			
 			// parameter list.
 			params = TREE_DECL_PARAMS(tree);
 			if (params) {
 				assert(TREE_NODE_KIND(params) == NODE_KIND_LIST);
 				assert(TREE_LIST_KIND(params) == LIST_KIND_PARAMS);
-				visitor->visit_list(visitor, params, depth + 1);
+				parser_visit_push(visitor->visit_list, params, depth + 1);
 			}
 			
 			// var decl list.
@@ -122,14 +122,14 @@ static void visit_decl(tree_node_visitor_t *visitor, tree_t tree, int depth)
 			assert(vars);
 			assert(TREE_NODE_KIND(vars) == NODE_KIND_LIST);
 			assert(TREE_LIST_KIND(vars) == LIST_KIND_VARS);
-			visitor->visit_list(visitor, vars, depth + 1);
+			parser_visit_push(visitor->visit_list, vars, depth + 1);
 			
 			// stmt list.
 			stmts = TREE_DECL_STMTS(tree);
 			assert(stmts);
 			assert(TREE_NODE_KIND(stmts) == NODE_KIND_LIST);
 			assert(TREE_LIST_KIND(stmts) == LIST_KIND_STMTS);
-			visitor->visit_list(visitor, stmts, depth + 1);
+			parser_visit_push(visitor->visit_list, stmts, depth + 1);
 		}
 		break;
 	case DECL_KIND_VARIABLE:
@@ -139,26 +139,26 @@ static void visit_decl(tree_node_visitor_t *visitor, tree_t tree, int depth)
 			// type specifier.
 			typespec = TREE_DECL_TYPESPEC(tree);
 			assert(TREE_NODE_KIND(typespec) == NODE_KIND_TYPESPEC);
-			visitor->visit_typespec(visitor, typespec, depth + 1);
+			parser_visit_push(visitor->visit_typespec, typespec, depth + 1);
 			
 			// id.
 			id = TREE_DECL_ID(tree);
 			assert(TREE_NODE_KIND(id) == NODE_KIND_ID);
-			visitor->visit_id(visitor, id, depth + 1);
+			parser_visit_push(visitor->visit_id, id, depth + 1);
 		} else {
 			printf("variable decl\n");
 			
 			// type specifier.
 			typespec = TREE_DECL_TYPESPEC(tree);
 			assert(TREE_NODE_KIND(typespec) == NODE_KIND_TYPESPEC);
-			visitor->visit_typespec(visitor, typespec, depth + 1);
+			parser_visit_push(visitor->visit_typespec, typespec, depth + 1);
 			
 			// id.
 			id = TREE_DECL_ID(tree);
 			assert(TREE_NODE_KIND(id) == NODE_KIND_ID);
-			visitor->visit_id(visitor, id, depth + 1);
+			parser_visit_push(visitor->visit_id, id, depth + 1);
 		}
-
+		
 		break;
 	case DECL_KIND_TYPENAME:
 		printf("record def\n");
@@ -166,14 +166,14 @@ static void visit_decl(tree_node_visitor_t *visitor, tree_t tree, int depth)
 		// id.
 		id = TREE_DECL_ID(tree);
 		assert(TREE_NODE_KIND(id) == NODE_KIND_ID);
-		visitor->visit_id(visitor, id, depth + 1);
+		parser_visit_push(visitor->visit_id, id, depth + 1);
 		
 		// var decl list.
 		vars = TREE_DECL_VARS(tree);
 		assert(vars);
 		assert(TREE_NODE_KIND(vars) == NODE_KIND_LIST);
 		assert(TREE_LIST_KIND(vars) == LIST_KIND_VARS);
-		visitor->visit_list(visitor, vars, depth + 1);
+		parser_visit_push(visitor->visit_list, vars, depth + 1);
 		break;
 	default:
 		assert(false);
@@ -197,13 +197,10 @@ static void visit_exp(tree_node_visitor_t *visitor, tree_t tree, int depth)
 	
 	// expr, expr, ...
 	if (TREE_NODE_KIND(tree) == NODE_KIND_LIST) {
-		slist_iter_t iter;
-		slist_iter_begin(TREE_LIST(tree), &iter);
-		while (slist_iter_not_end(&iter)) {
-			tree_t exp = SLIST_ITER_GET_T(iter, tree_t);
-			visitor->visit_exp(visitor, exp, depth);
-			
-			slist_iter_move_next(&iter);
+		int i;
+		for (i = 0; i != TREE_LIST_COUNT(tree); ++i) {
+			tree_t exp = TREE_LIST_ITEM(tree, i);
+			parser_visit_push(visitor->visit_exp, exp, depth);
 		}
 		return;
 	}
@@ -223,12 +220,12 @@ static void visit_exp(tree_node_visitor_t *visitor, tree_t tree, int depth)
 		first = TREE_EXP_FIRST(tree);
 		assert(first);
 		
-		visitor->visit_exp(visitor, first, depth + 1);
+		parser_visit_push(visitor->visit_exp, first, depth + 1);
 		
 		// arguments.
 		second = TREE_EXP_SECOND(tree);
 		if (second)
-			visitor->visit_exp(visitor, second, depth + 1);
+			parser_visit_push(visitor->visit_exp, second, depth + 1);
 		break;
 	case EXP_OP_INDEX:
 		printf("postfix (index)\n");
@@ -237,13 +234,13 @@ static void visit_exp(tree_node_visitor_t *visitor, tree_t tree, int depth)
 		first = TREE_EXP_FIRST(tree);
 		assert(first);
 		
-		visitor->visit_exp(visitor, first, depth + 1);
+		parser_visit_push(visitor->visit_exp, first, depth + 1);
 		
 		// indexer.
 		second = TREE_EXP_SECOND(tree);
 		assert(second);
 		
-		visitor->visit_exp(visitor, second, depth + 1);
+		parser_visit_push(visitor->visit_exp, second, depth + 1);
 		break;
 	case EXP_OP_DOT:
 		printf("postfix (dot)\n");
@@ -252,14 +249,14 @@ static void visit_exp(tree_node_visitor_t *visitor, tree_t tree, int depth)
 		first = TREE_EXP_FIRST(tree);
 		assert(first);
 		
-		visitor->visit_exp(visitor, first, depth + 1);
+		parser_visit_push(visitor->visit_exp, first, depth + 1);
 		
 		// property.
 		second = TREE_EXP_SECOND(tree);
 		assert(second);
 		assert(TREE_NODE_KIND(second) == NODE_KIND_ID);
 		
-		visitor->visit_exp(visitor, second, depth + 1);
+		parser_visit_push(visitor->visit_exp, second, depth + 1);
 		break;
 	case EXP_OP_ASSIGNMENT:
 		printf("assignment expr\n");
@@ -268,13 +265,13 @@ static void visit_exp(tree_node_visitor_t *visitor, tree_t tree, int depth)
 		first = TREE_EXP_FIRST(tree);
 		assert(first);
 		
-		visitor->visit_exp(visitor, first, depth + 1);
+		parser_visit_push(visitor->visit_exp, first, depth + 1);
 		
 		// right-value.
 		second = TREE_EXP_SECOND(tree);
 		assert(second);
 		
-		visitor->visit_exp(visitor, second, depth + 1);
+		parser_visit_push(visitor->visit_exp, second, depth + 1);
 		break;
 	case EXP_OP_U_PLUS:
 		printf("unary expr (plus)\n");
@@ -283,7 +280,7 @@ static void visit_exp(tree_node_visitor_t *visitor, tree_t tree, int depth)
 		first = TREE_EXP_FIRST(tree);
 		assert(first);
 		
-		visitor->visit_exp(visitor, first, depth + 1);
+		parser_visit_push(visitor->visit_exp, first, depth + 1);
 		break;
 	case EXP_OP_U_MINUS:
 		printf("unary expr (minus)\n");
@@ -292,7 +289,7 @@ static void visit_exp(tree_node_visitor_t *visitor, tree_t tree, int depth)
 		first = TREE_EXP_FIRST(tree);
 		assert(first);
 		
-		visitor->visit_exp(visitor, first, depth + 1);
+		parser_visit_push(visitor->visit_exp, first, depth + 1);
 		break;
 	case EXP_OP_NOT:
 		printf("unary expr (not)\n");
@@ -301,7 +298,7 @@ static void visit_exp(tree_node_visitor_t *visitor, tree_t tree, int depth)
 		first = TREE_EXP_FIRST(tree);
 		assert(first);
 		
-		visitor->visit_exp(visitor, first, depth + 1);
+		parser_visit_push(visitor->visit_exp, first, depth + 1);
 		break;
 	case EXP_OP_LOGICAL_OR:
 		printf("logical or expr\n");
@@ -310,13 +307,13 @@ static void visit_exp(tree_node_visitor_t *visitor, tree_t tree, int depth)
 		first = TREE_EXP_FIRST(tree);
 		assert(first);
 		
-		visitor->visit_exp(visitor, first, depth + 1);
+		parser_visit_push(visitor->visit_exp, first, depth + 1);
 		
 		// rhs.
 		second = TREE_EXP_SECOND(tree);
 		assert(second);
 		
-		visitor->visit_exp(visitor, second, depth + 1);
+		parser_visit_push(visitor->visit_exp, second, depth + 1);
 		break;
 	case EXP_OP_LOGICAL_AND:
 		printf("logical and expr\n");
@@ -325,13 +322,13 @@ static void visit_exp(tree_node_visitor_t *visitor, tree_t tree, int depth)
 		first = TREE_EXP_FIRST(tree);
 		assert(first);
 		
-		visitor->visit_exp(visitor, first, depth + 1);
+		parser_visit_push(visitor->visit_exp, first, depth + 1);
 		
 		// rhs.
 		second = TREE_EXP_SECOND(tree);
 		assert(second);
 		
-		visitor->visit_exp(visitor, second, depth + 1);
+		parser_visit_push(visitor->visit_exp, second, depth + 1);
 		break;
 	case EXP_OP_EQ:
 		printf("relational expr (eq)\n");
@@ -340,13 +337,13 @@ static void visit_exp(tree_node_visitor_t *visitor, tree_t tree, int depth)
 		first = TREE_EXP_FIRST(tree);
 		assert(first);
 		
-		visitor->visit_exp(visitor, first, depth + 1);
+		parser_visit_push(visitor->visit_exp, first, depth + 1);
 		
 		// rhs.
 		second = TREE_EXP_SECOND(tree);
 		assert(second);
 		
-		visitor->visit_exp(visitor, second, depth + 1);
+		parser_visit_push(visitor->visit_exp, second, depth + 1);
 		break;
 	case EXP_OP_NEQ:
 		printf("relational expr (neq)\n");
@@ -355,13 +352,13 @@ static void visit_exp(tree_node_visitor_t *visitor, tree_t tree, int depth)
 		first = TREE_EXP_FIRST(tree);
 		assert(first);
 		
-		visitor->visit_exp(visitor, first, depth + 1);
+		parser_visit_push(visitor->visit_exp, first, depth + 1);
 		
 		// rhs.
 		second = TREE_EXP_SECOND(tree);
 		assert(second);
 		
-		visitor->visit_exp(visitor, second, depth + 1);
+		parser_visit_push(visitor->visit_exp, second, depth + 1);
 		break;
 	case EXP_OP_LESS:
 		printf("relational expr (less)\n");
@@ -370,13 +367,13 @@ static void visit_exp(tree_node_visitor_t *visitor, tree_t tree, int depth)
 		first = TREE_EXP_FIRST(tree);
 		assert(first);
 		
-		visitor->visit_exp(visitor, first, depth + 1);
+		parser_visit_push(visitor->visit_exp, first, depth + 1);
 		
 		// rhs.
 		second = TREE_EXP_SECOND(tree);
 		assert(second);
 		
-		visitor->visit_exp(visitor, second, depth + 1);
+		parser_visit_push(visitor->visit_exp, second, depth + 1);
 		break;
 	case EXP_OP_LESS_EQ:
 		printf("relational expr (less eq)\n");
@@ -385,13 +382,13 @@ static void visit_exp(tree_node_visitor_t *visitor, tree_t tree, int depth)
 		first = TREE_EXP_FIRST(tree);
 		assert(first);
 		
-		visitor->visit_exp(visitor, first, depth + 1);
+		parser_visit_push(visitor->visit_exp, first, depth + 1);
 		
 		// rhs.
 		second = TREE_EXP_SECOND(tree);
 		assert(second);
 		
-		visitor->visit_exp(visitor, second, depth + 1);
+		parser_visit_push(visitor->visit_exp, second, depth + 1);
 		break;
 	case EXP_OP_GREATER:
 		printf("relational expr (greater)\n");
@@ -400,13 +397,13 @@ static void visit_exp(tree_node_visitor_t *visitor, tree_t tree, int depth)
 		first = TREE_EXP_FIRST(tree);
 		assert(first);
 		
-		visitor->visit_exp(visitor, first, depth + 1);
+		parser_visit_push(visitor->visit_exp, first, depth + 1);
 		
 		// rhs.
 		second = TREE_EXP_SECOND(tree);
 		assert(second);
 		
-		visitor->visit_exp(visitor, second, depth + 1);
+		parser_visit_push(visitor->visit_exp, second, depth + 1);
 		break;
 	case EXP_OP_GREATER_EQ:
 		printf("relational expr (greater eq)\n");
@@ -415,13 +412,13 @@ static void visit_exp(tree_node_visitor_t *visitor, tree_t tree, int depth)
 		first = TREE_EXP_FIRST(tree);
 		assert(first);
 		
-		visitor->visit_exp(visitor, first, depth + 1);
+		parser_visit_push(visitor->visit_exp, first, depth + 1);
 		
 		// rhs.
 		second = TREE_EXP_SECOND(tree);
 		assert(second);
 		
-		visitor->visit_exp(visitor, second, depth + 1);
+		parser_visit_push(visitor->visit_exp, second, depth + 1);
 		break;
 	case EXP_OP_PLUS:
 		printf("additive expr (plus)\n");
@@ -430,13 +427,13 @@ static void visit_exp(tree_node_visitor_t *visitor, tree_t tree, int depth)
 		first = TREE_EXP_FIRST(tree);
 		assert(first);
 		
-		visitor->visit_exp(visitor, first, depth + 1);
+		parser_visit_push(visitor->visit_exp, first, depth + 1);
 		
 		// rhs.
 		second = TREE_EXP_SECOND(tree);
 		assert(second);
 		
-		visitor->visit_exp(visitor, second, depth + 1);
+		parser_visit_push(visitor->visit_exp, second, depth + 1);
 		break;
 	case EXP_OP_MINUS:
 		printf("additive expr (minus)\n");
@@ -445,13 +442,13 @@ static void visit_exp(tree_node_visitor_t *visitor, tree_t tree, int depth)
 		first = TREE_EXP_FIRST(tree);
 		assert(first);
 		
-		visitor->visit_exp(visitor, first, depth + 1);
+		parser_visit_push(visitor->visit_exp, first, depth + 1);
 		
 		// rhs.
 		second = TREE_EXP_SECOND(tree);
 		assert(second);
 		
-		visitor->visit_exp(visitor, second, depth + 1);
+		parser_visit_push(visitor->visit_exp, second, depth + 1);
 		break;
 	case EXP_OP_MULTIPLY:
 		printf("mult expr (mult)\n");
@@ -460,13 +457,13 @@ static void visit_exp(tree_node_visitor_t *visitor, tree_t tree, int depth)
 		first = TREE_EXP_FIRST(tree);
 		assert(first);
 		
-		visitor->visit_exp(visitor, first, depth + 1);
+		parser_visit_push(visitor->visit_exp, first, depth + 1);
 		
 		// rhs.
 		second = TREE_EXP_SECOND(tree);
 		assert(second);
 		
-		visitor->visit_exp(visitor, second, depth + 1);
+		parser_visit_push(visitor->visit_exp, second, depth + 1);
 		break;
 	case EXP_OP_DIVIDE:
 		printf("mult expr (divide)\n");
@@ -475,13 +472,13 @@ static void visit_exp(tree_node_visitor_t *visitor, tree_t tree, int depth)
 		first = TREE_EXP_FIRST(tree);
 		assert(first);
 		
-		visitor->visit_exp(visitor, first, depth + 1);
+		parser_visit_push(visitor->visit_exp, first, depth + 1);
 		
 		// rhs.
 		second = TREE_EXP_SECOND(tree);
 		assert(second);
 		
-		visitor->visit_exp(visitor, second, depth + 1);
+		parser_visit_push(visitor->visit_exp, second, depth + 1);
 		break;
 	case EXP_OP_MODULO:
 		printf("mult expr (modulo)\n");
@@ -490,13 +487,13 @@ static void visit_exp(tree_node_visitor_t *visitor, tree_t tree, int depth)
 		first = TREE_EXP_FIRST(tree);
 		assert(first);
 		
-		visitor->visit_exp(visitor, first, depth + 1);
+		parser_visit_push(visitor->visit_exp, first, depth + 1);
 		
 		// rhs.
 		second = TREE_EXP_SECOND(tree);
 		assert(second);
 		
-		visitor->visit_exp(visitor, second, depth + 1);
+		parser_visit_push(visitor->visit_exp, second, depth + 1);
 		break;
 	case EXP_OP_NEW:
 		printf("primary (new)\n");
@@ -506,12 +503,12 @@ static void visit_exp(tree_node_visitor_t *visitor, tree_t tree, int depth)
 		assert(TREE_NODE_KIND(typespec) == NODE_KIND_TYPESPEC);
 		
 		// type.
-		visitor->visit_typespec(visitor, typespec, depth + 1);
+		parser_visit_push(visitor->visit_typespec, typespec, depth + 1);
 		
 		// dim.
 		tree_t dim = TREE_EXP_SECOND(tree);
 		if (dim)
-			visitor->visit_exp(visitor, dim, depth + 1);
+			parser_visit_push(visitor->visit_exp, dim, depth + 1);
 		break;
 	default:
 		assert(false);
@@ -527,62 +524,58 @@ static void visit_id(tree_node_visitor_t *visitor, tree_t tree, int depth)
 
 static void visit_list(tree_node_visitor_t *visitor, tree_t tree, int depth)
 {
-	slist_iter_t iter;
+	int i;
 	
 	print_space(depth);
 	switch (TREE_LIST_KIND(tree)) {
 	case LIST_KIND_TU:
 		printf("translation unit\n");
 		
-		slist_iter_begin(TREE_LIST(tree), &iter);
-		while (slist_iter_not_end(&iter)) {
-			tree_t edecl = SLIST_ITER_GET_T(iter, tree_t);
+		for (i = 0; i != TREE_LIST_COUNT(tree); ++i) {
+			tree_t edecl = TREE_LIST_ITEM(tree, i);
 			assert(TREE_NODE_KIND(edecl) == NODE_KIND_DECL);
 			assert(TREE_DECL_KIND(edecl) == DECL_KIND_FUNCTION ||
 				TREE_DECL_KIND(edecl) == DECL_KIND_TYPENAME);
 			
-			visitor->visit_decl(visitor, edecl, depth + 1);
-			slist_iter_move_next(&iter);
+			parser_visit_push(visitor->visit_decl, edecl, depth + 1);
 		}
 		break;
 	case LIST_KIND_PARAMS:
 		printf("parameter list\n");
 		
-		slist_iter_begin(TREE_LIST(tree), &iter);
-		while (slist_iter_not_end(&iter)) {
-			tree_t param = SLIST_ITER_GET_T(iter, tree_t);
+		for (i = 0; i != TREE_LIST_COUNT(tree); ++i) {
+			tree_t param = TREE_LIST_ITEM(tree, i);
 			assert(TREE_NODE_KIND(param) == NODE_KIND_DECL);
 			assert(TREE_DECL_KIND(param) == DECL_KIND_VARIABLE);
 			assert(TREE_DECL_PARAM(param));
 			
-			visitor->visit_decl(visitor, param, depth + 1);
-			slist_iter_move_next(&iter);
+			parser_visit_push(visitor->visit_decl, param, depth + 1);
 		}
 		break;
 	case LIST_KIND_VARS:
 		printf("variable decl list\n");
 		
-		slist_iter_begin(TREE_LIST(tree), &iter);
-		while (slist_iter_not_end(&iter)) {
-			tree_t var = SLIST_ITER_GET_T(iter, tree_t);
+		for (i = 0; i != TREE_LIST_COUNT(tree); ++i) {
+			tree_t var = TREE_LIST_ITEM(tree, i);
 			assert(TREE_NODE_KIND(var) == NODE_KIND_DECL);
 			assert(TREE_DECL_KIND(var) == DECL_KIND_VARIABLE);
 			assert(!TREE_DECL_PARAM(var));
 			
-			visitor->visit_decl(visitor, var, depth + 1);
-			slist_iter_move_next(&iter);
+			parser_visit_push(visitor->visit_decl, var, depth + 1);
 		}
 		break;
 	case LIST_KIND_STMTS:
 		printf("stmt list\n");
 	  
-		slist_iter_begin(TREE_LIST(tree), &iter);
-		while (slist_iter_not_end(&iter)) {
-			tree_t stmt = SLIST_ITER_GET_T(iter, tree_t);
+		for (i = 0; i != TREE_LIST_COUNT(tree); ++i) {
+			tree_t stmt = TREE_LIST_ITEM(tree, i);
+			
+			// '{}' is no stmt.
+			if (!stmt)
+				continue;
 			assert(TREE_NODE_KIND(stmt) == NODE_KIND_STMT);
 			
-			visitor->visit_stmt(visitor, stmt, depth + 1);
-			slist_iter_move_next(&iter);
+			parser_visit_push(visitor->visit_stmt, stmt, depth + 1);
 		}
 		break;
 	default:
@@ -607,7 +600,7 @@ static void visit_stmt(tree_node_visitor_t *visitor, tree_t tree, int depth)
 		assert(TREE_NODE_KIND(exp) == NODE_KIND_LIST);
 		assert(TREE_LIST_KIND(exp) == LIST_KIND_EXPR);
 			
-		visitor->visit_exp(visitor, exp, depth + 1);
+		parser_visit_push(visitor->visit_exp, exp, depth + 1);
 		break;
 	case STMT_KIND_COMPOUND:
 		printf("compound stmt\n");
@@ -617,7 +610,7 @@ static void visit_stmt(tree_node_visitor_t *visitor, tree_t tree, int depth)
 		assert(TREE_NODE_KIND(stmts) == NODE_KIND_LIST);
 		assert(TREE_LIST_KIND(stmts) == LIST_KIND_STMTS);
 		
-		visitor->visit_list(visitor, stmts, depth + 1);
+		parser_visit_push(visitor->visit_list, stmts, depth + 1);
 		break;
 	case STMT_KIND_RETURN:
 		printf("return stmt\n");
@@ -628,7 +621,7 @@ static void visit_stmt(tree_node_visitor_t *visitor, tree_t tree, int depth)
 		assert(TREE_NODE_KIND(exp) == NODE_KIND_LIST);
 		assert(TREE_LIST_KIND(exp) == LIST_KIND_EXPR);
 			
-		visitor->visit_exp(visitor, exp, depth + 1);
+		parser_visit_push(visitor->visit_exp, exp, depth + 1);
 		break;
 	case STMT_KIND_BREAK:
 		printf("break stmt\n");
@@ -645,21 +638,22 @@ static void visit_stmt(tree_node_visitor_t *visitor, tree_t tree, int depth)
 		assert(TREE_NODE_KIND(exp) == NODE_KIND_LIST);
 		assert(TREE_LIST_KIND(exp) == LIST_KIND_EXPR);
 			
-		visitor->visit_exp(visitor, exp, depth + 1);
+		parser_visit_push(visitor->visit_exp, exp, depth + 1);
 		
-		// stmt (then).
+		// stmt (then), none for '{}'.
 		tree_t then_part = TREE_IF_THEN(tree);
-		assert(then_part);
-		assert(TREE_NODE_KIND(then_part) == NODE_KIND_STMT);
-		
-		visitor->visit_stmt(visitor, then_part, depth + 1);
+		if (then_part) {
+			assert(TREE_NODE_KIND(then_part) == NODE_KIND_STMT);
+			
+			parser_visit_push(visitor->visit_stmt, then_part, depth + 1);
+		}
 		
 		// stmt (else).
 		tree_t else_part = TREE_IF_ELSE(tree);
 		if (else_part) {
 			assert(TREE_NODE_KIND(else_part) == NODE_KIND_STMT);
 		
-			visitor->visit_stmt(visitor, else_part, depth + 1);
+			parser_visit_push(visitor->visit_stmt, else_part, depth + 1);
 		}
 		break;
 	case STMT_KIND_FOR:
@@ -670,8 +664,8 @@ static void visit_stmt(tree_node_visitor_t *visitor, tree_t tree, int depth)
 		if (init) {
 			assert(TREE_NODE_KIND(init) == NODE_KIND_STMT);
 			assert(TREE_STMT_KIND(init) == STMT_KIND_EXPR);
-
-			visitor->visit_stmt(visitor, init, depth + 1);
+			
+			parser_visit_push(visitor->visit_stmt, init, depth + 1);
 		}
 		
 		// expr.
@@ -679,8 +673,8 @@ static void visit_stmt(tree_node_visitor_t *visitor, tree_t tree, int depth)
 		if (exp) {
 			assert(TREE_NODE_KIND(exp) == NODE_KIND_STMT);
 			assert(TREE_STMT_KIND(exp) == STMT_KIND_EXPR);
-
-			visitor->visit_stmt(visitor, exp, depth + 1);
+			
+			parser_visit_push(visitor->visit_stmt, exp, depth + 1);
 		}
 		
 		// incr.
@@ -689,15 +683,16 @@ static void visit_stmt(tree_node_visitor_t *visitor, tree_t tree, int depth)
 			assert(TREE_NODE_KIND(incr) == NODE_KIND_LIST);
 			assert(TREE_LIST_KIND(incr) == LIST_KIND_EXPR);
 			
-			visitor->visit_exp(visitor, incr, depth + 1);
+			parser_visit_push(visitor->visit_exp, incr, depth + 1);
 		}
 		
-		// body.
+		// body, none for '{}'.
 		body = TREE_STMT_BODY(tree);
-		assert(body);
-		assert(TREE_NODE_KIND(body) == NODE_KIND_STMT);
-		
-		visitor->visit_stmt(visitor, body, depth + 1);
+		if (body) {
+			assert(TREE_NODE_KIND(body) == NODE_KIND_STMT);
+			
+			parser_visit_push(visitor->visit_stmt, body, depth + 1);
+		}
 		break;
 	case STMT_KIND_WHILE:
 		printf("while stmt\n");
@@ -708,14 +703,15 @@ static void visit_stmt(tree_node_visitor_t *visitor, tree_t tree, int depth)
 		assert(TREE_NODE_KIND(exp) == NODE_KIND_LIST);
 		assert(TREE_LIST_KIND(exp) == LIST_KIND_EXPR);
 			
-		visitor->visit_exp(visitor, exp, depth + 1);
+		parser_visit_push(visitor->visit_exp, exp, depth + 1);
 		
-		// body.
+		// body, none for '{}'.
 		body = TREE_STMT_BODY(tree);
-		assert(body);
-		assert(TREE_NODE_KIND(body) == NODE_KIND_STMT);
-		
-		visitor->visit_stmt(visitor, body, depth + 1);
+		if (body) {
+			assert(TREE_NODE_KIND(body) == NODE_KIND_STMT);
+			
+			parser_visit_push(visitor->visit_stmt, body, depth + 1);
+		}
 		break;
 	default:
 		assert(false);
@@ -751,3 +747,39 @@ static void visit_typespec(tree_node_visitor_t *visitor, tree_t tree, int depth)
 	
 	printf("\n");
 }
+
+// Prints the head of every function, one per line, in the words of
+// the parse trace. Only the heads are looked at: parsed with lazy
+// bodies, no body of the file is kept for this.
+void print_function_heads(tree_t tu)
+{
+	assert(TREE_NODE_KIND(tu) == NODE_KIND_LIST);
+	assert(TREE_LIST_KIND(tu) == LIST_KIND_TU);
+	
+	int i;
+	for (i = 0; i != TREE_LIST_COUNT(tu); ++i) {
+		tree_t decl = TREE_LIST_ITEM(tu, i);
+		if (TREE_DECL_KIND(decl) != DECL_KIND_FUNCTION)
+			continue;
+		
+		if (TREE_DECL_NATIVE(decl))
+			printf("native ");
+		printf("'%s' returns ", TREE_ID_NAME(TREE_DECL_ID(decl)));
+		parser_print_type(TREE_DECL_TYPESPEC(decl));
+		
+		tree_t params = TREE_DECL_PARAMS(decl);
+		if (!params) {
+			printf(", with no params\n");
+			continue;
+		}
+		
+		int k;
+		for (k = 0; k != TREE_LIST_COUNT(params); ++k) {
+			tree_t param = TREE_LIST_ITEM(params, k);
+			printf(k ? ", " : ", with ");
+			printf("'%s' of type ", TREE_ID_NAME(TREE_DECL_ID(param)));
+			parser_print_type(TREE_DECL_TYPESPEC(param));
+		}
+		printf("\n");
+	}
+}
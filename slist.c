@@ -2,7 +2,7 @@
 
 slist_t slist_create()
 {
-	pslist_node_t phead = xmalloc(sizeof(slist_node_t));
+	pslist_node_t phead = pool_alloc(sizeof(slist_node_t));
 	phead->plink = NULL;
 	
 	return phead;
@@ -13,7 +13,7 @@ void slist_destroy(slist_t list)
 	pslist_node_t pnode = list;
 	while (pnode) {
 		pslist_node_t pnext = pnode->plink;
-		xfree(pnode);
+		pool_free(pnode);
 		pnode = pnext;
 	}
 }
@@ -51,15 +51,23 @@ void *slist_iter_deref(pslist_iter_t piter)
 	return (void *)piter->pcurr->data;
 }
 
-void slist_insert(pslist_iter_t piter, const void *pdata, size_t size)
+// Inserts an element of size bytes before the current one,
+// and returns it for the caller to fill in.
+void *slist_insert_new(pslist_iter_t piter, size_t size)
 {
 	assert(piter);
 	
-	pslist_node_t pnode = xmalloc(sizeof(slist_node_t) + size);
-	memcpy(pnode->data, pdata, size);
+	pslist_node_t pnode = pool_alloc(sizeof(slist_node_t) + size);
 	pnode->plink = piter->pcurr;
 	piter->plast->plink = pnode;
 	piter->pcurr = pnode;
+	
+	return pnode->data;
+}
+
+void slist_insert(pslist_iter_t piter, const void *pdata, size_t size)
+{
+	memcpy(slist_insert_new(piter, size), pdata, size);
 }
 
 void slist_push_front(slist_t list, const void *pdata, size_t size)
@@ -78,7 +86,7 @@ void slist_remove(pslist_iter_t piter)
 	
 	piter->plast->plink = piter->pcurr->plink;
 	pslist_node_t pnext = piter->pcurr->plink;
-	xfree(piter->pcurr);
+	pool_free(piter->pcurr);
 	piter->pcurr = pnext;
 }
 
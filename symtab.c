@@ -0,0 +1,208 @@
+#include "javac.h"
+
+// The symbol table of the checker.
+//
+// Names are atoms, and atoms are numbered densely from 0, so the table
+// is just an array with a binding per atom id: a lookup is one index,
+// with no hashing or key compare at all. The binding of an atom is
+// always the innermost one in scope.
+//
+// Declaring a name in a scope saves the binding it replaces on the
+// undo log. Entering a scope only records how long the log is, and
+// leaving it pops the log back to that length, restoring each saved
+// binding, so it costs as much as the scope declared and no more.
+// Nothing is ever rehashed or copied when scopes come and go.
+typedef struct _symtab_binding_t {
+	tree_t decl;	// The tree_decl_t, NULL when the atom is not bound.
+	int scope;	// How many scopes were entered when it was bound.
+} symtab_binding_t, *psymtab_binding_t;
+
+typedef struct _symtab_undo_t {
+	unsigned atom_id;
+	symtab_binding_t shadowed;
+} symtab_undo_t, *psymtab_undo_t;
+
+static psymtab_binding_t bindings;
+static unsigned n_bindings;
+
+static psymtab_undo_t undo_log;
+static int n_undo_log;
+static int cap_undo_log;
+
+// Where the undo log stood as each open scope was entered.
+static int *scope_marks;
+static int n_scopes;
+static int cap_scopes;
+
+// Every atom the checker sees has to be interned by now:
+// the table is sized once, for atom_count() atoms.
+void symtab_init()
+{
+	assert(!bindings);
+	
+	n_bindings = atom_count();
+	bindings = xmalloc((n_bindings ? n_bindings : 1) * sizeof(symtab_binding_t));
+	memset(bindings, 0, (n_bindings ? n_bindings : 1) * sizeof(symtab_binding_t));
+	n_undo_log = 0;
+	n_scopes = 0;
+}
+
+void symtab_finit()
+{
+	xfree(bindings);
+	bindings = NULL;
+	n_bindings = 0;
+	xfree(undo_log);
+	undo_log = NULL;
+	n_undo_log = cap_undo_log = 0;
+	xfree(scope_marks);
+	scope_marks = NULL;
+	n_scopes = cap_scopes = 0;
+}
+
+void symtab_enter_scope()
+{
+	if (n_scopes == cap_scopes) {
+		cap_scopes = cap_scopes ? cap_scopes * 2 : 16;
+		scope_marks = xrealloc(scope_marks, cap_scopes * sizeof(int));
+	}
+	
+	scope_marks[n_scopes++] = n_undo_log;
+}
+
+// Undoes the bindings of the innermost scope, latest first,
+// which brings back whatever they shadowed.
+void symtab_leave_scope()
+{
+	assert(n_scopes > 0);
+	
+	int mark = scope_marks[--n_scopes];
+	while (n_undo_log > mark) {
+		psymtab_undo_t undo = &undo_log[--n_undo_log];
+		bindings[undo->atom_id] = undo->shadowed;
+	}
+}
+
+int symtab_scope_depth()
+{
+	return n_scopes;
+}
+
+// Binds the name of decl in the innermost scope.
+// Returns NULL, or the decl already bound to the name in that scope,
+// in which case nothing is bound.
+tree_t symtab_declare(tree_t decl)
+{
+	assert(n_scopes > 0);
+	assert(TREE_NODE_KIND(decl) == NODE_KIND_DECL);
+	
+	unsigned atom_id = ATOM_ID(TREE_ID_ATOM(TREE_DECL_ID(decl)));
+	assert(atom_id < n_bindings);
+	
+	psymtab_binding_t binding = &bindings[atom_id];
+	if (binding->decl && binding->scope == n_scopes)
+		return binding->decl;
+	
+	if (n_undo_log == cap_undo_log) {
+		cap_undo_log = cap_undo_log ? cap_undo_log * 2 : 64;
+		undo_log = xrealloc(undo_log, cap_undo_log * sizeof(symtab_undo_t));
+	}
+	
+	psymtab_undo_t undo = &undo_log[n_undo_log++];
+	undo->atom_id = atom_id;
+	undo->shadowed = *binding;
+	
+	binding->decl = decl;
+	binding->scope = n_scopes;
+	
+	return NULL;
+}
+
+// The decl the atom is bound to in the innermost scope having it, or NULL.
+tree_t symtab_lookup(patom_t atom)
+{
+	assert(ATOM_ID(atom) < n_bindings);
+	
+	return bindings[ATOM_ID(atom)].decl;
+}
+
+void symtab_unittest()
+{
+#	ifndef NDEBUG
+	// Runs on an atom table of its own.
+	atom_init();
+	
+	enum { N_DECLS = 6 };
+	tree_node_t ids[N_DECLS];
+	tree_node_t decls[N_DECLS];
+	char name[32];
+	int i;
+	for (i = 0; i != N_DECLS; ++i) {
+		// Names 0, 1 and 2 are spelled twice, the 3 others shadow them.
+		sprintf(name, "symtab_test_%d", i % 3);
+		TREE_NODE_KIND(&ids[i]) = NODE_KIND_ID;
+		TREE_ID_ATOM(&ids[i]) = atom_intern_str(name);
+		TREE_NODE_KIND(&decls[i]) = NODE_KIND_DECL;
+		TREE_DECL_KIND(&decls[i]) = DECL_KIND_VARIABLE;
+		TREE_DECL_ID(&decls[i]) = &ids[i];
+	}
+	patom_t unbound = atom_intern_str("symtab_test_unbound");
+	
+	symtab_init();
+	
+	// global.
+	symtab_enter_scope();
+	assert(!symtab_declare(&decls[0]));
+	assert(!symtab_declare(&decls[1]));
+	assert(symtab_declare(&decls[0]) == &decls[0]);
+	assert(symtab_lookup(TREE_ID_ATOM(&ids[0])) == &decls[0]);
+	assert(!symtab_lookup(unbound));
+	
+	// function: shadows 0 and binds 2.
+	symtab_enter_scope();
+	assert(!symtab_declare(&decls[3]));
+	assert(!symtab_declare(&decls[2]));
+	assert(symtab_declare(&decls[5]) == &decls[2]);
+	assert(symtab_lookup(TREE_ID_ATOM(&ids[0])) == &decls[3]);
+	assert(symtab_lookup(TREE_ID_ATOM(&ids[1])) == &decls[1]);
+	
+	// block: shadows 1, then leaves.
+	symtab_enter_scope();
+	assert(symtab_scope_depth() == 3);
+	assert(!symtab_declare(&decls[4]));
+	assert(symtab_lookup(TREE_ID_ATOM(&ids[1])) == &decls[4]);
+	symtab_leave_scope();
+	assert(symtab_lookup(TREE_ID_ATOM(&ids[1])) == &decls[1]);
+	assert(symtab_lookup(TREE_ID_ATOM(&ids[0])) == &decls[3]);
+	
+	symtab_leave_scope();
+	assert(symtab_lookup(TREE_ID_ATOM(&ids[0])) == &decls[0]);
+	assert(!symtab_lookup(TREE_ID_ATOM(&ids[2])));
+	
+	symtab_leave_scope();
+	assert(symtab_scope_depth() == 0);
+	for (i = 0; i != N_DECLS; ++i)
+		assert(!symtab_lookup(TREE_ID_ATOM(&ids[i])));
+	
+	// Deep nesting grows the log and the marks, and unwinds them all.
+	enum { N_DEPTH = 1000 };
+	symtab_enter_scope();
+	assert(!symtab_declare(&decls[0]));
+	for (i = 0; i != N_DEPTH; ++i) {
+		symtab_enter_scope();
+		assert(!symtab_declare(&decls[i % 2 ? 0 : 3]));
+		assert(!symtab_declare(&decls[1]));
+	}
+	assert(symtab_lookup(TREE_ID_ATOM(&ids[0])) == &decls[0]);
+	for (i = 0; i != N_DEPTH; ++i)
+		symtab_leave_scope();
+	assert(symtab_lookup(TREE_ID_ATOM(&ids[0])) == &decls[0]);
+	assert(!symtab_lookup(TREE_ID_ATOM(&ids[1])));
+	symtab_leave_scope();
+	
+	symtab_finit();
+	atom_finit();
+#	endif
+	
+	printf("test symtab ok\n");
+}
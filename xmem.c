@@ -1,28 +1,221 @@
 #include "javac.h"
 
-static int n_malloc;
-static int n_free;
+#include <pthread.h>
 
-void *xmalloc(size_t size)
+// Every block from xmalloc() starts with a header telling its size,
+// the phase it was made in and the site that made it, so that xfree()
+// can give the bytes back to the same counters.
+// The header keeps the block aligned as malloc() would.
+#define XMEM_HEADER_SIZE 16
+
+typedef struct _xmem_header_t {
+	size_t size;
+	uint16_t phase;
+	uint16_t site;
+} xmem_header_t, *pxmem_header_t;
+
+typedef struct _xmem_counters_t {
+	uint64_t n_alloc;
+	uint64_t n_free;
+	uint64_t n_realloc;
+	uint64_t bytes_alloc;
+	uint64_t bytes_free;
+	uint64_t peak;
+} xmem_counters_t, *pxmem_counters_t;
+
+// Counters are bumped from any thread, relaxed: they are statistics,
+// nothing is ordered by them.
+#define XMEM_ADD(V, N) __atomic_add_fetch(&(V), (N), __ATOMIC_RELAXED)
+#define XMEM_LOAD(V) __atomic_load_n(&(V), __ATOMIC_RELAXED)
+
+// Allocation counts by size: bucket 0 holds sizes up to 16 bytes,
+// bucket k sizes up to 16 << k, the last one everything larger.
+#define XMEM_N_BUCKETS 20
+
+// Call sites, with XMEM_SITES only. Site 0 stands for unknown.
+#define XMEM_MAX_SITES 1024
+
+typedef struct _xmem_site_t {
+	const char *file;
+	int line;
+	xmem_counters_t counters;
+} xmem_site_t, *pxmem_site_t;
+
+static const char *xmem_phase_names[XMEM_N_PHASES] = {
+	"main", "lex", "parse", "check", "codegen"
+};
+
+static int xmem_curr_phase;
+static uint64_t xmem_live;
+static uint64_t xmem_peak;
+static xmem_counters_t xmem_phases[XMEM_N_PHASES];
+static uint64_t xmem_buckets[XMEM_N_BUCKETS];
+static xmem_site_t xmem_sites[XMEM_MAX_SITES];
+static pthread_mutex_t xmem_sites_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline void xmem_raise(uint64_t *ppeak, uint64_t live)
+{
+	uint64_t peak = XMEM_LOAD(*ppeak);
+	while (live > peak &&
+		!__atomic_compare_exchange_n(ppeak, &peak, live, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+// Allocations from now on are counted for this phase.
+// What is live when it starts counts towards its peak,
+// even if the phase itself never grows it.
+void xmem_phase(xmem_phase_t phase)
+{
+	assert(phase >= 0 && phase < XMEM_N_PHASES);
+	
+	__atomic_store_n(&xmem_curr_phase, phase, __ATOMIC_RELAXED);
+	xmem_raise(&xmem_phases[phase].peak, XMEM_LOAD(xmem_live));
+}
+
+// Live bytes went up by size: raise the peak overall
+// and the peak of the phase running now.
+static inline void xmem_grow_live(uint64_t size)
+{
+	uint64_t live = XMEM_ADD(xmem_live, size);
+	xmem_raise(&xmem_peak, live);
+	xmem_raise(&xmem_phases[__atomic_load_n(&xmem_curr_phase, __ATOMIC_RELAXED)].peak, live);
+}
+
+static inline int xmem_bucket(size_t size)
+{
+	int bucket = 0;
+	while (bucket < XMEM_N_BUCKETS - 1 && size > ((size_t)16 << bucket))
+		bucket++;
+	
+	return bucket;
+}
+
+// Finds or claims the slot of a site. Published slots are read
+// without the lock: a slot's line is set before its file.
+static int xmem_site(const char *file, int line)
+{
+	if (!file)
+		return 0;
+	
+	unsigned hash = ((uintptr_t)file >> 3) * 31 + line;
+	unsigned i = hash % (XMEM_MAX_SITES - 1) + 1;
+	unsigned n;
+	for (n = 1; n != XMEM_MAX_SITES; ++n) {
+		pxmem_site_t site = &xmem_sites[i];
+		const char *site_file = __atomic_load_n(&site->file, __ATOMIC_ACQUIRE);
+		
+		if (!site_file) {
+			pthread_mutex_lock(&xmem_sites_lock);
+			if (!site->file) {
+				site->line = line;
+				__atomic_store_n(&site->file, file, __ATOMIC_RELEASE);
+			}
+			site_file = site->file;
+			pthread_mutex_unlock(&xmem_sites_lock);
+		}
+		
+		if (site_file == file && site->line == line)
+			return i;
+		
+		if (++i == XMEM_MAX_SITES)
+			i = 1;
+	}
+	
+	// Table full, the rest is unknown.
+	return 0;
+}
+
+static void xmem_count_alloc(pxmem_header_t header, size_t size, const char *file, int line)
 {
-	void *p = malloc(size);
+	header->size = size;
+	header->phase = __atomic_load_n(&xmem_curr_phase, __ATOMIC_RELAXED);
+	header->site = xmem_site(file, line);
 	
+	pxmem_counters_t phase = &xmem_phases[header->phase];
+	pxmem_counters_t site = &xmem_sites[header->site].counters;
+	XMEM_ADD(phase->n_alloc, 1);
+	XMEM_ADD(phase->bytes_alloc, size);
+	XMEM_ADD(site->n_alloc, 1);
+	XMEM_ADD(site->bytes_alloc, size);
+	XMEM_ADD(xmem_buckets[xmem_bucket(size)], 1);
+	xmem_grow_live(size);
+}
+
+static void xmem_count_free(pxmem_header_t header)
+{
+	pxmem_counters_t phase = &xmem_phases[header->phase];
+	pxmem_counters_t site = &xmem_sites[header->site].counters;
+	XMEM_ADD(phase->n_free, 1);
+	XMEM_ADD(phase->bytes_free, header->size);
+	XMEM_ADD(site->n_free, 1);
+	XMEM_ADD(site->bytes_free, header->size);
+	XMEM_ADD(xmem_live, -(uint64_t)header->size);
+}
+
+// Defined with parenthesized names, so that the XMEM_SITES macros
+// in javac.h do not apply here.
+void *(xmalloc)(size_t size)
+{
+	return xmalloc_at(size, NULL, 0);
+}
+
+void *(xrealloc)(void *p, size_t size)
+{
+	return xrealloc_at(p, size, NULL, 0);
+}
+
+void *xmalloc_at(size_t size, const char *file, int line)
+{
+	pxmem_header_t header = malloc(XMEM_HEADER_SIZE + size);
+	
+	if (!header)
+		fatal("not enough memory");
+	
+	xmem_count_alloc(header, size, file, line);
+	
+	return (char *)header + XMEM_HEADER_SIZE;
+}
+
+// Grows (or allocates, if p is NULL) a block.
+// The block stays with the phase and site that made it.
+void *xrealloc_at(void *p, size_t size, const char *file, int line)
+{
 	if (!p)
+		return xmalloc_at(size, file, line);
+	
+	pxmem_header_t header = (pxmem_header_t)((char *)p - XMEM_HEADER_SIZE);
+	size_t old_size = header->size;
+	
+	header = realloc(header, XMEM_HEADER_SIZE + size);
+	if (!header)
 		fatal("not enough memory");
-		
-	n_malloc++;
+	header->size = size;
 	
-	return p;
+	pxmem_counters_t phase = &xmem_phases[header->phase];
+	pxmem_counters_t site = &xmem_sites[header->site].counters;
+	XMEM_ADD(phase->n_realloc, 1);
+	XMEM_ADD(site->n_realloc, 1);
+	if (size > old_size) {
+		XMEM_ADD(phase->bytes_alloc, size - old_size);
+		XMEM_ADD(site->bytes_alloc, size - old_size);
+		xmem_grow_live(size - old_size);
+	} else {
+		XMEM_ADD(phase->bytes_free, old_size - size);
+		XMEM_ADD(site->bytes_free, old_size - size);
+		XMEM_ADD(xmem_live, -(uint64_t)(old_size - size));
+	}
+	
+	return (char *)header + XMEM_HEADER_SIZE;
 }
 
 void xfree(void *p)
 {
 	if (!p)
 		return;
-		
-	free(p);
 	
-	n_free++;
+	pxmem_header_t header = (pxmem_header_t)((char *)p - XMEM_HEADER_SIZE);
+	xmem_count_free(header);
+	free(header);
 }
 
 char *xstrdup(const char *src)
@@ -34,7 +227,390 @@ char *xstrdup(const char *src)
 	return strcpy(dst, src);
 }
 
+// Arenas hand out memory from large chunks and free it all at once.
+// A request larger than a chunk gets a chunk of its own.
+#define ARENA_CHUNK_SIZE (64 * 1024)
+#define ARENA_ALIGN 8
+
+void *arena_alloc(parena_t arena, size_t size)
+{
+	assert(arena);
+	
+	size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+	
+	parena_chunk_t chunk = arena->chunks;
+	if (!chunk || chunk->size - chunk->used < size) {
+		size_t chunk_size = size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE;
+		chunk = xmalloc(sizeof(arena_chunk_t) + chunk_size);
+		chunk->size = chunk_size;
+		chunk->used = 0;
+		chunk->next = arena->chunks;
+		arena->chunks = chunk;
+	}
+	
+	void *p = chunk->data + chunk->used;
+	chunk->used += size;
+	
+	return p;
+}
+
+// The same, for an arena any number of threads allocate from at once.
+// The head chunk is bumped with an atomic add; when it is full, every
+// thread that finds it so makes a new chunk and only one of them gets
+// it in, the others free theirs. An arena is used with only one of
+// arena_alloc() and arena_alloc_shared(): the add may overshoot the
+// end of a full chunk, which wastes its tail but confuses arena_alloc().
+void *arena_alloc_shared(parena_t arena, size_t size)
+{
+	assert(arena);
+	
+	size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+	
+	parena_chunk_t chunk = __atomic_load_n(&arena->chunks, __ATOMIC_ACQUIRE);
+	while (true) {
+		if (chunk && size <= chunk->size) {
+			size_t used = __atomic_fetch_add(&chunk->used, size, __ATOMIC_RELAXED);
+			if (used + size <= chunk->size)
+				return chunk->data + used;
+		}
+		
+		size_t chunk_size = size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE;
+		parena_chunk_t fresh = xmalloc(sizeof(arena_chunk_t) + chunk_size);
+		fresh->size = chunk_size;
+		fresh->used = size;
+		fresh->next = chunk;
+		if (__atomic_compare_exchange_n(&arena->chunks, &chunk, fresh, false,
+			__ATOMIC_RELEASE, __ATOMIC_ACQUIRE))
+			return fresh->data;
+		
+		// Another thread put a chunk in first, chunk is now that one.
+		xfree(fresh);
+	}
+}
+
+void arena_free(parena_t arena)
+{
+	assert(arena);
+	
+	parena_chunk_t chunk = arena->chunks;
+	while (chunk) {
+		parena_chunk_t next = chunk->next;
+		xfree(chunk);
+		chunk = next;
+	}
+	
+	arena->chunks = NULL;
+}
+
+arena_mark_t arena_mark(parena_t arena)
+{
+	assert(arena);
+	
+	arena_mark_t mark = { arena->chunks, arena->chunks ? arena->chunks->used : 0 };
+	return mark;
+}
+
+// Gives back everything made since mark, which must still be in the
+// arena. Of the chunks made since, the first one is kept, emptied, to
+// fill again: an arena released over and over stays off malloc. The
+// tail of the chunk of the mark is then left unused.
+void arena_release(parena_t arena, arena_mark_t mark)
+{
+	assert(arena);
+	
+	parena_chunk_t chunk = arena->chunks;
+	while (chunk != mark.chunk && chunk->next != mark.chunk) {
+		parena_chunk_t next = chunk->next;
+		xfree(chunk);
+		chunk = next;
+	}
+	
+	arena->chunks = chunk;
+	if (chunk == mark.chunk) {
+		if (chunk)
+			chunk->used = mark.used;
+	} else {
+		chunk->used = 0;
+	}
+}
+
+// Hands the chunks of from over to into, which frees them with its own.
+// from is left empty. The head chunk of into stays the one it bumps.
+void arena_merge(parena_t into, parena_t from)
+{
+	assert(into);
+	assert(from);
+	
+	parena_chunk_t last = from->chunks;
+	if (!last)
+		return;
+	
+	while (last->next)
+		last = last->next;
+	
+	if (into->chunks) {
+		last->next = into->chunks->next;
+		into->chunks->next = from->chunks;
+	} else {
+		into->chunks = from->chunks;
+	}
+	
+	from->chunks = NULL;
+}
+
+// Pools hand out small blocks from per-thread free lists, one per
+// size class of POOL_GRAIN bytes: a freed block is handed out again
+// before any new memory, so containers that insert and remove all the
+// time stay off malloc. New blocks are cut from an arena, given back
+// by pool_finit() only. A block starts with the class it belongs to,
+// so pool_free() needs no size; a block too large for any class is
+// passed on to xmalloc().
+#define POOL_GRAIN 16
+#define POOL_CLASSES 16
+#define POOL_LARGE POOL_CLASSES
+
+typedef union _pool_block_t {
+	union _pool_block_t *next;	// On a free list.
+	size_t size_class;			// Handed out.
+} pool_block_t, *ppool_block_t;
+
+static __thread ppool_block_t pool_free_lists[POOL_CLASSES];
+static __thread arena_t pool_arena;
+
+void *pool_alloc(size_t size)
+{
+	size_t size_class = size ? (size - 1) / POOL_GRAIN : 0;
+	
+	ppool_block_t block;
+	if (size_class >= POOL_CLASSES) {
+		block = xmalloc(sizeof(pool_block_t) + size);
+		size_class = POOL_LARGE;
+	} else if (pool_free_lists[size_class]) {
+		block = pool_free_lists[size_class];
+		pool_free_lists[size_class] = block->next;
+	} else {
+		block = arena_alloc(&pool_arena, sizeof(pool_block_t) + (size_class + 1) * POOL_GRAIN);
+	}
+	
+	block->size_class = size_class;
+	return block + 1;
+}
+
+void pool_free(void *p)
+{
+	if (!p)
+		return;
+	
+	ppool_block_t block = (ppool_block_t)p - 1;
+	size_t size_class = block->size_class;
+	if (size_class == POOL_LARGE) {
+		xfree(block);
+		return;
+	}
+	
+	assert(size_class < POOL_CLASSES);
+	block->next = pool_free_lists[size_class];
+	pool_free_lists[size_class] = block;
+}
+
+// Releases every block of this thread's pools, in use or not.
+void pool_finit()
+{
+	arena_free(&pool_arena);
+	memset(pool_free_lists, 0, sizeof(pool_free_lists));
+}
+
+void pool_unittest()
+{
+#	ifndef NDEBUG
+	// A freed block is the next one handed out in its class,
+	// and only in its class.
+	char *p = pool_alloc(24);
+	memset(p, 1, 24);
+	pool_free(p);
+	assert(pool_alloc(17) == p);
+	char *q = pool_alloc(16);
+	assert(q != p);
+	pool_free(q);
+	assert(pool_alloc(1) == q);
+	assert(pool_alloc(0) != q);
+	pool_free(p);
+	
+	// Large blocks go to xmalloc().
+	char *large = pool_alloc(POOL_GRAIN * POOL_CLASSES + 1);
+	memset(large, 2, POOL_GRAIN * POOL_CLASSES + 1);
+	pool_free(large);
+	
+	// Blocks do not overlap.
+	enum { N_BLOCKS = 1000 };
+	char *blocks[N_BLOCKS];
+	int i;
+	for (i = 0; i < N_BLOCKS; ++i) {
+		blocks[i] = pool_alloc(i % 100);
+		memset(blocks[i], i & 0xFF, i % 100);
+	}
+	for (i = 0; i < N_BLOCKS; ++i) {
+		int k;
+		for (k = 0; k < i % 100; ++k)
+			assert(blocks[i][k] == (char)(i & 0xFF));
+		pool_free(blocks[i]);
+	}
+	
+	pool_finit();
+#	endif
+	
+	printf("test pool ok\n");
+}
+
+static void xmem_report_counters(FILE *fp, pxmem_counters_t counters)
+{
+	uint64_t bytes_alloc = XMEM_LOAD(counters->bytes_alloc);
+	uint64_t bytes_free = XMEM_LOAD(counters->bytes_free);
+	
+	fprintf(fp, " allocs=%llu frees=%llu reallocs=%llu bytes=%llu live=%llu",
+		(unsigned long long)XMEM_LOAD(counters->n_alloc),
+		(unsigned long long)XMEM_LOAD(counters->n_free),
+		(unsigned long long)XMEM_LOAD(counters->n_realloc),
+		(unsigned long long)bytes_alloc,
+		(unsigned long long)(bytes_alloc - bytes_free)
+		);
+}
+
+// Writes every counter, one record per line: a word naming the record,
+// then key=value pairs. Bytes are requested bytes, without headers or
+// malloc() overhead; live is what is still held of them.
+//   xmem live=<bytes> peak=<bytes> allocs=<n> frees=<n> reallocs=<n>
+//   xmem.phase name=<phase> allocs=... live=<bytes> peak=<bytes>
+//   xmem.size le=<bytes>|gt=<bytes> allocs=<n>
+//   xmem.site file=<file> line=<line> allocs=... live=<bytes>
+// A phase's counters are those of the blocks made while it ran,
+// its peak is the highest total live while it ran.
+// Sites are only known when built with XMEM_SITES.
+void xmem_report(FILE *fp)
+{
+	xmem_counters_t total;
+	memset(&total, 0, sizeof(total));
+	int i;
+	for (i = 0; i != XMEM_N_PHASES; ++i) {
+		total.n_alloc += XMEM_LOAD(xmem_phases[i].n_alloc);
+		total.n_free += XMEM_LOAD(xmem_phases[i].n_free);
+		total.n_realloc += XMEM_LOAD(xmem_phases[i].n_realloc);
+	}
+	
+	fprintf(fp, "xmem live=%llu peak=%llu allocs=%llu frees=%llu reallocs=%llu\n",
+		(unsigned long long)XMEM_LOAD(xmem_live),
+		(unsigned long long)XMEM_LOAD(xmem_peak),
+		(unsigned long long)total.n_alloc,
+		(unsigned long long)total.n_free,
+		(unsigned long long)total.n_realloc
+		);
+	
+	for (i = 0; i != XMEM_N_PHASES; ++i) {
+		fprintf(fp, "xmem.phase name=%s", xmem_phase_names[i]);
+		xmem_report_counters(fp, &xmem_phases[i]);
+		fprintf(fp, " peak=%llu\n", (unsigned long long)XMEM_LOAD(xmem_phases[i].peak));
+	}
+	
+	for (i = 0; i != XMEM_N_BUCKETS; ++i) {
+		uint64_t n = XMEM_LOAD(xmem_buckets[i]);
+		if (!n)
+			continue;
+		if (i == XMEM_N_BUCKETS - 1)
+			fprintf(fp, "xmem.size gt=%llu", (unsigned long long)16 << (i - 1));
+		else
+			fprintf(fp, "xmem.size le=%llu", (unsigned long long)16 << i);
+		fprintf(fp, " allocs=%llu\n", (unsigned long long)n);
+	}
+	
+	for (i = 1; i != XMEM_MAX_SITES; ++i) {
+		pxmem_site_t site = &xmem_sites[i];
+		const char *file = __atomic_load_n(&site->file, __ATOMIC_ACQUIRE);
+		if (!file)
+			continue;
+		fprintf(fp, "xmem.site file=%s line=%d", file, site->line);
+		xmem_report_counters(fp, &site->counters);
+		fprintf(fp, "\n");
+	}
+}
+
+void xmem_unittest()
+{
+#	ifndef NDEBUG
+	assert(sizeof(xmem_header_t) <= XMEM_HEADER_SIZE);
+	assert(xmem_bucket(0) == 0 && xmem_bucket(16) == 0);
+	assert(xmem_bucket(17) == 1 && xmem_bucket(32) == 1);
+	assert(xmem_bucket((size_t)-1) == XMEM_N_BUCKETS - 1);
+	
+	// The counters are put back as they were at the end,
+	// the copies are not counted themselves.
+	uint64_t peak = xmem_peak;
+	xmem_counters_t *phases = malloc(sizeof(xmem_phases));
+	uint64_t *buckets = malloc(sizeof(xmem_buckets));
+	xmem_site_t *sites = malloc(sizeof(xmem_sites));
+	assert(phases && buckets && sites);
+	memcpy(phases, xmem_phases, sizeof(xmem_phases));
+	memcpy(buckets, xmem_buckets, sizeof(xmem_buckets));
+	memcpy(sites, xmem_sites, sizeof(xmem_sites));
+	
+	// Live bytes follow xmalloc(), xrealloc() and xfree(),
+	// and a block stays with the phase it was made in.
+	uint64_t live = xmem_live;
+	xmem_counters_t codegen = xmem_phases[XMEM_PHASE_CODEGEN];
+	xmem_phases[XMEM_PHASE_CODEGEN].peak = 0;
+	xmem_phase(XMEM_PHASE_CODEGEN);
+	assert(xmem_phases[XMEM_PHASE_CODEGEN].peak == live);
+	char *p = xmalloc(100);
+	assert(xmem_live == live + 100);
+	assert(xmem_peak >= live + 100);
+	assert(xmem_phases[XMEM_PHASE_CODEGEN].n_alloc == codegen.n_alloc + 1);
+	xmem_phase(XMEM_PHASE_MAIN);
+	p = xrealloc(p, 1000);
+	assert(xmem_live == live + 1000);
+	assert(xmem_phases[XMEM_PHASE_CODEGEN].bytes_alloc == codegen.bytes_alloc + 1000);
+	p = xrealloc(p, 10);
+	assert(xmem_live == live + 10);
+	xfree(p);
+	assert(xmem_live == live);
+	assert(xmem_phases[XMEM_PHASE_CODEGEN].n_free == codegen.n_free + 1);
+	assert(xmem_phases[XMEM_PHASE_CODEGEN].bytes_free == codegen.bytes_free + 1000);
+	
+	// Sites are told apart by file and line.
+	int a = xmem_site("xmem_test.c", 1);
+	int b = xmem_site("xmem_test.c", 2);
+	assert(a && b && a != b);
+	assert(xmem_site("xmem_test.c", 1) == a);
+	assert(xmem_site(NULL, 1) == 0);
+	p = xmalloc_at(7, "xmem_test.c", 2);
+	assert(xmem_sites[b].counters.n_alloc == 1);
+	assert(xmem_sites[b].counters.bytes_alloc == 7);
+	xfree(p);
+	assert(xmem_sites[b].counters.bytes_free == 7);
+	
+	xmem_peak = peak;
+	memcpy(xmem_phases, phases, sizeof(xmem_phases));
+	memcpy(xmem_buckets, buckets, sizeof(xmem_buckets));
+	memcpy(xmem_sites, sites, sizeof(xmem_sites));
+	free(phases);
+	free(buckets);
+	free(sites);
+#	endif
+	
+	printf("test xmem ok\n");
+}
+
 void xstat()
 {
-	printf("stats for memory usage: %d allocations, %d deallocations.\n", n_malloc, n_free);
-}
\ No newline at end of file
+	uint64_t n_malloc = 0, n_free = 0;
+	int i;
+	for (i = 0; i != XMEM_N_PHASES; ++i) {
+		n_malloc += XMEM_LOAD(xmem_phases[i].n_alloc);
+		n_free += XMEM_LOAD(xmem_phases[i].n_free);
+	}
+	
+	printf("stats for memory usage: %llu allocations, %llu deallocations, %llu bytes live, %llu bytes at peak.\n",
+		(unsigned long long)n_malloc,
+		(unsigned long long)n_free,
+		(unsigned long long)XMEM_LOAD(xmem_live),
+		(unsigned long long)XMEM_LOAD(xmem_peak)
+		);
+}